@@ -0,0 +1,48 @@
+#include "AlphaBlendState.h"
+
+ID3D11BlendState* AlphaBlendState::s_state = nullptr;
+unsigned int AlphaBlendState::s_users = 0;
+
+void AlphaBlendState::Acquire(ID3D11Device* device)
+{
+	s_users++;
+	if (s_state)
+		return;
+
+	//colour over what is behind it; alpha accumulates coverage the same way
+	D3D11_BLEND_DESC desc = {};
+	desc.RenderTarget[0].BlendEnable = true;
+	desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	desc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	desc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	device->CreateBlendState(&desc, &s_state);
+}
+
+void AlphaBlendState::Release()
+{
+	if (s_users == 0 || --s_users > 0)
+		return;
+
+	if (s_state) s_state->Release();
+	s_state = nullptr;
+}
+
+ID3D11BlendState* AlphaBlendState::Bind(ID3D11DeviceContext* context)
+{
+	ID3D11BlendState* previous = nullptr;
+	FLOAT factor[4];
+	UINT mask;
+	context->OMGetBlendState(&previous, factor, &mask);
+	context->OMSetBlendState(s_state, nullptr, 0xffffffff);
+	return previous;
+}
+
+void AlphaBlendState::Restore(ID3D11DeviceContext* context, ID3D11BlendState* previous)
+{
+	context->OMSetBlendState(previous, nullptr, 0xffffffff);
+	if (previous) previous->Release();
+}
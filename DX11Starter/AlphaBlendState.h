@@ -0,0 +1,24 @@
+#pragma once
+
+#include <d3d11.h>
+
+//the alpha over blend state (SRC_ALPHA, INV_SRC_ALPHA) that depth sorted emitters draw with
+//additive particles come out the same in any order, so back to front only pays off under this state; unsorted
+//emitters keep whatever blend the scene binds for them
+//shared and reference counted like QuadIndexBuffer
+class AlphaBlendState
+{
+private:
+	static ID3D11BlendState* s_state;
+	static unsigned int s_users;
+
+public:
+	static void Acquire(ID3D11Device* device);
+	static void Release();
+
+	static ID3D11BlendState* Get() { return s_state; }
+
+	//binds the alpha over state and returns the state bound before, with a reference Restore gives back
+	static ID3D11BlendState* Bind(ID3D11DeviceContext* context);
+	static void Restore(ID3D11DeviceContext* context, ID3D11BlendState* previous);
+};
@@ -0,0 +1,147 @@
+#include "DepthSort.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	const unsigned int c_digitBits = 11;
+	const unsigned int c_bucketCount = 1 << c_digitBits;
+	const unsigned int c_digitMask = c_bucketCount - 1;
+	const unsigned int c_keyBits = c_digitBits * 2;
+	const unsigned int c_keyMax = (1 << c_keyBits) - 1;
+
+	//below this a single thread wins, and chunks are never smaller than this either
+	const unsigned int c_parallelCount = 32768;
+	const unsigned int c_minChunk = 16384;
+
+	//turns the per chunk digit counts into scatter offsets, chunk by chunk within a bucket so the sort stays stable
+	void PrefixOffsets(unsigned int* histograms, unsigned int chunkCount)
+	{
+		unsigned int running = 0;
+		for (unsigned int bucket = 0; bucket < c_bucketCount; bucket++)
+		{
+			for (unsigned int chunk = 0; chunk < chunkCount; chunk++)
+			{
+				unsigned int& slot = histograms[chunk * c_bucketCount + bucket];
+				unsigned int bucketCount = slot;
+				slot = running;
+				running += bucketCount;
+			}
+		}
+	}
+}
+
+void SortBackToFront(const float* depth, unsigned int count, unsigned int* order, DepthSortScratch& scratch, JobSystem* jobs)
+{
+	if (count == 0)
+		return;
+
+	//one chunk per thread, unless that would make them too small to pay for the job
+	unsigned int chunkCount = 1;
+	if (jobs && count >= c_parallelCount)
+		chunkCount = std::min(jobs->GetWorkerCount() + 1, count / c_minChunk);
+	unsigned int chunkSize = (count + chunkCount - 1) / chunkCount;
+	chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	scratch.keys.resize(count);
+	scratch.keysTemp.resize(count);
+	scratch.orderTemp.resize(count);
+	scratch.histograms.resize(chunkCount * c_bucketCount);
+	scratch.chunkMin.resize(chunkCount);
+	scratch.chunkMax.resize(chunkCount);
+
+	unsigned int* keys = scratch.keys.data();
+	unsigned int* keysTemp = scratch.keysTemp.data();
+	unsigned int* orderTemp = scratch.orderTemp.data();
+	unsigned int* histograms = scratch.histograms.data();
+
+	auto forEachChunk = [&](const JobSystem::RangeJob& pass)
+	{
+		auto chunkRange = [&pass, chunkSize, count](unsigned int chunk)
+		{
+			pass(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+		};
+
+		if (chunkCount == 1)
+		{
+			chunkRange(0);
+			return;
+		}
+
+		JobGroup group;
+		jobs->ParallelFor(group, chunkCount, 1, [&chunkRange](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int chunk = begin; chunk < end; chunk++)
+				chunkRange(chunk);
+		});
+		jobs->Wait(group);
+	};
+
+	//the depth range, so the quantization spends all 22 bits on the depths actually present
+	//only finite depths count, one NaN would otherwise turn the whole range and every key into nothing
+	forEachChunk([&](unsigned int begin, unsigned int end)
+	{
+		float low = std::numeric_limits<float>::max(), high = -std::numeric_limits<float>::max();
+		for (unsigned int i = begin; i < end; i++)
+		{
+			if (!std::isfinite(depth[i]))
+				continue;
+			low = std::min(low, depth[i]);
+			high = std::max(high, depth[i]);
+		}
+		scratch.chunkMin[begin / chunkSize] = low;
+		scratch.chunkMax[begin / chunkSize] = high;
+	});
+
+	float nearest = *std::min_element(scratch.chunkMin.begin(), scratch.chunkMin.end());
+	float farthest = *std::max_element(scratch.chunkMax.begin(), scratch.chunkMax.end());
+	float scale = farthest > nearest ? c_keyMax / (farthest - nearest) : 0.0f;
+
+	//keys grow towards the camera, so an ascending sort is back to front
+	forEachChunk([&](unsigned int begin, unsigned int end)
+	{
+		unsigned int* histogram = histograms + (begin / chunkSize) * c_bucketCount;
+		std::fill(histogram, histogram + c_bucketCount, 0);
+
+		for (unsigned int i = begin; i < end; i++)
+		{
+			float quantized = (farthest - depth[i]) * scale;
+			unsigned int key = std::isfinite(depth[i]) && quantized > 0.0f ? std::min((unsigned int)quantized, c_keyMax) : 0;
+			keys[i] = key;
+			histogram[key & c_digitMask]++;
+		}
+	});
+	PrefixOffsets(histograms, chunkCount);
+
+	//low digit, the input order is the identity so there is nothing to read for it
+	forEachChunk([&](unsigned int begin, unsigned int end)
+	{
+		unsigned int* offsets = histograms + (begin / chunkSize) * c_bucketCount;
+		for (unsigned int i = begin; i < end; i++)
+		{
+			unsigned int slot = offsets[keys[i] & c_digitMask]++;
+			keysTemp[slot] = keys[i];
+			orderTemp[slot] = i;
+		}
+	});
+
+	forEachChunk([&](unsigned int begin, unsigned int end)
+	{
+		unsigned int* histogram = histograms + (begin / chunkSize) * c_bucketCount;
+		std::fill(histogram, histogram + c_bucketCount, 0);
+
+		for (unsigned int i = begin; i < end; i++)
+			histogram[keysTemp[i] >> c_digitBits]++;
+	});
+	PrefixOffsets(histograms, chunkCount);
+
+	//high digit, straight into the caller's order
+	forEachChunk([&](unsigned int begin, unsigned int end)
+	{
+		unsigned int* offsets = histograms + (begin / chunkSize) * c_bucketCount;
+		for (unsigned int i = begin; i < end; i++)
+			order[offsets[keysTemp[i] >> c_digitBits]++] = orderTemp[i];
+	});
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+class JobSystem;
+
+//buffers reused by SortBackToFront, so sorting every frame stops allocating once they have grown
+struct DepthSortScratch
+{
+	std::vector<unsigned int> keys, keysTemp, orderTemp;
+	std::vector<unsigned int> histograms;
+	std::vector<float> chunkMin, chunkMax;
+};
+
+//writes the indices 0..count-1 to order, farthest depth first, for back to front alpha blending
+//depths are quantized to 22 bits over their own range and sorted by two 11 bit LSD radix passes,
+//only the indices move, never the particles; equal keys keep their input order
+//NaN and infinite depths take no part in the range and sort with the farthest, in their input order
+//with a JobSystem and enough depths, every pass splits its histogram and scatter across the pool
+void SortBackToFront(const float* depth, unsigned int count, unsigned int* order, DepthSortScratch& scratch, JobSystem* jobs = nullptr);
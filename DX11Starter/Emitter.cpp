@@ -1,4 +1,5 @@
 #include "Emitter.h"
+#include <cmath>
 #include <iostream>
 #include <vector>
 Emitter::Emitter(
@@ -28,285 +29,481 @@ Emitter::Emitter(
 
 	m_timePerEmmission = 1.0f / emitRate;
 
-	m_particleArr = new Particle[m_maxParticles];
-	ZeroMemory(m_particleArr, sizeof(Particle) * m_maxParticles);
+	m_forceField = nullptr;
+	m_surface = nullptr;
+	m_ground = nullptr;
+	m_collision = ParticleCollision{ ParticleCollision_None, 0.0f, 0.0f };
+	UpdateBounds();
+
+	m_particles.Allocate(m_maxParticles);
 
 	m_oldestAlive = 0;
-	m_oldestDead = 0;
 	m_liveParticles = 0;
-	m_timeSinceEmit = 0;
-
-	//m_vertices = new ParticleVertex[4];
-	//m_vertices[0].m_UV = DirectX::XMFLOAT2(0.0f, 0.0f);
-	//m_vertices[1].m_UV = DirectX::XMFLOAT2(1.0f, 0.0f);
-	//m_vertices[2].m_UV = DirectX::XMFLOAT2(1.0f, 1.0f);
-	//m_vertices[3].m_UV = DirectX::XMFLOAT2(0.0f, 1.0f);
-	m_vertices = new ParticleVertex[4 * m_maxParticles];
-	for (unsigned int i = 0; i < m_maxParticles * 4; i += 4)
-	{
-		m_vertices[i].m_UV = DirectX::XMFLOAT2(0.0f, 0.0f);
-		m_vertices[i + 1].m_UV = DirectX::XMFLOAT2(1.0f, 0.0f);
-		m_vertices[i + 2].m_UV = DirectX::XMFLOAT2(1.0f, 1.0f);
-		m_vertices[i + 3].m_UV = DirectX::XMFLOAT2(0.0f, 1.0f);
-	}
 
-	D3D11_BUFFER_DESC vertexDesc = {};
-	vertexDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	vertexDesc.Usage = D3D11_USAGE_DYNAMIC;
-	vertexDesc.ByteWidth = sizeof(ParticleVertex) * 4 * m_maxParticles;
-	//vertexDesc.ByteWidth = sizeof(ParticleVertex) * 4;
-	device->CreateBuffer(&vertexDesc, 0, &m_vbuff);
+	m_randomKey = NextParticleRandomKey();
 
+	//a burst of one second's worth at time zero, then the steady rate
+	m_schedule.burstCount = m_emitRate;
+	m_schedule.interval = m_timePerEmmission;
+	m_time = 0;
+	m_firstLive = 0;
+	m_nextSpawn = 0;
 
-	//std::vector<unsigned int> indexArr = {0,1,2,0,2,3};
-	//unsigned int* indexArr = new unsigned int[6];
-	unsigned int* indexArr = new unsigned int[m_maxParticles * 6];
-	unsigned int index = 0;
-	for (unsigned int i = 0; i < 4 * m_maxParticles; i += 4)
-	//for (unsigned int i = 0; i < 4 ; i += 4)
-	{
-		indexArr[index++] = i;
-		indexArr[index++] = i + 1;
-		indexArr[index++] = i + 2;
-		indexArr[index++] = i;
-		indexArr[index++] = i + 2;
-		indexArr[index++] = i + 3;
-	}
-	/*indexArr[0] = 0;
-	indexArr[1] = 1;
-	indexArr[2] = 2;
-	indexArr[3] = 0;
-	indexArr[4] = 2;
-	indexArr[5] = 3;*/
+	//the quad buffers come with the first quad upload, so an emitter switched to instancing never holds them
+	m_vbuff = nullptr;
+	m_drawOffset = 0;
 
+	m_instanceBuff = nullptr;
+	m_instanceVS = nullptr;
+	m_mapped = nullptr;
 
-	D3D11_SUBRESOURCE_DATA indexData = {};
-	indexData.pSysMem = indexArr;
+	m_detail = 1;
+	m_depthSort = false;
+	m_sortJobs = nullptr;
+	m_drawCount = 0;
+	m_drawGathered = false;
 
-	CD3D11_BUFFER_DESC indexDesc = {};
-	indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexDesc.CPUAccessFlags = 0;
-	indexDesc.Usage = D3D11_USAGE_DEFAULT;
-	//indexDesc.ByteWidth = sizeof(unsigned int) * 6;
-	indexDesc.ByteWidth = sizeof(unsigned int) * 6 * m_maxParticles;
+	AlphaBlendState::Acquire(device);
 
-	device->CreateBuffer(&indexDesc, &indexData, &m_Ibuff);
-	delete[] indexArr;
+	Seek(0);
+}
 
-	for(unsigned int i = 0 ; i < m_emitRate;i++)
-		SpawnParticle();
+Emitter::Emitter(const EmitterDesc& desc, ID3D11Device* device, SimpleVertexShader* vs, SimplePixelShader* ps, ID3D11ShaderResourceView* srv)
+	: Emitter
+	(
+		XMFLOAT3(desc.velocity), XMFLOAT4(desc.startColor), XMFLOAT4(desc.endColor),
+		XMFLOAT4(desc.rotationRange), XMFLOAT3(desc.velocityRange), XMFLOAT3(desc.positionRange),
+		XMFLOAT3(desc.position), XMFLOAT3(desc.acceleration),
+		desc.maxParticles, desc.emitRate, desc.lifeTime, desc.startSize, desc.endSize,
+		device, vs, ps, srv
+	)
+{
 }
 
 Emitter::~Emitter()
 {
-	delete[] m_particleArr;
-	delete[] m_vertices;
-	m_vbuff->Release();
-	m_Ibuff->Release();
+	m_particles.Release();
+	ReleaseQuadBuffers();
+	AlphaBlendState::Release();
+	if (m_instanceBuff) m_instanceBuff->Release();
 }
 
-void Emitter::UpdateParticle(float delta, unsigned int particleIndex)
+void Emitter::CreateQuadBuffers(ID3D11DeviceContext* context)
 {
-	Particle* currentParticle = m_particleArr + particleIndex;
-	if (currentParticle->m_Age >= m_lifeTime)
+	if (m_vbuff)
 		return;
 
-	currentParticle->m_Age += delta;
-	if (currentParticle->m_Age >= m_lifeTime)
-	{
-		m_oldestAlive++;
-		m_oldestAlive %= m_maxParticles;
-		m_liveParticles--;
+	ID3D11Device* device = nullptr;
+	context->GetDevice(&device);
+
+	D3D11_BUFFER_DESC vertexDesc = {};
+	vertexDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	vertexDesc.Usage = D3D11_USAGE_DYNAMIC;
+	vertexDesc.ByteWidth = sizeof(ParticleVertex) * 4 * m_maxParticles * c_uploadRingFrames;
+	device->CreateBuffer(&vertexDesc, 0, &m_vbuff);
+
+	//the vertex buffer is an upload ring measured in quads, drawn through the shared index buffer
+	m_upload.Reset(m_maxParticles * c_uploadRingFrames);
+	QuadIndexBuffer::Acquire(device, m_maxParticles);
+	device->Release();
+}
+
+void Emitter::ReleaseQuadBuffers()
+{
+	if (!m_vbuff)
 		return;
-	}
 
-	using namespace DirectX;
-	float agePercentage = currentParticle->m_Age / m_lifeTime;
-	XMStoreFloat4(&currentParticle->m_Color,
-		XMVectorLerp(XMLoadFloat4(&m_startColor), XMLoadFloat4(&m_endColor), agePercentage));
+	m_vbuff->Release();
+	m_vbuff = nullptr;
+	QuadIndexBuffer::Release();
+}
 
-	currentParticle->m_rotation = currentParticle->m_startRot +
-		agePercentage * (currentParticle->m_endRot - currentParticle->m_startRot);
+void Emitter::EnableInstancing(ID3D11Device* device, SimpleVertexShader* instanceVS)
+{
+	//the instanced path needs neither the quad ring nor the index buffer
+	ReleaseQuadBuffers();
 
-	currentParticle->m_size = m_startSize+ agePercentage * (m_endSize - m_startSize);
-	currentParticle->m_currPosition = m_emitterPosition;
+	if (m_instanceBuff)
+		m_instanceBuff->Release();
 
-	XMVECTOR startPos = XMLoadFloat3(&currentParticle->m_startPosition);
-	XMVECTOR startVelocity = XMLoadFloat3(&currentParticle->m_startVeloctiy);
-	XMVECTOR acc = XMLoadFloat3(&m_emitterAcceleration);
-	float t = currentParticle->m_Age;
+	D3D11_BUFFER_DESC instanceDesc = {};
+	instanceDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	instanceDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	instanceDesc.Usage = D3D11_USAGE_DYNAMIC;
+	instanceDesc.ByteWidth = sizeof(unsigned int) * c_particleInstanceWords * m_maxParticles * c_uploadRingFrames;
+	device->CreateBuffer(&instanceDesc, 0, &m_instanceBuff);
 
-	XMVECTOR pos = ((acc * t * t) / 2.0f) + (startVelocity * t) + startPos;
+	m_instanceUpload.Reset(m_maxParticles * c_uploadRingFrames);
+	m_instanceVS = instanceVS;
+}
 
-	XMStoreFloat3(&currentParticle->m_currPosition, pos);
+void Emitter::SetDepthSort(bool enabled, JobSystem* jobs)
+{
+	m_depthSort = enabled;
+	m_sortJobs = jobs;
 }
 
-void Emitter::UpdateEmitter(float delta)
+void Emitter::SetForceField(const ForceField* field)
 {
-	//delta /= 100;
-	if (m_oldestAlive < m_oldestDead)
+	m_forceField = field;
+	UpdateBounds();
+}
+
+void Emitter::SetSurface(const MeshSampler* surface)
+{
+	m_surface = surface;
+	UpdateBounds();
+
+	//nothing resident, so Seek respawns every live particle where the new surface puts it
+	m_firstLive = 0;
+	m_nextSpawn = 0;
+	Seek(m_time);
+}
+
+void Emitter::SetCollision(const Heightfield* ground, const ParticleCollision& collision)
+{
+	m_ground = ground;
+	m_collision = collision;
+	UpdateBounds();
+}
+
+void Emitter::UpdateBounds()
+{
+	//everything the particles can reach over their life, for culling
+	ParticleMotion motion =
+	{
+		{ m_emitterPosition.x, m_emitterPosition.y, m_emitterPosition.z }, { m_positionRange.x, m_positionRange.y, m_positionRange.z },
+		{ m_startVelocity.x, m_startVelocity.y, m_startVelocity.z }, { m_velocityRange.x, m_velocityRange.y, m_velocityRange.z },
+		{ m_emitterAcceleration.x, m_emitterAcceleration.y, m_emitterAcceleration.z },
+		m_lifeTime, max(m_startSize, m_endSize)
+	};
+
+	//on a surface the start positions are the mesh's box at the emitter
+	if (m_surface)
 	{
-		for (unsigned int i = m_oldestAlive; i < m_oldestDead; i++)
+		const ParticleBounds& mesh = m_surface->GetBounds();
+		for (unsigned int axis = 0; axis < 3; axis++)
 		{
-			UpdateParticle(delta, i);
+			motion.origin[axis] += 0.5f * (mesh.min[axis] + mesh.max[axis]);
+			motion.posRange[axis] = 0.5f * (mesh.max[axis] - mesh.min[axis]);
 		}
 	}
-	else
+	m_bounds = ComputeParticleBounds(motion);
+
+	//a bounce turns a particle somewhere off its closed form path, but never further from its spawn box than its top speed takes it
+	if (m_ground && m_collision.mode == ParticleCollision_Bounce)
 	{
-		for (unsigned int i = m_oldestAlive; i < m_maxParticles; i++)
+		float reach = GetBounceReach(motion.startVel, motion.velRange, motion.acc, m_lifeTime) + motion.maxSize;
+		for (unsigned int axis = 0; axis < 3; axis++)
 		{
-			UpdateParticle(delta, i);
-		}
-		for (unsigned int i = 0; i < m_oldestDead; i++)
-		{
-			UpdateParticle(delta, i);
+			m_bounds.min[axis] = min(m_bounds.min[axis], motion.origin[axis] - motion.posRange[axis] - reach);
+			m_bounds.max[axis] = max(m_bounds.max[axis], motion.origin[axis] + motion.posRange[axis] + reach);
 		}
 	}
 
-	m_timeSinceEmit += delta;
-
-	while (m_timeSinceEmit > m_timePerEmmission)
+	//a field can only push a particle so far from its closed form path, however it points
+	float reach = m_forceField ? m_forceField->GetReach(m_lifeTime) : 0.0f;
+	for (unsigned int axis = 0; axis < 3; axis++)
 	{
-		SpawnParticle();
-		m_timeSinceEmit -= m_timePerEmmission;
+		m_bounds.min[axis] -= reach;
+		m_bounds.max[axis] += reach;
 	}
 }
 
-void Emitter::SpawnParticle()
+void Emitter::UpdateEmitter(float delta)
 {
-	if (m_liveParticles == m_maxParticles)
+	//particles are only evaluated when they are drawn, so without a field or ground a step is just retiring and spawning
+	Seek(m_time + delta);
+	bool colliding = m_ground && m_collision.mode != ParticleCollision_None;
+	if ((!m_forceField && !colliding) || m_liveParticles == 0)
 		return;
 
-	using namespace DirectX;
-	Particle* firstDeadOne = m_particleArr + m_oldestDead;
-	//Particle* firstDeadOne = m_particleArr;
-	firstDeadOne->m_Age = 0;
-	firstDeadOne->m_size = m_startSize;
-	firstDeadOne->m_Color = m_startColor;
-
-	firstDeadOne->m_startPosition = m_emitterPosition;
-	firstDeadOne->m_startPosition.x += (((float)rand() / RAND_MAX) * 2 - 1) * m_positionRange.x;
-	firstDeadOne->m_startPosition.y += (((float)rand() / RAND_MAX) * 2 - 1) * m_positionRange.y;
-	firstDeadOne->m_startPosition.z += (((float)rand() / RAND_MAX) * 2 - 1) * m_positionRange.z;
-
-	firstDeadOne->m_currPosition = firstDeadOne->m_startPosition;
-
-	firstDeadOne->m_startVeloctiy = m_startVelocity;
-	firstDeadOne->m_startVeloctiy.x += (((float)rand() / RAND_MAX) * 2 - 1) * m_velocityRange.x;
-	firstDeadOne->m_startVeloctiy.y += (((float)rand() / RAND_MAX) * 2 - 1) * m_velocityRange.y;
-	firstDeadOne->m_startVeloctiy.z += (((float)rand() / RAND_MAX) * 2 - 1) * m_velocityRange.z;
-
-	firstDeadOne->m_startRot = ((float)rand() / RAND_MAX) *
-		(m_rotationRange.y - m_rotationRange.x) + m_rotationRange.x;
-
-	firstDeadOne->m_endRot = ((float)rand() / RAND_MAX) *
-		(m_rotationRange.w - m_rotationRange.z) + m_rotationRange.z;
+	//with either, every live particle is touched, over the live range's two runs of the ring
+	float acc[3] = { m_emitterAcceleration.x, m_emitterAcceleration.y, m_emitterAcceleration.z };
+	unsigned int firstCount = min(m_liveParticles, m_maxParticles - m_oldestAlive);
+	if (m_forceField)
+	{
+		ApplyForceField(*m_forceField, m_particles, m_oldestAlive, m_oldestAlive + firstCount, (float)m_time, delta, acc);
+		ApplyForceField(*m_forceField, m_particles, 0, m_liveParticles - firstCount, (float)m_time, delta, acc);
+	}
+	if (colliding)
+	{
+		CollideParticles(*m_ground, m_collision, m_particles, m_oldestAlive, m_oldestAlive + firstCount, (float)m_time, acc);
+		CollideParticles(*m_ground, m_collision, m_particles, 0, m_liveParticles - firstCount, (float)m_time, acc);
+	}
+}
 
-	m_liveParticles++;
+void Emitter::Restart(const DirectX::XMFLOAT3& position)
+{
+	//the bounds only depend on the position through the origin
+	float offset[3] = { position.x - m_emitterPosition.x, position.y - m_emitterPosition.y, position.z - m_emitterPosition.z };
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		m_bounds.min[axis] += offset[axis];
+		m_bounds.max[axis] += offset[axis];
+	}
+	m_emitterPosition = position;
+	m_randomKey = NextParticleRandomKey();
+
+	//nothing resident, so Seek respawns the whole burst
+	m_time = 0;
+	m_firstLive = 0;
+	m_nextSpawn = 0;
+	Seek(0);
+}
 
-	++m_oldestDead;
-	m_oldestDead %= m_maxParticles;
+void Emitter::Seek(double time)
+{
+	//the live set is a closed form range of spawn indices
+	ParticleLiveRange live = LiveRangeAt(m_schedule, time, m_lifeTime, m_maxParticles);
+	unsigned int first = live.first, last = live.last;
+
+	//only indices that are not already resident need their spawn state rebuilt
+	SpawnParticles(first, min(last, m_firstLive));
+	SpawnParticles(max(first, m_nextSpawn), last);
+
+	m_time = time;
+	m_firstLive = first;
+	m_nextSpawn = last;
+	m_liveParticles = last - first;
+	m_oldestAlive = first % m_maxParticles;
+}
 
+void Emitter::SpawnParticles(unsigned int first, unsigned int last)
+{
+	ParticleSpawnParams params =
+	{
+		{ m_emitterPosition.x, m_emitterPosition.y, m_emitterPosition.z }, { m_positionRange.x, m_positionRange.y, m_positionRange.z },
+		{ m_startVelocity.x, m_startVelocity.y, m_startVelocity.z }, { m_velocityRange.x, m_velocityRange.y, m_velocityRange.z },
+		{ m_rotationRange.x, m_rotationRange.y, m_rotationRange.z, m_rotationRange.w },
+		m_randomKey,
+		m_surface
+	};
+	SpawnParticleStreams(m_particles, m_maxParticles, m_schedule, params, first, last);
 }
 
 void Emitter::DrawEmitter(ID3D11DeviceContext* context, Camera* camera)
 {
-	SetupGPU(context, camera);
+	if (BeginUpload(context, camera))
+	{
+		ExpandRange(0, m_drawCount);
+		EndUpload(context);
+	}
 
-	UINT stride = sizeof(ParticleVertex);
-	UINT offset = 0;
-	context->IASetVertexBuffers(0, 1, &m_vbuff, &stride, &offset);
-	context->IASetIndexBuffer(m_Ibuff, DXGI_FORMAT_R32_UINT, 0);
+	Draw(context, camera);
+}
 
-	m_vs->SetMatrix4x4("view", camera->GetView());
-	m_vs->SetMatrix4x4("projection", camera->GetProjection());
-	m_vs->SetShader();
-	m_vs->CopyAllBufferData();
+void Emitter::Draw(ID3D11DeviceContext* context, Camera* camera)
+{
+	if (m_drawCount == 0)
+		return;
 
 	m_ps->SetShaderResourceView("particleTex", m_texture);
 	//m_ps->CopyAllBufferData();
 	m_ps->SetShader();
 
-	//std::cout << "Live: " << m_liveParticles << " firstAlive : " << m_firstAlive << " firstDead: " << m_firstDead << "\n";
+	//back to front only shows under alpha over, so a sorted emitter draws with it and puts the scene's blend back
+	ID3D11BlendState* sceneBlend = m_depthSort ? AlphaBlendState::Bind(context) : nullptr;
 
-	if (m_oldestAlive < m_oldestDead)
+	if (m_instanceVS)
 	{
-		context->DrawIndexed(m_liveParticles * 6, m_oldestAlive * 6, 0);
+		//records sit in the per instance slot, no index buffer, six vertices a particle
+		UINT stride = sizeof(unsigned int) * c_particleInstanceWords;
+		UINT offset = 0;
+		context->IASetVertexBuffers(1, 1, &m_instanceBuff, &stride, &offset);
+		context->IASetIndexBuffer(nullptr, DXGI_FORMAT_R32_UINT, 0);
+
+		m_instanceVS->SetMatrix4x4("view", camera->GetView());
+		m_instanceVS->SetMatrix4x4("projection", camera->GetProjection());
+		m_instanceVS->SetFloat3("origin", m_emitterPosition);
+		m_instanceVS->SetShader();
+		m_instanceVS->CopyAllBufferData();
+
+		context->DrawInstanced(6, m_drawCount, 0, m_drawOffset);
 	}
 	else
 	{
-		context->DrawIndexed((m_oldestAlive-1) * 6, 0, 0);
+		UINT stride = sizeof(ParticleVertex);
+		UINT offset = 0;
+		context->IASetVertexBuffers(0, 1, &m_vbuff, &stride, &offset);
+		QuadIndexBuffer::Bind(context, m_maxParticles);
+
+		m_vs->SetMatrix4x4("view", camera->GetView());
+		m_vs->SetMatrix4x4("projection", camera->GetProjection());
+		m_vs->SetShader();
+		m_vs->CopyAllBufferData();
+
+		//BeginUpload packs the drawn particles contiguously at m_drawOffset, so the particle ring never splits the draw
+		context->DrawIndexed(m_drawCount * 6, 0, m_drawOffset * 4);
+	}
+
+	if (m_depthSort)
+		AlphaBlendState::Restore(context, sceneBlend);
+}
+
+bool Emitter::BeginUpload(ID3D11DeviceContext* context, Camera* camera)
+{
+	m_mapped = nullptr;
+	PrepareUpload(camera->GetView());
+	if (m_drawCount == 0)
+		return false;
+
+	//append this frame's data behind the previous frames' ones, only wrapping with a DISCARD when the ring is full
+	if (m_instanceVS)
+		m_mapped = m_instanceUpload.Append(context, m_instanceBuff, m_drawCount, sizeof(unsigned int) * c_particleInstanceWords, m_drawOffset);
+	else
+	{
+		CreateQuadBuffers(context);
+		m_mapped = m_upload.Append(context, m_vbuff, m_drawCount, sizeof(ParticleVertex) * 4, m_drawOffset);
+	}
 
-		context->DrawIndexed((m_maxParticles - m_oldestAlive) * 6, m_oldestAlive * 6, 0);
+	return m_mapped != nullptr;
+}
+
+bool Emitter::MapUpload(ID3D11DeviceContext* context)
+{
+	//the step has not run yet, so room for the whole pool; the ring holds c_uploadRingFrames of those
+	if (m_instanceVS)
+		m_mapped = m_instanceUpload.Append(context, m_instanceBuff, m_maxParticles, sizeof(unsigned int) * c_particleInstanceWords, m_drawOffset);
+	else
+	{
+		CreateQuadBuffers(context);
+		m_mapped = m_upload.Append(context, m_vbuff, m_maxParticles, sizeof(ParticleVertex) * 4, m_drawOffset);
 	}
 
-	context->DrawIndexed(6,0,0);
+	return m_mapped != nullptr;
+}
+
+void Emitter::PrepareUpload(const XMFLOAT4X4& view)
+{
+	static_assert(sizeof(ParticleVertex) == sizeof(float) * c_particleVertexFloats, "ParticleVertex must match the expansion kernel");
+
+	m_drawCount = 0;
+	if (m_liveParticles == 0)
+		return;
 
+	//camera right and up come straight out of the view matrix, once per frame
+	ParticleExpandParams& params = m_expandParams;
+	params = {};
+	params.right[0] = view._11; params.right[1] = view._12; params.right[2] = view._13;
+	params.up[0] = view._21; params.up[1] = view._22; params.up[2] = view._23;
+	params.startColor[0] = m_startColor.x; params.startColor[1] = m_startColor.y;
+	params.startColor[2] = m_startColor.z; params.startColor[3] = m_startColor.w;
+	params.endColor[0] = m_endColor.x; params.endColor[1] = m_endColor.y;
+	params.endColor[2] = m_endColor.z; params.endColor[3] = m_endColor.w;
+	params.invLifeTime = 1.0f / m_lifeTime;
+	params.time = (float)m_time;
+	params.acc[0] = m_emitterAcceleration.x; params.acc[1] = m_emitterAcceleration.y; params.acc[2] = m_emitterAcceleration.z;
+	params.startSize = m_startSize;
+	params.endSize = m_endSize;
+	params.forward[0] = view._31; params.forward[1] = view._32; params.forward[2] = view._33;
+	params.origin[0] = m_emitterPosition.x; params.origin[1] = m_emitterPosition.y; params.origin[2] = m_emitterPosition.z;
+
+	BuildDrawOrder();
 }
 
-void Emitter::SetupGPU(ID3D11DeviceContext* context, Camera* camera)
+void Emitter::ExpandRange(unsigned int first, unsigned int count)
 {
-	if (m_oldestAlive < m_oldestDead)
+	if (!m_mapped || count == 0)
+		return;
+
+	//live particle k sits in slot (m_oldestAlive + k) % m_maxParticles and in record k of the mapped space
+	unsigned int begin = (m_oldestAlive + first) % m_maxParticles;
+	unsigned int firstCount = min(count, m_maxParticles - begin);
+
+	if (m_drawGathered)
 	{
-		for (unsigned int i = m_oldestAlive; i < m_oldestDead; i++)
-		{
-			SetupGPUParticle(i, camera);
-		}
+		//thinned or sorted: record k is the slot m_order[k], wherever it sits in the ring
+		const unsigned int* order = m_order.data() + first;
+		if (m_instanceVS)
+			ExpandSortedParticleInstances(m_particles, order, count, m_expandParams, static_cast<unsigned int*>(m_mapped) + first * c_particleInstanceWords);
+		else
+			ExpandSortedParticleQuads(m_particles, order, count, m_expandParams, static_cast<float*>(m_mapped) + first * c_particleVertexFloats * 4);
+	}
+	else if (m_instanceVS)
+	{
+		unsigned int* out = static_cast<unsigned int*>(m_mapped) + first * c_particleInstanceWords;
+		out = ExpandParticleInstances(m_particles, begin, begin + firstCount, m_expandParams, out);
+		ExpandParticleInstances(m_particles, 0, count - firstCount, m_expandParams, out);
 	}
 	else
 	{
-		for (unsigned int i = 0; i < m_oldestDead; i++)
+		float* out = static_cast<float*>(m_mapped) + first * c_particleVertexFloats * 4;
+		out = ExpandParticleQuads(m_particles, begin, begin + firstCount, m_expandParams, out);
+		ExpandParticleQuads(m_particles, 0, count - firstCount, m_expandParams, out);
+	}
+}
+
+void Emitter::EndUpload(ID3D11DeviceContext* context)
+{
+	if (!m_mapped)
+		return;
+
+	context->Unmap(m_instanceVS ? m_instanceBuff : m_vbuff, 0);
+	m_mapped = nullptr;
+}
+
+void Emitter::BuildDrawOrder()
+{
+	m_drawGathered = m_detail > 1 || m_depthSort;
+	if (!m_drawGathered)
+	{
+		m_drawCount = m_liveParticles;
+		return;
+	}
+
+	if (m_detail == 1)
+	{
+		//everything, in live order; the depths come straight off the two stream ranges of the ring
+		unsigned int firstCount = min(m_liveParticles, m_maxParticles - m_oldestAlive);
+		m_depths.resize(m_liveParticles);
+		float* depth = ComputeParticleDepths(m_particles, m_oldestAlive, m_oldestAlive + firstCount, m_expandParams, m_depths.data());
+		ComputeParticleDepths(m_particles, 0, m_liveParticles - firstCount, m_expandParams, depth);
+
+		m_drawSlots.resize(m_liveParticles);
+		for (unsigned int k = 0; k < m_liveParticles; k++)
+			m_drawSlots[k] = (m_oldestAlive + k) % m_maxParticles;
+	}
+	else
+	{
+		m_drawSlots.clear();
+		for (unsigned int n = (m_firstLive + m_detail - 1) / m_detail * m_detail; n < m_nextSpawn; n += m_detail)
+			m_drawSlots.push_back(n % m_maxParticles);
+
+		if (m_depthSort)
 		{
-			SetupGPUParticle(i, camera);
+			m_depths.resize(m_drawSlots.size());
+			ComputeParticleDepthsAt(m_particles, m_drawSlots.data(), (unsigned int)m_drawSlots.size(), m_expandParams, m_depths.data());
 		}
-		for (unsigned int i = m_oldestAlive; i < m_maxParticles; i++)
+	}
+
+	//a particle the ground killed has a NaN position and would never be seen, so it is left out of the sort
+	if (m_depthSort && m_ground && m_collision.mode == ParticleCollision_Kill)
+	{
+		unsigned int kept = 0;
+		for (unsigned int k = 0; k < (unsigned int)m_drawSlots.size(); k++)
 		{
-			SetupGPUParticle(i, camera);
+			if (std::isnan(m_depths[k]))
+				continue;
+			m_depths[kept] = m_depths[k];
+			m_drawSlots[kept++] = m_drawSlots[k];
 		}
+		m_drawSlots.resize(kept);
 	}
 
-	D3D11_MAPPED_SUBRESOURCE mapped = {};
-	context->Map(m_vbuff, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-	memcpy(mapped.pData, m_vertices, sizeof(ParticleVertex) * 4 * m_maxParticles);
-	//memcpy(mapped.pData, m_vertices, sizeof(ParticleVertex) * 4 );
-	context->Unmap(m_vbuff, 0);
-}
+	m_drawCount = (unsigned int)m_drawSlots.size();
+	m_order.resize(m_drawCount);
 
-void Emitter::SetupGPUParticle(unsigned int index, Camera* camera)
-{
-	unsigned int i = index * 4;
-	m_vertices[i].m_Position = ParticleVertexPos(index, 0, camera);
-	m_vertices[i + 1].m_Position = ParticleVertexPos(index, 1, camera);
-	m_vertices[i + 2].m_Position = ParticleVertexPos(index, 2, camera);
-	m_vertices[i + 3].m_Position = ParticleVertexPos(index, 3, camera);
-
-	m_vertices[i].m_Color = m_particleArr[index].m_Color;
-	m_vertices[i + 1].m_Color = m_particleArr[index].m_Color;
-	m_vertices[i + 2].m_Color = m_particleArr[index].m_Color;
-	m_vertices[i + 3].m_Color = m_particleArr[index].m_Color;
-}
+	if (!m_depthSort)
+	{
+		m_order.swap(m_drawSlots);
+		return;
+	}
 
-XMFLOAT3 Emitter::ParticleVertexPos(unsigned int index, unsigned int cornerIndex, Camera* camera)
-{
-	XMFLOAT4X4 view = camera->GetView();
-	XMVECTOR cameraRight = XMVectorSet(view._11, view._12, view._13, 0);
-	XMVECTOR cameraUp = XMVectorSet(view._21, view._22, view._23, 0);
-
-	XMFLOAT2 Offset = m_vertices[index * 4 + cornerIndex].m_UV;
-	Offset.x = Offset.x * 2 - 1;
-	Offset.y = (Offset.y * (-2) + 1);
-
-	XMVECTOR offsetVec = XMLoadFloat2(&Offset);
-	XMMATRIX rotationMatrix = XMMatrixRotationZ(m_particleArr[index].m_rotation);
-	offsetVec = XMVector3Transform(offsetVec, rotationMatrix);
-
-	XMVECTOR posVec = XMLoadFloat3(&m_particleArr[index].m_currPosition);
-	posVec += cameraRight * XMVectorGetX(offsetVec) * m_particleArr[index].m_size;
-	posVec += cameraUp * XMVectorGetY(offsetVec) * m_particleArr[index].m_size;
-
-	XMFLOAT3 position;
-	XMStoreFloat3(&position, posVec);
-	//XMFLOAT3(m_vertices[index].m_Position);
-	return position;
-}
\ No newline at end of file
+	m_sortOrder.resize(m_drawCount);
+	SortBackToFront(m_depths.data(), m_drawCount, m_sortOrder.data(), m_sortScratch, m_sortJobs);
+
+	for (unsigned int k = 0; k < m_drawCount; k++)
+		m_order[k] = m_drawSlots[m_sortOrder[k]];
+}
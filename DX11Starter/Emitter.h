@@ -5,19 +5,21 @@
 
 #include "SimpleShader.h"
 #include "Camera.h"
-
-
-struct Particle
-{
-	DirectX::XMFLOAT3 m_startPosition,m_currPosition, m_startVeloctiy;
-	DirectX::XMFLOAT4 m_Color;
-
-	float m_size;
-	float m_Age;
-	float m_startRot;
-	float m_endRot;
-	float m_rotation;
-};
+#include "ParticleStreams.h"
+#include "UploadRing.h"
+#include "ParticleRandom.h"
+#include "SpawnSchedule.h"
+#include "ParticleSimulation.h"
+#include "QuadIndexBuffer.h"
+#include "AlphaBlendState.h"
+#include "DepthSort.h"
+#include "ParticleBounds.h"
+#include "EmitterDesc.h"
+#include "ForceField.h"
+#include "MeshSampler.h"
+#include "Heightfield.h"
+
+#include <vector>
 
 struct ParticleVertex
 {
@@ -36,24 +38,69 @@ class Emitter
 
 	unsigned int m_liveParticles,m_emitRate;
 
-	float m_timeSinceEmit, m_timePerEmmission, m_lifeTime, m_startSize, m_endSize;
+	float m_timePerEmmission, m_lifeTime, m_startSize, m_endSize;
+
+	//particle streams (structure of arrays), spawn index n lives in slot n % m_maxParticles
+	ParticleStreams m_particles;
+	unsigned int m_maxParticles, m_oldestAlive;
+	unsigned int m_randomKey;
+
+	//emitter clock and the spawn indices [m_firstLive, m_nextSpawn) that are live at it
+	SpawnSchedule m_schedule;
+	double m_time;
+	unsigned int m_firstLive, m_nextSpawn;
+
+	ParticleBounds m_bounds;
+
+	//optional extra accelerations, kicked into the streams every step; shared, not owned
+	const ForceField* m_forceField;
+
+	//optional mesh to spawn on instead of the position range box; shared, not owned
+	const MeshSampler* m_surface;
+
+	//optional ground the particles bounce off or die on; shared, not owned
+	const Heightfield* m_ground;
+	ParticleCollision m_collision;
+
+	//quad mode: four expanded vertices per particle, null until the first quad upload
+	ID3D11Buffer* m_vbuff;
+	UploadRing m_upload;
+	unsigned int m_drawOffset;
+
+	//instanced mode: one 16 byte record per particle, the vertex shader builds the corners
+	ID3D11Buffer* m_instanceBuff;
+	UploadRing m_instanceUpload;
+	SimpleVertexShader* m_instanceVS;
 
-	//particles array
-	Particle* m_particleArr;
-	unsigned int m_maxParticles, m_oldestDead, m_oldestAlive;
+	//mapped upload space between BeginUpload and EndUpload
+	void* m_mapped;
+	ParticleExpandParams m_expandParams;
+
+	//level of detail: only spawn indices that are multiples of m_detail are drawn
+	unsigned int m_detail;
+
+	//back to front mode sorts what is drawn, farthest first
+	bool m_depthSort;
+	JobSystem* m_sortJobs;
+	std::vector<float> m_depths;
+	std::vector<unsigned int> m_drawSlots, m_sortOrder;
+	DepthSortScratch m_sortScratch;
+
+	//what BeginUpload decided to draw: m_drawCount particles, through the slots in m_order when m_drawGathered,
+	//straight along the ring otherwise
+	unsigned int m_drawCount;
+	bool m_drawGathered;
+	std::vector<unsigned int> m_order;
 
-	//VertexArray
-	ParticleVertex* m_vertices;
-	ID3D11Buffer* m_vbuff, * m_Ibuff;
 	ID3D11ShaderResourceView* m_texture;
 	SimpleVertexShader* m_vs;
 	SimplePixelShader* m_ps;
 
-	void SpawnParticle();
-	void UpdateParticle(float delta, unsigned int particleIndex);
-	void SetupGPU(ID3D11DeviceContext* context, Camera* camera);
-	void SetupGPUParticle(unsigned int index, Camera* camera);
-	XMFLOAT3 ParticleVertexPos(unsigned int index, unsigned int cornerIndex, Camera* camera);
+	void CreateQuadBuffers(ID3D11DeviceContext* context);
+	void ReleaseQuadBuffers();
+	void SpawnParticles(unsigned int first, unsigned int last);
+	void BuildDrawOrder();
+	void UpdateBounds();
 
 public:
 
@@ -65,8 +112,56 @@ public:
 		unsigned int maxParticles, unsigned int emitRate, float lifeTime, float startSize, float endSize,
 		ID3D11Device* device, SimpleVertexShader* vs, SimplePixelShader* ps, ID3D11ShaderResourceView* srv
 	);
+	Emitter(const EmitterDesc& desc, ID3D11Device* device, SimpleVertexShader* vs, SimplePixelShader* ps, ID3D11ShaderResourceView* srv);
 	~Emitter();
 
+	//switches to the instanced path, drawn with ParticleInstanceVS instead of the expanded quads, and gives back the quad
+	//vertex ring and index buffer share if a quad draw already made them
+	void EnableInstancing(ID3D11Device* device, SimpleVertexShader* instanceVS);
+
+	//draws back to front with alpha over blending instead of the scene's additive one, sorting on jobs when given and the pool is large
+	void SetDepthSort(bool enabled, JobSystem* jobs = nullptr);
+
+	//draws one particle in every detail spawned, as if the emit rate were divided by detail
+	//the choice goes by spawn index, so a particle is either drawn for its whole life or not at all
+	void SetDetail(unsigned int detail) { m_detail = detail > 0 ? detail : 1; }
+
+	//bends the particles with a force field on top of the constant acceleration, null to go back to pure ballistics
+	//the field is sampled once per step, so Seek stays exact only without one; set it again after the field changes
+	//so the culling bounds grow with it
+	void SetForceField(const ForceField* field);
+
+	//spawns on the surface of a mesh placed at the emitter position instead of in the position range box, null for the box
+	//the live particles respawn on it at once; the sampler must outlive the emitter or be unset first
+	void SetSurface(const MeshSampler* surface);
+
+	//collides the particles with a heightfield every step, null or ParticleCollision_None to let them through
+	//like a field it acts per step, so Seek replays the ballistic path; killed particles stay hidden until respawned
+	void SetCollision(const Heightfield* ground, const ParticleCollision& collision);
+
 	void UpdateEmitter(float delta);
 	void DrawEmitter(ID3D11DeviceContext* context, Camera* camera);
+
+	//DrawEmitter in steps, so the expansion can be split across threads:
+	//map on the context's thread, ExpandRange any disjoint pieces of [0, GetDrawCount()) from any thread, then unmap and draw
+	bool BeginUpload(ID3D11DeviceContext* context, Camera* camera);
+	void ExpandRange(unsigned int first, unsigned int count);
+	void EndUpload(ID3D11DeviceContext* context);
+	void Draw(ID3D11DeviceContext* context, Camera* camera);
+
+	//BeginUpload the other way round, for stepping a frame ahead on a worker (ParticleSystemManager::SetPipelined):
+	//MapUpload on the context's thread before the step, then UpdateEmitter, PrepareUpload and ExpandRange from any thread
+	bool MapUpload(ID3D11DeviceContext* context);
+	void PrepareUpload(const DirectX::XMFLOAT4X4& view);
+
+	unsigned int GetLiveParticles() const { return m_liveParticles; }
+	unsigned int GetDrawCount() const { return m_drawCount; }
+	const ParticleBounds& GetBounds() const { return m_bounds; }
+
+	//starts over at time zero somewhere else with fresh randoms, reusing every buffer, for pooled effects
+	void Restart(const DirectX::XMFLOAT3& position);
+
+	//moves the emitter clock to any time, forwards or backwards, in O(live) without stepping
+	void Seek(double time);
+	double GetTime() const { return m_time; }
 };
@@ -0,0 +1,353 @@
+#include "EmitterDesc.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	const char c_effectFileMagic[4] = { 'P', 'F', 'X', 'B' };
+	const uint32_t c_effectFileVersion = 3;
+
+	struct EffectFileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t descSize;
+		uint32_t count;
+	};
+
+	//how each text key maps onto EmitterDesc
+	enum FieldKind { c_fieldString, c_fieldType, c_fieldUint, c_fieldFloat };
+
+	struct FieldInfo
+	{
+		const char* key;
+		FieldKind kind;
+		size_t offset;
+		unsigned int count;
+	};
+
+	const FieldInfo c_fields[] =
+	{
+		{ "texture", c_fieldString, offsetof(EmitterDesc, texture), 1 },
+		{ "type", c_fieldType, offsetof(EmitterDesc, type), 1 },
+		{ "maxParticles", c_fieldUint, offsetof(EmitterDesc, maxParticles), 1 },
+		{ "emitRate", c_fieldUint, offsetof(EmitterDesc, emitRate), 1 },
+		{ "lifeTime", c_fieldFloat, offsetof(EmitterDesc, lifeTime), 1 },
+		{ "startSize", c_fieldFloat, offsetof(EmitterDesc, startSize), 1 },
+		{ "endSize", c_fieldFloat, offsetof(EmitterDesc, endSize), 1 },
+		{ "position", c_fieldFloat, offsetof(EmitterDesc, position), 3 },
+		{ "positionRange", c_fieldFloat, offsetof(EmitterDesc, positionRange), 3 },
+		{ "velocity", c_fieldFloat, offsetof(EmitterDesc, velocity), 3 },
+		{ "velocityRange", c_fieldFloat, offsetof(EmitterDesc, velocityRange), 3 },
+		{ "acceleration", c_fieldFloat, offsetof(EmitterDesc, acceleration), 3 },
+		{ "rotationRange", c_fieldFloat, offsetof(EmitterDesc, rotationRange), 4 },
+		{ "startColor", c_fieldFloat, offsetof(EmitterDesc, startColor), 4 },
+		{ "endColor", c_fieldFloat, offsetof(EmitterDesc, endColor), 4 },
+		{ "instancing", c_fieldUint, offsetof(EmitterDesc, instancing), 1 },
+		{ "depthSort", c_fieldUint, offsetof(EmitterDesc, depthSort), 1 },
+		{ "poolSize", c_fieldUint, offsetof(EmitterDesc, poolSize), 1 },
+		{ "surface", c_fieldString, offsetof(EmitterDesc, surface), 1 },
+		{ "collision", c_fieldUint, offsetof(EmitterDesc, collision), 1 },
+		{ "restitution", c_fieldFloat, offsetof(EmitterDesc, restitution), 1 },
+		{ "friction", c_fieldFloat, offsetof(EmitterDesc, friction), 1 },
+	};
+
+	const char* const c_typeNames[] = { "cpu", "hybrid", "gpu" };
+
+	bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	//next whitespace separated token in [cursor, end), empty at the end of the line
+	std::string NextToken(const char*& cursor, const char* end)
+	{
+		while (cursor < end && IsSpace(*cursor)) cursor++;
+		const char* start = cursor;
+		while (cursor < end && !IsSpace(*cursor)) cursor++;
+		return std::string(start, cursor);
+	}
+
+	void CopyName(char* dest, const std::string& source)
+	{
+		size_t length = source.size() < 31 ? source.size() : 31;
+		memcpy(dest, source.data(), length);
+		dest[length] = '\0';
+	}
+
+	bool ParseValue(const FieldInfo& field, const char*& cursor, const char* end, EmitterDesc& desc)
+	{
+		char* base = reinterpret_cast<char*>(&desc) + field.offset;
+		for (unsigned int i = 0; i < field.count; i++)
+		{
+			std::string token = NextToken(cursor, end);
+			if (token.empty())
+				return false;
+
+			char* parsed = nullptr;
+			switch (field.kind)
+			{
+			case c_fieldString:
+				CopyName(base, token);
+				break;
+
+			case c_fieldType:
+			{
+				unsigned int type = 0;
+				while (type < 3 && token != c_typeNames[type]) type++;
+				if (type == 3)
+					return false;
+				desc.type = (EmitterType)type;
+				break;
+			}
+
+			case c_fieldUint:
+				reinterpret_cast<uint32_t*>(base)[i] = (uint32_t)strtoul(token.c_str(), &parsed, 10);
+				if (*parsed != '\0')
+					return false;
+				break;
+
+			case c_fieldFloat:
+				reinterpret_cast<float*>(base)[i] = strtof(token.c_str(), &parsed);
+				if (*parsed != '\0')
+					return false;
+				break;
+			}
+		}
+
+		//trailing values are an error, not silently dropped
+		return NextToken(cursor, end).empty();
+	}
+}
+
+EmitterDesc DefaultEmitterDesc()
+{
+	EmitterDesc desc = {};
+	CopyName(desc.texture, "particle");
+	desc.type = EmitterType_Cpu;
+	desc.maxParticles = 1000;
+	desc.emitRate = 100;
+	desc.lifeTime = 2.0f;
+	desc.startSize = 0.1f;
+	desc.endSize = 1.0f;
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		desc.startColor[i] = 1.0f;
+		desc.endColor[i] = i < 3 ? 1.0f : 0.0f;
+	}
+	desc.poolSize = 1;
+	desc.restitution = 0.5f;
+	desc.friction = 0.2f;
+	return desc;
+}
+
+bool ValidateDesc(const EmitterDesc& desc, std::string& error)
+{
+	if (desc.type > EmitterType_Gpu || desc.collision > 2)
+	{
+		error = std::string("emitter ") + desc.name + ": unknown type or collision mode";
+		return false;
+	}
+
+	if (desc.maxParticles == 0 || desc.emitRate == 0 || !std::isfinite(desc.lifeTime) || desc.lifeTime <= 0.0f || desc.poolSize == 0)
+	{
+		error = std::string("emitter ") + desc.name + ": maxParticles, emitRate, lifeTime and poolSize must be positive";
+		return false;
+	}
+
+	return true;
+}
+
+bool ParseEffectText(const char* text, size_t length, std::vector<EmitterDesc>& out, std::string& error)
+{
+	out.clear();
+	const char* end = text + length;
+	unsigned int lineNumber = 0;
+
+	for (const char* line = text; line < end; )
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+		if (!lineEnd) lineEnd = end;
+		lineNumber++;
+
+		const char* comment = (const char*)memchr(line, '#', lineEnd - line);
+		const char* cursor = line;
+		const char* valuesEnd = comment ? comment : lineEnd;
+		line = lineEnd + 1;
+
+		std::string key = NextToken(cursor, valuesEnd);
+		if (key.empty())
+			continue;
+
+		if (key == "emitter")
+		{
+			std::string name = NextToken(cursor, valuesEnd);
+			if (name.empty() || name.size() > 31 || !NextToken(cursor, valuesEnd).empty())
+			{
+				error = "line " + std::to_string(lineNumber) + ": emitter needs one name of at most 31 characters";
+				return false;
+			}
+
+			out.push_back(DefaultEmitterDesc());
+			CopyName(out.back().name, name);
+			continue;
+		}
+
+		if (out.empty())
+		{
+			error = "line " + std::to_string(lineNumber) + ": '" + key + "' before the first emitter";
+			return false;
+		}
+
+		const FieldInfo* field = nullptr;
+		for (const FieldInfo& candidate : c_fields)
+			if (key == candidate.key) field = &candidate;
+
+		if (!field)
+		{
+			error = "line " + std::to_string(lineNumber) + ": unknown key '" + key + "'";
+			return false;
+		}
+
+		if (!ParseValue(*field, cursor, valuesEnd, out.back()))
+		{
+			error = "line " + std::to_string(lineNumber) + ": '" + key + "' takes " + std::to_string(field->count) + " value(s)";
+			return false;
+		}
+	}
+
+	for (const EmitterDesc& desc : out)
+		if (!ValidateDesc(desc, error))
+			return false;
+
+	return true;
+}
+
+std::string FormatEffectText(const std::vector<EmitterDesc>& descs)
+{
+	std::string text;
+	char value[32];
+
+	for (const EmitterDesc& desc : descs)
+	{
+		text += "emitter ";
+		text += desc.name;
+		text += "\n";
+
+		for (const FieldInfo& field : c_fields)
+		{
+			//an empty name is the default and would not parse back
+			const char* base = reinterpret_cast<const char*>(&desc) + field.offset;
+			if (field.kind == c_fieldString && *base == '\0')
+				continue;
+
+			text += field.key;
+			for (unsigned int i = 0; i < field.count; i++)
+			{
+				text += " ";
+				switch (field.kind)
+				{
+				case c_fieldString: text += base; break;
+				case c_fieldType: text += c_typeNames[desc.type]; break;
+				case c_fieldUint: snprintf(value, sizeof(value), "%u", reinterpret_cast<const uint32_t*>(base)[i]); text += value; break;
+				case c_fieldFloat: snprintf(value, sizeof(value), "%.9g", reinterpret_cast<const float*>(base)[i]); text += value; break;
+				}
+			}
+			text += "\n";
+		}
+		text += "\n";
+	}
+
+	return text;
+}
+
+bool ReadEffectBinary(const void* data, size_t length, std::vector<EmitterDesc>& out, std::string& error)
+{
+	EffectFileHeader header;
+	if (length < sizeof(header))
+	{
+		error = "effect file too short";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, c_effectFileMagic, 4) != 0 || header.version != c_effectFileVersion || header.descSize != sizeof(EmitterDesc))
+	{
+		error = "effect file from a different version, cook it again";
+		return false;
+	}
+
+	if ((length - sizeof(header)) / sizeof(EmitterDesc) < header.count)
+	{
+		error = "effect file truncated";
+		return false;
+	}
+
+	out.resize(header.count);
+	if (header.count)
+		memcpy(out.data(), static_cast<const char*>(data) + sizeof(header), sizeof(EmitterDesc) * header.count);
+
+	//names come from disk, never trust them to be terminated
+	for (EmitterDesc& desc : out)
+	{
+		desc.name[31] = '\0';
+		desc.texture[31] = '\0';
+		desc.surface[31] = '\0';
+		if (!ValidateDesc(desc, error))
+		{
+			error = "effect file holds an invalid " + error;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::vector<unsigned char> WriteEffectBinary(const std::vector<EmitterDesc>& descs)
+{
+	EffectFileHeader header;
+	memcpy(header.magic, c_effectFileMagic, 4);
+	header.version = c_effectFileVersion;
+	header.descSize = sizeof(EmitterDesc);
+	header.count = (uint32_t)descs.size();
+
+	std::vector<unsigned char> bytes(sizeof(header) + sizeof(EmitterDesc) * descs.size());
+	memcpy(bytes.data(), &header, sizeof(header));
+	if (!descs.empty())
+		memcpy(bytes.data() + sizeof(header), descs.data(), sizeof(EmitterDesc) * descs.size());
+	return bytes;
+}
+
+bool LoadEffectFile(const char* path, std::vector<EmitterDesc>& out, std::string& error)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+	std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	if (bytes.size() >= 4 && memcmp(bytes.data(), c_effectFileMagic, 4) == 0)
+		return ReadEffectBinary(bytes.data(), bytes.size(), out, error);
+	return ParseEffectText(bytes.data(), bytes.size(), out, error);
+}
+
+bool CookEffectFile(const char* textPath, const char* binaryPath, std::string& error)
+{
+	std::vector<EmitterDesc> descs;
+	if (!LoadEffectFile(textPath, descs, error))
+		return false;
+
+	std::vector<unsigned char> bytes = WriteEffectBinary(descs);
+	std::ofstream file(binaryPath, std::ios::binary);
+	if (!file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size()))
+	{
+		error = std::string("cannot write ") + binaryPath;
+		return false;
+	}
+	return true;
+}
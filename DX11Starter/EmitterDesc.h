@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//which emitter class a descriptor builds
+enum EmitterType : uint32_t
+{
+	EmitterType_Cpu,
+	EmitterType_Hybrid,
+	EmitterType_Gpu
+};
+
+//everything that builds an emitter of any of the three kinds, in one place instead of positional constructor arguments
+//plain data, so an effect file is a header followed by these records verbatim and loads with one read
+struct EmitterDesc
+{
+	char name[32];
+	char texture[32];
+
+	EmitterType type;
+	uint32_t maxParticles;
+	uint32_t emitRate;
+
+	float lifeTime;
+	float startSize, endSize;
+
+	float position[3];
+	float positionRange[3];
+	float velocity[3];
+	float velocityRange[3];
+	float acceleration[3];
+	float rotationRange[4];
+	float startColor[4], endColor[4];
+
+	//Emitter::EnableInstancing, and SetDepthSort / GPUEmitter::EnableDepthSort
+	//depth sorted effects draw alpha over (AlphaBlendState), the rest additive where the order makes no difference
+	uint32_t instancing;
+	uint32_t depthSort;
+
+	//how many instances of the effect can be alive at once, all built at load
+	uint32_t poolSize;
+
+	//name of a loaded mesh to spawn on instead of the positionRange box, empty for the box (cpu and hybrid only)
+	char surface[32];
+
+	//what the particles do on the scene's ground: 0 pass through, 1 bounce, 2 die, as ParticleCollisionMode (cpu and gpu only)
+	//a bounce keeps restitution of the speed into the ground and loses friction of the speed along it
+	uint32_t collision;
+	float restitution;
+	float friction;
+};
+static_assert(std::is_trivially_copyable<EmitterDesc>::value, "EmitterDesc is written to effect files verbatim");
+static_assert(sizeof(EmitterDesc) == 252, "changing EmitterDesc changes the effect file format, bump c_effectFileVersion");
+
+//defaults for every field a text effect leaves out
+EmitterDesc DefaultEmitterDesc();
+
+//whether an emitter can be built from desc: a known type and collision mode, positive counts, and a finite positive
+//lifetime for the closed form age math to divide by; both effect readers reject a file holding one that is not
+bool ValidateDesc(const EmitterDesc& desc, std::string& error);
+
+//text source form, one "key value..." per line and # comments, every "emitter <name>" line starts a new descriptor:
+//  emitter sparks
+//  type cpu            (cpu, hybrid or gpu)
+//  maxParticles 210
+//  velocity -2 2 0
+//keys are the EmitterDesc field names, booleans are 0 or 1, empty names are left out
+bool ParseEffectText(const char* text, size_t length, std::vector<EmitterDesc>& out, std::string& error);
+std::string FormatEffectText(const std::vector<EmitterDesc>& descs);
+
+//binary form: a small versioned header and the records
+bool ReadEffectBinary(const void* data, size_t length, std::vector<EmitterDesc>& out, std::string& error);
+std::vector<unsigned char> WriteEffectBinary(const std::vector<EmitterDesc>& descs);
+
+//reads either form, told apart by the binary header
+bool LoadEffectFile(const char* path, std::vector<EmitterDesc>& out, std::string& error);
+
+//text to binary, for building effects ahead of time
+bool CookEffectFile(const char* textPath, const char* binaryPath, std::string& error);
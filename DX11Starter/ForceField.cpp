@@ -0,0 +1,379 @@
+#include "ForceField.h"
+#include "ParticleRandom.h"
+#include "SimdLanes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const float c_minRadius = 1e-3f;
+	const float c_twoPi = 6.283185307f;
+
+	//1 / sqrt(x) with one newton step on top of the estimate, plenty for a force
+	inline __m128 ReciprocalSqrt(__m128 x)
+	{
+		__m128 y = _mm_rsqrt_ps(x);
+		__m128 yyx = _mm_mul_ps(_mm_mul_ps(y, y), x);
+		return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), yyx));
+	}
+
+	//cosine for the curl waves, cheaper than SinCos4: one turn is folded onto a quarter wave around zero,
+	//where cos(2 pi t) = -sin(2 pi (|t| - 1/4)) takes a degree 7 polynomial, about 2e-5 off
+	inline __m128 Cos4(__m128 x)
+	{
+		__m128 turns = _mm_mul_ps(x, _mm_set1_ps(0.159154943f));
+		turns = _mm_sub_ps(turns, _mm_cvtepi32_ps(_mm_cvtps_epi32(turns)));
+		__m128 u = _mm_sub_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), turns), _mm_set1_ps(0.25f));
+		__m128 y = _mm_mul_ps(u, _mm_set1_ps(c_twoPi));
+
+		__m128 y2 = _mm_mul_ps(y, y);
+		__m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.8447486e-4f), y2), _mm_set1_ps(8.3109378e-3f));
+		s = _mm_add_ps(_mm_mul_ps(s, y2), _mm_set1_ps(-0.16665852f));
+		s = _mm_add_ps(_mm_mul_ps(s, y2), _mm_set1_ps(0.99999665f));
+		return _mm_mul_ps(s, _mm_xor_ps(y, _mm_set1_ps(-0.0f)));
+	}
+
+	//particles evaluated source by source: every source runs over the whole tile before the next one starts, so its
+	//constants stay in registers and the blocks are independent of each other, instead of one long chain per block
+	const unsigned int c_tileSize = 64;
+
+	struct ForceTile
+	{
+		alignas(16) float position[3][c_tileSize];
+		alignas(16) float acceleration[3][c_tileSize];
+	};
+
+	inline __m128 Load(const float* stream, unsigned int i) { return _mm_load_ps(stream + i); }
+	inline void Add(float* stream, unsigned int i, __m128 value) { _mm_store_ps(stream + i, _mm_add_ps(_mm_load_ps(stream + i), value)); }
+
+	//trilinear: the cell lookup runs four lanes at a time, then each lane blends its eight corners as whole float4s
+	void SampleGrid(const ForceGrid& grid, ForceTile& tile, unsigned int count)
+	{
+		const __m128 invCell = _mm_set1_ps(1.0f / grid.cellSize);
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		const unsigned int stride[3] = { 4, 4 * grid.size[0], 4 * grid.size[0] * grid.size[1] };
+		const float* values = grid.values.data();
+		auto lerp = [](__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)); };
+
+		alignas(16) int base[3][4], step[3][4];
+		alignas(16) float fraction[3][4];
+		for (unsigned int i = 0; i < count; i += 4)
+		{
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				__m128 last = _mm_set1_ps((float)(grid.size[axis] - 1));
+				__m128 cell = _mm_mul_ps(_mm_sub_ps(Load(tile.position[axis], i), _mm_set1_ps(grid.origin[axis])), invCell);
+				cell = _mm_min_ps(_mm_max_ps(cell, zero), last);
+
+				//cell is never negative, so truncating is flooring; the border cell steps by zero
+				__m128i whole = _mm_cvttps_epi32(cell);
+				__m128 wholeF = _mm_cvtepi32_ps(whole);
+				__m128 steps = _mm_and_ps(_mm_cmplt_ps(wholeF, last), one);
+				_mm_store_ps(fraction[axis], _mm_sub_ps(cell, wholeF));
+				_mm_store_si128(reinterpret_cast<__m128i*>(step[axis]), _mm_cvttps_epi32(steps));
+				_mm_store_si128(reinterpret_cast<__m128i*>(base[axis]), whole);
+			}
+
+			unsigned int lanes = std::min(count - i, 4u);
+			for (unsigned int k = 0; k < lanes; k++)
+			{
+				const float* corner = values + base[0][k] * stride[0] + base[1][k] * stride[1] + base[2][k] * stride[2];
+				unsigned int dx = step[0][k] * stride[0], dy = step[1][k] * stride[1], dz = step[2][k] * stride[2];
+				__m128 fx = _mm_set1_ps(fraction[0][k]), fy = _mm_set1_ps(fraction[1][k]), fz = _mm_set1_ps(fraction[2][k]);
+
+				__m128 z0 = lerp(lerp(_mm_loadu_ps(corner), _mm_loadu_ps(corner + dx), fx),
+					lerp(_mm_loadu_ps(corner + dy), _mm_loadu_ps(corner + dy + dx), fx), fy);
+				corner += dz;
+				__m128 z1 = lerp(lerp(_mm_loadu_ps(corner), _mm_loadu_ps(corner + dx), fx),
+					lerp(_mm_loadu_ps(corner + dy), _mm_loadu_ps(corner + dy + dx), fx), fy);
+
+				alignas(16) float sample[4];
+				_mm_store_ps(sample, lerp(z0, z1, fz));
+				for (unsigned int axis = 0; axis < 3; axis++)
+					tile.acceleration[axis][i + k] += sample[axis];
+			}
+		}
+	}
+
+	//the whole field at the first count positions of the tile, count a multiple of eight
+	void AccelerateTile(const ForceField& field, ForceTile& tile, unsigned int count, float time)
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+			memset(tile.acceleration[axis], 0, sizeof(float) * count);
+
+		for (const ForceAttractor& attractor : field.GetAttractors())
+		{
+			const __m128 center[3] = { _mm_set1_ps(attractor.position[0]), _mm_set1_ps(attractor.position[1]), _mm_set1_ps(attractor.position[2]) };
+			const __m128 radiusSq = _mm_set1_ps(attractor.radius * attractor.radius);
+			const __m128 strength = _mm_set1_ps(attractor.strength);
+			for (unsigned int i = 0; i < count; i += 4)
+			{
+				__m128 d[3];
+				for (unsigned int axis = 0; axis < 3; axis++)
+					d[axis] = _mm_sub_ps(center[axis], Load(tile.position[axis], i));
+
+				__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2]));
+				__m128 inverse = ReciprocalSqrt(_mm_add_ps(distanceSq, radiusSq));
+				__m128 scale = _mm_mul_ps(_mm_mul_ps(strength, inverse), _mm_mul_ps(inverse, inverse));
+				for (unsigned int axis = 0; axis < 3; axis++)
+					Add(tile.acceleration[axis], i, _mm_mul_ps(d[axis], scale));
+			}
+		}
+
+		for (const ForceVortex& vortex : field.GetVortices())
+		{
+			const __m128 center[3] = { _mm_set1_ps(vortex.position[0]), _mm_set1_ps(vortex.position[1]), _mm_set1_ps(vortex.position[2]) };
+			const __m128 axisX = _mm_set1_ps(vortex.axis[0]), axisY = _mm_set1_ps(vortex.axis[1]), axisZ = _mm_set1_ps(vortex.axis[2]);
+			const __m128 radiusSq = _mm_set1_ps(vortex.radius * vortex.radius);
+			const __m128 strength = _mm_set1_ps(vortex.strength);
+			for (unsigned int i = 0; i < count; i += 4)
+			{
+				__m128 d[3];
+				for (unsigned int axis = 0; axis < 3; axis++)
+					d[axis] = _mm_sub_ps(Load(tile.position[axis], i), center[axis]);
+
+				__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2]));
+				__m128 scale = _mm_div_ps(strength, _mm_add_ps(distanceSq, radiusSq));
+
+				Add(tile.acceleration[0], i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(axisY, d[2]), _mm_mul_ps(axisZ, d[1])), scale));
+				Add(tile.acceleration[1], i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(axisZ, d[0]), _mm_mul_ps(axisX, d[2])), scale));
+				Add(tile.acceleration[2], i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(axisX, d[1]), _mm_mul_ps(axisY, d[0])), scale));
+			}
+		}
+
+		//one dot, one cosine and three multiply adds a wave; two blocks at a time with the sums in registers,
+		//so the waves are the inner loop without a load and store of the sums each
+		const std::vector<ForceCurlWave>& waves = field.GetCurlWaves();
+		if (!waves.empty())
+		{
+			for (unsigned int i = 0; i < count; i += 8)
+			{
+				__m128 p0[3], p1[3], a0[3], a1[3];
+				for (unsigned int axis = 0; axis < 3; axis++)
+				{
+					p0[axis] = Load(tile.position[axis], i);
+					p1[axis] = Load(tile.position[axis], i + 4);
+					a0[axis] = a1[axis] = _mm_setzero_ps();
+				}
+
+				for (const ForceCurlWave& wave : waves)
+				{
+					__m128 offset = _mm_set1_ps(wave.phase + wave.speed * time);
+					__m128 angle0 = offset, angle1 = offset;
+					for (unsigned int axis = 0; axis < 3; axis++)
+					{
+						__m128 direction = _mm_set1_ps(wave.wave[axis]);
+						angle0 = _mm_add_ps(angle0, _mm_mul_ps(direction, p0[axis]));
+						angle1 = _mm_add_ps(angle1, _mm_mul_ps(direction, p1[axis]));
+					}
+
+					__m128 cosine0 = Cos4(angle0), cosine1 = Cos4(angle1);
+					for (unsigned int axis = 0; axis < 3; axis++)
+					{
+						__m128 curl = _mm_set1_ps(wave.curl[axis]);
+						a0[axis] = _mm_add_ps(a0[axis], _mm_mul_ps(curl, cosine0));
+						a1[axis] = _mm_add_ps(a1[axis], _mm_mul_ps(curl, cosine1));
+					}
+				}
+
+				for (unsigned int axis = 0; axis < 3; axis++)
+				{
+					Add(tile.acceleration[axis], i, a0[axis]);
+					Add(tile.acceleration[axis], i + 4, a1[axis]);
+				}
+			}
+		}
+
+		if (field.HasGrid())
+			SampleGrid(field.GetGrid(), tile, count);
+	}
+}
+
+void ForceField::AddAttractor(const ForceAttractor& attractor)
+{
+	m_attractors.push_back(attractor);
+	m_attractors.back().radius = std::max(attractor.radius, c_minRadius);
+	UpdateMaxAcceleration();
+}
+
+void ForceField::AddVortex(const ForceVortex& vortex)
+{
+	ForceVortex added = vortex;
+	added.radius = std::max(vortex.radius, c_minRadius);
+
+	float length = sqrtf(vortex.axis[0] * vortex.axis[0] + vortex.axis[1] * vortex.axis[1] + vortex.axis[2] * vortex.axis[2]);
+	for (unsigned int axis = 0; axis < 3; axis++)
+		added.axis[axis] = length > 0.0f ? vortex.axis[axis] / length : (axis == 1 ? 1.0f : 0.0f);
+
+	m_vortices.push_back(added);
+	UpdateMaxAcceleration();
+}
+
+void ForceField::SetGrid(const ForceGrid& grid)
+{
+	m_grid = grid;
+	m_gridMax = 0.0f;
+	for (size_t i = 0; i + 3 < m_grid.values.size(); i += 4)
+	{
+		const float* value = m_grid.values.data() + i;
+		m_gridMax = std::max(m_gridMax, sqrtf(value[0] * value[0] + value[1] * value[1] + value[2] * value[2]));
+	}
+	UpdateMaxAcceleration();
+}
+
+void ForceField::SetCurlNoise(float strength, float scale, float speed, unsigned int waveCount, uint32_t seed)
+{
+	m_curlWaves.clear();
+
+	//independent waves add up in power, so each gets strength * sqrt(2 / n) to make the rms magnitude strength
+	float amplitude = waveCount > 0 ? strength * sqrtf(2.0f / waveCount) : 0.0f;
+	for (unsigned int i = 0; i < waveCount; i++)
+	{
+		float random[8];
+		for (unsigned int channel = 0; channel < 8; channel += 2)
+		{
+			uint32_t words[2];
+			PhiloxRandom2x32(seed, i, channel >> 1, words);
+			random[channel] = RandomUnitFloat(words[0]);
+			random[channel + 1] = RandomUnitFloat(words[1]);
+		}
+
+		//a direction uniform on the sphere, and the potential's direction from another one, made perpendicular to it
+		auto onSphere = [](float u, float v, float out[3])
+		{
+			float z = u * 2 - 1, r = sqrtf(std::max(1 - z * z, 0.0f)), angle = v * c_twoPi;
+			out[0] = r * cosf(angle); out[1] = r * sinf(angle); out[2] = z;
+		};
+		float direction[3], potential[3];
+		onSphere(random[0], random[1], direction);
+		onSphere(random[2], random[3], potential);
+
+		float along = direction[0] * potential[0] + direction[1] * potential[1] + direction[2] * potential[2];
+		for (unsigned int axis = 0; axis < 3; axis++)
+			potential[axis] -= along * direction[axis];
+
+		float length = sqrtf(potential[0] * potential[0] + potential[1] * potential[1] + potential[2] * potential[2]);
+		if (length < 1e-4f)
+		{
+			//parallel by chance, any perpendicular will do
+			potential[0] = -direction[1]; potential[1] = direction[0]; potential[2] = 0;
+			length = sqrtf(potential[0] * potential[0] + potential[1] * potential[1]);
+			if (length < 1e-4f) { potential[0] = 1; potential[1] = 0; length = 1; }
+		}
+
+		//wavelengths spread over an octave around scale
+		float frequency = c_twoPi / scale * (0.7f + 0.6f * random[4]);
+
+		ForceCurlWave wave;
+		wave.curl[0] = (direction[1] * potential[2] - direction[2] * potential[1]) / length * amplitude;
+		wave.curl[1] = (direction[2] * potential[0] - direction[0] * potential[2]) / length * amplitude;
+		wave.curl[2] = (direction[0] * potential[1] - direction[1] * potential[0]) / length * amplitude;
+		for (unsigned int axis = 0; axis < 3; axis++)
+			wave.wave[axis] = direction[axis] * frequency;
+		wave.phase = random[5] * c_twoPi;
+		wave.speed = speed * (0.5f + random[6]);
+		m_curlWaves.push_back(wave);
+	}
+
+	m_curlMax = amplitude * waveCount;
+	UpdateMaxAcceleration();
+}
+
+void ForceField::Clear()
+{
+	m_attractors.clear();
+	m_vortices.clear();
+	m_curlWaves.clear();
+	m_grid = {};
+	m_curlMax = m_gridMax = 0.0f;
+	m_maxAcceleration = 0.0f;
+}
+
+bool ForceField::IsEmpty() const
+{
+	return m_attractors.empty() && m_vortices.empty() && m_curlWaves.empty() && !HasGrid();
+}
+
+void ForceField::UpdateMaxAcceleration()
+{
+	//an attractor peaks at |d| = radius / sqrt(2) with 2 / (3 sqrt(3)) strength / radius^2, a vortex at |d| = radius
+	m_maxAcceleration = m_curlMax + m_gridMax;
+	for (const ForceAttractor& attractor : m_attractors)
+		m_maxAcceleration += 0.3849002f * fabsf(attractor.strength) / (attractor.radius * attractor.radius);
+	for (const ForceVortex& vortex : m_vortices)
+		m_maxAcceleration += 0.5f * fabsf(vortex.strength) / vortex.radius;
+}
+
+void ForceField::Evaluate(const float* x, const float* y, const float* z, unsigned int count, float time, float* outX, float* outY, float* outZ) const
+{
+	const float* position[3] = { x, y, z };
+	float* out[3] = { outX, outY, outZ };
+
+	ForceTile tile;
+	for (unsigned int first = 0; first < count; first += c_tileSize)
+	{
+		unsigned int tileCount = std::min(count - first, c_tileSize);
+		unsigned int padded = (tileCount + 7) & ~7u;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			memcpy(tile.position[axis], position[axis] + first, sizeof(float) * tileCount);
+			memset(tile.position[axis] + tileCount, 0, sizeof(float) * (padded - tileCount));
+		}
+
+		AccelerateTile(*this, tile, padded, time);
+		for (unsigned int axis = 0; axis < 3; axis++)
+			memcpy(out[axis] + first, tile.acceleration[axis], sizeof(float) * tileCount);
+	}
+}
+
+void ApplyForceField(const ForceField& field, ParticleStreams& s, unsigned int begin, unsigned int end, float time, float dt, const float acc[3])
+{
+	if (field.IsEmpty() || dt <= 0.0f)
+		return;
+
+	float* position[3] = { s.posX, s.posY, s.posZ };
+	float* velocity[3] = { s.velX, s.velY, s.velZ };
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 step = _mm_set1_ps(dt);
+	const __m128 halfAcc[3] = { _mm_set1_ps(0.5f * acc[0]), _mm_set1_ps(0.5f * acc[1]), _mm_set1_ps(0.5f * acc[2]) };
+
+	ForceTile tile;
+	alignas(16) float age[c_tileSize];
+	for (unsigned int first = begin; first < end; first += c_tileSize)
+	{
+		unsigned int tileCount = std::min(end - first, c_tileSize);
+		unsigned int padded = (tileCount + 7) & ~7u;
+
+		//where the closed form has every particle now
+		for (unsigned int i = 0; i < padded; i += 4)
+		{
+			unsigned int lanes = std::min(tileCount - std::min(i, tileCount), 4u);
+			__m128 particleAge = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(time), LoadLanes(s.spawnTime + first + i, lanes)), zero);
+			_mm_store_ps(age + i, particleAge);
+
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				__m128 meanVelocity = _mm_add_ps(LoadLanes(velocity[axis] + first + i, lanes), _mm_mul_ps(halfAcc[axis], particleAge));
+				_mm_store_ps(tile.position[axis] + i, _mm_add_ps(LoadLanes(position[axis] + first + i, lanes), _mm_mul_ps(meanVelocity, particleAge)));
+			}
+		}
+
+		AccelerateTile(field, tile, padded, time);
+
+		//particles younger than the step only feel it since their spawn
+		for (unsigned int i = 0; i < tileCount; i += 4)
+		{
+			unsigned int lanes = std::min(tileCount - i, 4u);
+			__m128 particleAge = _mm_load_ps(age + i);
+			__m128 kickTime = _mm_min_ps(particleAge, step);
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				__m128 kick = _mm_mul_ps(Load(tile.acceleration[axis], i), kickTime);
+				StoreLanes(velocity[axis] + first + i, _mm_add_ps(LoadLanes(velocity[axis] + first + i, lanes), kick), lanes);
+				StoreLanes(position[axis] + first + i, _mm_sub_ps(LoadLanes(position[axis] + first + i, lanes), _mm_mul_ps(kick, particleAge)), lanes);
+			}
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ParticleStreams.h"
+
+//extra accelerations on top of an emitter's constant one: point attractors, vortices, a vector field on a grid and
+//curl noise, all summed into one field that is evaluated four particles at a time here and by ForceField.hlsli on the gpu
+//one field can be shared by any number of emitters; it must not change while an emitter steps with it
+
+//pulls toward position with strength * d / (|d|^2 + radius^2)^1.5, radius softens the center, negative strength pushes
+struct ForceAttractor
+{
+	float position[3];
+	float strength;
+	float radius;
+};
+static_assert(sizeof(ForceAttractor) == 20, "ForceAttractor must match ForceAttractor in ForceField.hlsli");
+
+//swirls around the line through position along the unit axis with strength * cross(axis, d) / (|d|^2 + radius^2)
+struct ForceVortex
+{
+	float position[3];
+	float strength;
+	float axis[3];
+	float radius;
+};
+static_assert(sizeof(ForceVortex) == 32, "ForceVortex must match ForceVortex in ForceField.hlsli");
+
+//one plane wave of the curl noise, stored already differentiated: curl * cos(dot(wave, p) + phase + speed * time)
+//is the curl of the potential a * sin(...) with curl = cross(wave, a), so every wave and any sum of them is divergence free
+struct ForceCurlWave
+{
+	float wave[3];
+	float phase;
+	float curl[3];
+	float speed;
+};
+static_assert(sizeof(ForceCurlWave) == 32, "ForceCurlWave must match ForceCurlWave in ForceField.hlsli");
+
+//accelerations at the corners of size[0] x size[1] x size[2] cells, cellSize apart from origin, x fastest,
+//as float4 with w unused so the values upload as an R32G32B32A32 volume as is
+//sampled trilinearly, positions outside clamp to the border
+struct ForceGrid
+{
+	float origin[3];
+	float cellSize;
+	unsigned int size[3];
+	std::vector<float> values;
+};
+
+class ForceField
+{
+public:
+	void AddAttractor(const ForceAttractor& attractor);
+	void AddVortex(const ForceVortex& vortex);
+	void SetGrid(const ForceGrid& grid);
+
+	//waveCount random waves with wavelengths around scale, drifting at speed radians per second,
+	//scaled so the acceleration is about strength in magnitude
+	void SetCurlNoise(float strength, float scale, float speed, unsigned int waveCount, uint32_t seed);
+
+	void Clear();
+	bool IsEmpty() const;
+
+	//acceleration at count points at time
+	void Evaluate(const float* x, const float* y, const float* z, unsigned int count, float time, float* outX, float* outY, float* outZ) const;
+
+	//bound on the acceleration's magnitude anywhere, for culling bounds
+	float GetMaxAcceleration() const { return m_maxAcceleration; }
+
+	//the furthest a particle living lifeTime can be pushed away from where the closed form puts it
+	float GetReach(float lifeTime) const { return 0.5f * m_maxAcceleration * lifeTime * lifeTime; }
+
+	//what the gpu side uploads
+	const std::vector<ForceAttractor>& GetAttractors() const { return m_attractors; }
+	const std::vector<ForceVortex>& GetVortices() const { return m_vortices; }
+	const std::vector<ForceCurlWave>& GetCurlWaves() const { return m_curlWaves; }
+	const ForceGrid& GetGrid() const { return m_grid; }
+	bool HasGrid() const { return !m_grid.values.empty(); }
+
+private:
+	std::vector<ForceAttractor> m_attractors;
+	std::vector<ForceVortex> m_vortices;
+	std::vector<ForceCurlWave> m_curlWaves;
+	ForceGrid m_grid = {};
+
+	//per source bounds, summed in m_maxAcceleration
+	float m_curlMax = 0.0f, m_gridMax = 0.0f;
+	float m_maxAcceleration = 0.0f;
+
+	void UpdateMaxAcceleration();
+};
+
+//kicks the particles in slots [begin, end) by the field at time, for a step of dt that ended there
+//the particles stay in closed form: the kick goes into their start velocity and their start position moves back by
+//kick * age, so the position at time is unchanged and only the motion from time on bends
+//acc is the emitter's constant acceleration, which the closed form already covers
+void ApplyForceField(const ForceField& field, ParticleStreams& streams, unsigned int begin, unsigned int end, float time, float dt, const float acc[3]);
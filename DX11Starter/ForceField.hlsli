@@ -0,0 +1,95 @@
+#ifndef __FORCE_FIELD
+#define __FORCE_FIELD
+
+//port of ForceField.cpp: point attractors, vortices, curl noise waves and a vector field grid, summed into one acceleration
+//an empty field has every count zero and costs a few uniform branches
+
+struct ForceAttractor
+{
+	float3 Position;
+	float Strength;
+	float Radius;
+};
+
+struct ForceVortex
+{
+	float3 Position;
+	float Strength;
+	float3 Axis;
+	float Radius;
+};
+
+struct ForceCurlWave
+{
+	float3 Wave;
+	float Phase;
+	float3 Curl;
+	float Speed;
+};
+
+cbuffer ForceFieldData : register(b1)
+{
+	uint attractorCount;
+	uint vortexCount;
+	uint curlWaveCount;
+	uint gridEnabled;
+
+	float3 gridOrigin;
+	float gridInvCellSize;
+
+	//size - 1 per axis, the last corner
+	float3 gridLast;
+}
+
+StructuredBuffer<ForceAttractor> Attractors : register(t0);
+StructuredBuffer<ForceVortex> Vortices		: register(t1);
+StructuredBuffer<ForceCurlWave> CurlWaves	: register(t2);
+Texture3D<float4> ForceGrid					: register(t3);
+
+//trilinear by hand like the cpu, hardware filtering only has 8 bits of fraction
+float3 SampleForceGrid(float3 position)
+{
+	float3 cell = clamp((position - gridOrigin) * gridInvCellSize, 0.0f, gridLast);
+	int3 base = (int3)cell;
+	int3 next = (int3)min((float3)base + 1.0f, gridLast);
+	float3 t = cell - (float3)base;
+
+	float3 z0 = lerp(lerp(ForceGrid.Load(int4(base.x, base.y, base.z, 0)).xyz, ForceGrid.Load(int4(next.x, base.y, base.z, 0)).xyz, t.x),
+		lerp(ForceGrid.Load(int4(base.x, next.y, base.z, 0)).xyz, ForceGrid.Load(int4(next.x, next.y, base.z, 0)).xyz, t.x), t.y);
+	float3 z1 = lerp(lerp(ForceGrid.Load(int4(base.x, base.y, next.z, 0)).xyz, ForceGrid.Load(int4(next.x, base.y, next.z, 0)).xyz, t.x),
+		lerp(ForceGrid.Load(int4(base.x, next.y, next.z, 0)).xyz, ForceGrid.Load(int4(next.x, next.y, next.z, 0)).xyz, t.x), t.y);
+	return lerp(z0, z1, t.z);
+}
+
+float3 ForceAt(float3 position, float time)
+{
+	float3 acceleration = 0;
+
+	for (uint a = 0; a < attractorCount; a++)
+	{
+		ForceAttractor attractor = Attractors[a];
+		float3 d = attractor.Position - position;
+		float inverse = rsqrt(dot(d, d) + attractor.Radius * attractor.Radius);
+		acceleration += d * (attractor.Strength * inverse * inverse * inverse);
+	}
+
+	for (uint v = 0; v < vortexCount; v++)
+	{
+		ForceVortex vortex = Vortices[v];
+		float3 d = position - vortex.Position;
+		acceleration += cross(vortex.Axis, d) * (vortex.Strength / (dot(d, d) + vortex.Radius * vortex.Radius));
+	}
+
+	for (uint w = 0; w < curlWaveCount; w++)
+	{
+		ForceCurlWave wave = CurlWaves[w];
+		acceleration += wave.Curl * cos(dot(wave.Wave, position) + wave.Phase + wave.Speed * time);
+	}
+
+	if (gridEnabled)
+		acceleration += SampleForceGrid(position);
+
+	return acceleration;
+}
+
+#endif
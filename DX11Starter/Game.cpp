@@ -63,9 +63,12 @@ Game::~Game()
 	if (particleEmitCS != nullptr) delete particleEmitCS;
 	if (particleUpdateCS != nullptr) delete particleUpdateCS;
 	if (particleSetArgsBuffCS != nullptr) delete particleSetArgsBuffCS;
+	if (particleSortArgsCS != nullptr) delete particleSortArgsCS;
+	if (particleSortLocalCS != nullptr) delete particleSortLocalCS;
+	if (particleSortStepCS != nullptr) delete particleSortStepCS;
+	if (particleSortMergeCS != nullptr) delete particleSortMergeCS;
 	if (gpuParticleVS != nullptr) delete gpuParticleVS;
 	if (gpuParticlePS != nullptr) delete gpuParticlePS;
-	if (emitterGpu != nullptr) delete emitterGpu;
 
 
 	//delete / Release particle Stuff
@@ -74,9 +77,10 @@ Game::~Game()
 	if (debugRaster != nullptr) debugRaster->Release();
 	if (particleVS != nullptr) delete particleVS;
 	if (hybridParticleVS != nullptr) delete hybridParticleVS;
+	if (particleInstanceVS != nullptr) delete particleInstanceVS;
 	if (particlePS != nullptr) delete particlePS;
-	if (emitter != nullptr) delete emitter;
-	if (emitterHY != nullptr) delete emitterHY;
+	if (particleEffects != nullptr) delete particleEffects;
+	if (particleSystems != nullptr) delete particleSystems;
 
 	//delete/release waterStuff;
 	delete[] waves;
@@ -113,6 +117,7 @@ Game::~Game()
 	if (terrainVertices) delete[] terrainVertices;
 	if (terrainIndices) delete[] terrainIndices;
 	if (heightArray) delete[] heightArray;
+	if (ground) delete ground;
 	if (terrainVS) delete terrainVS;
 	if (terrainPS) delete terrainPS;
 
@@ -312,69 +317,25 @@ void Game::Init()
 	rd.FillMode = D3D11_FILL_WIREFRAME;
 	device->CreateRasterizerState(&rd, &debugRaster);
 
-	emitter = new Emitter
-	(
-		XMFLOAT3(-2, 2, 0),
-		XMFLOAT4(1, 0.1f, 0.1f, 0.7f),
-		XMFLOAT4(1, 0.6f, 0.1f, 0.f),
-		XMFLOAT4(-2, 2, -2, 2),
-		XMFLOAT3(0.2f, 0.2f, 0.2f),
-		XMFLOAT3(0.1f, 0.1f, 0.1f),
-		XMFLOAT3(-2, 8, 5),
-		XMFLOAT3(0, -1, 0),
-		210,
-		30,
-		2,
-		0.1f,
-		2.0f,
-		device,
-		particleVS,
-		particlePS,
-		texMap["particle"]->GetSRV()
-	);
-
-	emitterHY = new HybridEmitter
-	(
-		XMFLOAT3(-2, 2, 0),
-		XMFLOAT4(1, 0.1f, 0.1f, 0.7f),
-		XMFLOAT4(1, 0.6f, 0.1f, 0.f),
-		XMFLOAT4(-2, 2, -2, 2),
-		XMFLOAT3(0.2f, 0.2f, 0.2f),
-		XMFLOAT3(0.1f, 0.1f, 0.1f),
-		XMFLOAT3(-2, 5, 5),
-		XMFLOAT3(0, -1, 0),
-		210,
-		30,
-		2,
-		0.1f,
-		2.0f,
-		device,
-		hybridParticleVS,
-		particlePS,
-		texMap["particle"]->GetSRV()
-	);
-
-	emitterGpu = new GPUEmitter(
-		1000, 100.0f,
-		3.0f, 0.1f,
-		2.0f,
-		XMFLOAT3(-2, 0, 5),
-		XMFLOAT3(-2, 2, 0),
-		XMFLOAT3(0.1f, 0.1f, 0.1f),
-		XMFLOAT3(0.2f, 0.2f, 0.2f),
-		XMFLOAT4(-2, 2, -2, 2),
-		XMFLOAT4(1, 0.1f, 0.1f, 0.7f),
-		XMFLOAT4(1, 0.6f, 0.1f, 0.f),
-		device,
-		context,
-		particledeadInitCS,
-		particleUpdateCS,
-		particleEmitCS,
-		particleSetArgsBuffCS,
-		gpuParticleVS,
-		gpuParticlePS,
-		texMap["particle"]->GetSRV()
-	);
+	particleSystems = new ParticleSystemManager();
+
+	ParticleShaders particleShaders =
+	{
+		particleVS, particleInstanceVS, hybridParticleVS, particlePS,
+		gpuParticleVS, gpuParticlePS,
+		particledeadInitCS, particleEmitCS, particleUpdateCS, particleSetArgsBuffCS,
+		particleSortArgsCS, particleSortLocalCS, particleSortStepCS, particleSortMergeCS
+	};
+	particleEffects = new ParticleEffects(particleSystems, device, context, particleShaders, &texMap, &meshMap);
+	particleEffects->SetGround(ground);
+
+	//cooked effects when present, otherwise straight from the text source
+	std::string effectError;
+	if (!particleEffects->Load("Effects/Particles.pfx", effectError) && !particleEffects->Load("Effects/Particles.txt", effectError))
+		std::cout << "effects: " << effectError << "\n";
+
+	for (unsigned int i = 0; i < particleEffects->GetEffectCount(); i++)
+		particleEffects->Spawn(i, XMFLOAT3(particleEffects->GetDesc(i).position));
 
 	// Ask DirectX for the actual object
 	device->CreateSamplerState(&rSamp, &refractSampler);
@@ -389,7 +350,7 @@ void Game::LoadHeightMap(const char* fileLocation, unsigned int resolution)
 	resolution++;
 	m_resolution = resolution;
 	unsigned int numVerts = resolution * resolution;
-	unsigned int numIndicies = (resolution - 1) * (resolution - 1) * 6;
+	unsigned int numIndicies = GridIndexCount(resolution, resolution);
 
 	//creating arrays to store data
 	heightArray = new unsigned int[numVerts];
@@ -420,20 +381,8 @@ void Game::LoadHeightMap(const char* fileLocation, unsigned int resolution)
 	}
 
 
-	int intIndex = 0;
-	for (int i = 0; i < m_resolution - 1; i++)
-	{
-		for (int j = 0; j < m_resolution - 1; j++)
-		{
-			terrainIndices[intIndex++] = i * m_resolution + j;
-			terrainIndices[intIndex++] = i * m_resolution + j + 1;
-			terrainIndices[intIndex++] = (i + 1) * m_resolution + j;
-			terrainIndices[intIndex++] = i * m_resolution + j + 1;
-			terrainIndices[intIndex++] = (i + 1) * m_resolution + j + 1;
-			terrainIndices[intIndex++] = (i + 1) * m_resolution + j;
-		}
-	}
-
+	//already in vertex cache order, and the vertices stay the grid the heightfield below reads
+	BuildGridIndices(terrainIndices, resolution, resolution);
 	meshMap["terrain"] = new Mesh(terrainVertices, terrainIndices, numVerts, numIndicies, device);
 
 	XMMATRIX trans = XMMatrixTranslation(0.0f, -1.5f, 0.0f);
@@ -441,6 +390,10 @@ void Game::LoadHeightMap(const char* fileLocation, unsigned int resolution)
 	XMMATRIX scale = XMMatrixScaling(1.0f, 1.0f, 1.0f);
 	XMMATRIX terrainMatrix = XMMatrixMultiply(XMMatrixMultiply(scale, rot), trans);
 	XMStoreFloat4x4(&TerrainMatrix, XMMatrixTranspose(terrainMatrix));
+
+	//the same heights where the terrain matrix puts them, for particles to collide with
+	float groundOrigin[3] = { 0.0f, -1.5f, 0.0f };
+	ground = new Heightfield(&terrainVertices[0].Position.y, sizeof(TerrainVertex), m_resolution, m_resolution, groundOrigin, 1.0f);
 }
 
 void Game::AddLighting()
@@ -508,12 +461,27 @@ void Game::LoadShaders()
 	particleSetArgsBuffCS = new SimpleComputeShader(device, context);
 	particleSetArgsBuffCS->LoadShaderFile(L"ParticleSetArgsBuffCS.cso");
 
+	particleSortArgsCS = new SimpleComputeShader(device, context);
+	particleSortArgsCS->LoadShaderFile(L"ParticleSortArgsCS.cso");
+
+	particleSortLocalCS = new SimpleComputeShader(device, context);
+	particleSortLocalCS->LoadShaderFile(L"ParticleSortLocalCS.cso");
+
+	particleSortStepCS = new SimpleComputeShader(device, context);
+	particleSortStepCS->LoadShaderFile(L"ParticleSortStepCS.cso");
+
+	particleSortMergeCS = new SimpleComputeShader(device, context);
+	particleSortMergeCS->LoadShaderFile(L"ParticleSortMergeCS.cso");
+
 	particleVS = new SimpleVertexShader(device, context);
 	particleVS->LoadShaderFile(L"ParticleVS.cso");
 
 	hybridParticleVS = new SimpleVertexShader(device, context);
 	hybridParticleVS->LoadShaderFile(L"HybridParticleVS.cso");
 
+	particleInstanceVS = new SimpleVertexShader(device, context);
+	particleInstanceVS->LoadShaderFile(L"ParticleInstanceVS.cso");
+
 	particlePS = new SimplePixelShader(device, context);
 	particlePS->LoadShaderFile(L"ParticlePS.cso");
 
@@ -560,7 +528,11 @@ void Game::LoadModelDirectory()
 	std::stringstream ss;
 	std::string s, path, s1;
 	std::string ModelPath = "Models";
+	std::string CachePath = "ModelCache";
 	unsigned int strlength = ModelPath.length() + 2;
+
+	//big scanned models parse in parallel chunks; the particle systems' workers do not exist yet
+	JobSystem loadJobs;
 	for (const auto& entry : fs::directory_iterator(ModelPath))
 	{
 		ss << entry.path();
@@ -570,8 +542,14 @@ void Game::LoadModelDirectory()
 		ss.clear();
 
 		path = s.substr(strlength);
+		if (entry.path().extension() != ".obj")
+			continue;
+
+		//cooked copies go to ModelCache beside Models, so every launch after the first only maps them
+		std::string name = path.substr(0, path.find("."));
+		std::string cachePath = CachePath + "/" + name + ".mesh";
 		ss << ModelPath << "/" << path;
-		meshMap[path.substr(0, path.find("."))] = new Mesh(ss.str().c_str(), device);
+		meshMap[name] = new Mesh(ss.str().c_str(), device, true, &loadJobs, cachePath.c_str());
 		ss.str(std::string());
 		ss.clear();
 	}
@@ -597,24 +575,11 @@ void Game::CreateWaterMesh()
 	}
 
 
-	UINT* ibw = new UINT[6 * 999 * 999];
-	int index = 0;
-	for (unsigned int i = 0; i < 999; i++)
-
-	{
-		for (unsigned int j = 0; j < 999; j++)
-		{
-			ibw[index++] = i * 1000 + j;
-			ibw[index++] = i * 1000 + (j + 1);
-			ibw[index++] = (i + 1) * 1000 + j;
-			ibw[index++] = i * 1000 + (j + 1);
-			ibw[index++] = (i + 1) * 1000 + (j + 1);
-			ibw[index++] = (i + 1) * 1000 + j;
-		}
-	}
-
-
-	meshMap["water"] = new Mesh(vbw, ibw, 1000000, 6 * 999 * 999, device);
+	//generated in vertex cache order, nothing to optimize at startup
+	unsigned int indexCount = GridIndexCount(1000, 1000);
+	UINT* ibw = new UINT[indexCount];
+	BuildGridIndices(ibw, 1000, 1000);
+	meshMap["water"] = new Mesh(vbw, ibw, 1000000, indexCount, device);
 	delete vbw;
 	delete ibw;
 
@@ -724,9 +689,7 @@ void Game::Update(float deltaTime, float totalTime)
 {
 	XMMATRIX rot = XMMatrixRotationRollPitchYaw(0.0f, totalTime, totalTime);
 	//entityList[0].SetRot(rot);
-	emitter->UpdateEmitter(deltaTime);
-	emitterHY->UpdateEmitter(deltaTime, totalTime);
-	emitterGpu->Update(deltaTime, totalTime);
+	particleSystems->Update(deltaTime, totalTime, camera);
 
 	rot = XMMatrixRotationRollPitchYaw(totalTime, 0.0f, totalTime);
 	//entityList[1].SetRot(rot);
@@ -786,9 +749,7 @@ void Game::Draw(float deltaTime, float totalTime)
 	particlePS->SetSamplerState("Sampler", Texture::m_sampler);
 	particlePS->CopyAllBufferData();
 
-	emitter->DrawEmitter(context, camera);
-	emitterHY->DrawEmitter(context, camera, totalTime);
-	emitterGpu->Draw(camera);
+	particleSystems->Draw(context, camera);
 
 	if (GetAsyncKeyState('C')) 
 	{
@@ -846,7 +807,7 @@ void Game::DrawTerrain()
 	terrainPS->SetShaderResourceView("terrainTexture", texMap["beach"]->GetSRV());
 	terrainPS->CopyAllBufferData();
 
-	context->DrawIndexed(6 * (m_resolution - 1) * (m_resolution - 1), 0, 0);
+	context->DrawIndexed(meshMap["terrain"]->GetIndexCount(), 0, 0);
 }
 
 
@@ -1015,7 +976,7 @@ void Game::DrawWater(float delta)
 	waterShaderPS->SetShaderResourceView("Reflection", reflectionSRV);
 	waterShaderPS->CopyAllBufferData();
 
-	context->DrawIndexed(6 * 999 * 999, 0, 0);
+	context->DrawIndexed(meshMap["water"]->GetIndexCount(), 0, 0);
 }
 
 //funciton to draw sky
@@ -12,6 +12,7 @@
 #include "Emitter.h"
 #include "HybridEmitter.h"
 #include "GpuEmitter.h"
+#include "ParticleEffects.h"
 
 class Game
 	: public DXCore
@@ -25,9 +26,8 @@ public:
 	ID3D11DepthStencilState* particleDepth = nullptr;
 	ID3D11BlendState* particleBlend = nullptr;
 	ID3D11RasterizerState* debugRaster = nullptr;
-	Emitter* emitter = nullptr;
-	HybridEmitter* emitterHY = nullptr;
-	GPUEmitter* emitterGpu = nullptr;
+	ParticleSystemManager* particleSystems = nullptr;
+	ParticleEffects* particleEffects = nullptr;
 	//Water Stuff
 	Materials* material = nullptr;
 	XMFLOAT4X4 WaterMatrix;
@@ -48,6 +48,7 @@ public:
 	TerrainVertex* terrainVertices = nullptr;
 	unsigned int * heightArray = nullptr, * terrainIndices = nullptr;
 	XMFLOAT4X4 TerrainMatrix;
+	Heightfield* ground = nullptr;
 	unsigned int m_resolution;
 
 	//General Stuff
@@ -120,11 +121,12 @@ private:
 	SimplePixelShader* PS_merge = nullptr;
 
 	//Particle Shaders
-	SimpleVertexShader* particleVS = nullptr, * hybridParticleVS = nullptr;
+	SimpleVertexShader* particleVS = nullptr, * hybridParticleVS = nullptr, * particleInstanceVS = nullptr;
 	SimplePixelShader* particlePS = nullptr;
 
 	//GpuParticleStuff
 	SimpleComputeShader* particledeadInitCS = nullptr, * particleUpdateCS = nullptr, * particleEmitCS = nullptr, * particleSetArgsBuffCS = nullptr;
+	SimpleComputeShader* particleSortArgsCS = nullptr, * particleSortLocalCS = nullptr, * particleSortStepCS = nullptr, * particleSortMergeCS = nullptr;
 	SimpleVertexShader* gpuParticleVS = nullptr;
 	SimplePixelShader* gpuParticlePS = nullptr;
 
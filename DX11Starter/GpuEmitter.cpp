@@ -1,6 +1,42 @@
 #include "GpuEmitter.h"
 
-float GPUEmitter::s_emitTimeCounter = 0;
+namespace
+{
+	//elements sorted in groupshared memory per group, SORT_BLOCK in ParticleSort.hlsli
+	const unsigned int c_sortBlock = 1024;
+
+	//immutable structured buffer read through an srv, null when there is nothing to read
+	template <typename T>
+	ID3D11ShaderResourceView* CreateStructuredSRV(ID3D11Device* device, const std::vector<T>& elements)
+	{
+		if (elements.empty())
+			return nullptr;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.ByteWidth = sizeof(T) * (UINT)elements.size();
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = sizeof(T);
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+
+		D3D11_SUBRESOURCE_DATA data = {};
+		data.pSysMem = elements.data();
+
+		ID3D11Buffer* buffer = nullptr;
+		device->CreateBuffer(&desc, &data, &buffer);
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = (UINT)elements.size();
+
+		ID3D11ShaderResourceView* srv = nullptr;
+		device->CreateShaderResourceView(buffer, &srvDesc, &srv);
+		buffer->Release();
+		return srv;
+	}
+}
 
 GPUEmitter::GPUEmitter
 (
@@ -36,34 +72,24 @@ GPUEmitter::GPUEmitter
 
 	m_timePerEmit = 1.0f / emitRate;
 
-	s_emitTimeCounter = 0.0f;
-
-	//index buffer creation
-	D3D11_BUFFER_DESC ibDesc = {};
-	ibDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibDesc.ByteWidth = sizeof(unsigned long) * 6 * m_maxParticles;
-	ibDesc.CPUAccessFlags = 0;
-	ibDesc.MiscFlags = 0;
-	ibDesc.StructureByteStride = 0;
-	ibDesc.Usage = D3D11_USAGE_DEFAULT;
-
-	unsigned long* indexArr = new unsigned long[m_maxParticles * 6];
-	unsigned long index = 0;
-	for (unsigned long i = 0; i < m_maxParticles; i++)
+	//everything the particles can reach over their life, for culling
+	//ParticleUpdateCS moves them without acceleration but a force field's, which SetForceField adds to the bounds,
+	//and ages them at twice the rate, so the lifetime is an upper bound
+	ParticleMotion motion =
 	{
-		indexArr[index++] = 0 + 4 * i;
-		indexArr[index++] = 1 + 4 * i;
-		indexArr[index++] = 2 + 4 * i;
-		indexArr[index++] = 0 + 4 * i;
-		indexArr[index++] = 2 + 4 * i;
-		indexArr[index++] = 3 + 4 * i;
-	}
+		{ emitterPos.x, emitterPos.y, emitterPos.z }, { posRange.x, posRange.y, posRange.z },
+		{ startVel.x, startVel.y, startVel.z }, { velRange.x, velRange.y, velRange.z },
+		{ 0, 0, 0 },
+		lifeTime, max(startSize, EndSize)
+	};
+	m_bounds = ComputeParticleBounds(motion);
 
-	D3D11_SUBRESOURCE_DATA indexData = {};
-	indexData.pSysMem = indexArr;
-	device->CreateBuffer(&ibDesc, &indexData, &m_indexBuff);
+	m_emitTimeCounter = 0.0f;
 
-	delete[] indexArr;
+	m_randomKey = NextParticleRandomKey();
+	m_spawnIndex = 0;
+
+	QuadIndexBuffer::Acquire(device, m_maxParticles);
 
 
 	//create particle pool SRV and UAV
@@ -191,12 +217,28 @@ GPUEmitter::GPUEmitter
 	m_initParticlesCS->DispatchByThreads(m_maxParticles, 1, 1);
 }
 
+GPUEmitter::GPUEmitter
+(
+	const EmitterDesc& desc, ID3D11Device* device, ID3D11DeviceContext* context,
+	SimpleComputeShader* initParticles, SimpleComputeShader* updateParticles, SimpleComputeShader* emitParticles,
+	SimpleComputeShader* updateArgsBuffer, SimpleVertexShader* vertexShader, SimplePixelShader* pixelShader, ID3D11ShaderResourceView* texture
+)
+	: GPUEmitter
+	(
+		desc.maxParticles, desc.emitRate, desc.lifeTime, desc.startSize, desc.endSize,
+		DirectX::XMFLOAT3(desc.position), DirectX::XMFLOAT3(desc.velocity), DirectX::XMFLOAT3(desc.positionRange), DirectX::XMFLOAT3(desc.velocityRange),
+		DirectX::XMFLOAT4(desc.rotationRange), DirectX::XMFLOAT4(desc.startColor), DirectX::XMFLOAT4(desc.endColor),
+		device, context, initParticles, updateParticles, emitParticles, updateArgsBuffer, vertexShader, pixelShader, texture
+	)
+{
+}
+
 GPUEmitter::~GPUEmitter()
 {
 	//release misc buffers
 	if (m_depthState)		m_depthState->Release();
 	if (m_blendState)		m_blendState->Release();
-	if (m_indexBuff)		m_indexBuff->Release();
+	QuadIndexBuffer::Release();
 	if (m_drawArgsBuff)		m_drawArgsBuff->Release();
 
 	//release SRV 's
@@ -209,6 +251,205 @@ GPUEmitter::~GPUEmitter()
 	if (m_deadParticleUAV)	m_deadParticleUAV->Release();
 	if (m_drawArgsUAV)		m_drawArgsUAV->Release();
 
+	//release sort resources
+	if (m_sortCountBuff)	m_sortCountBuff->Release();
+	if (m_sortArgsBuff)		m_sortArgsBuff->Release();
+	if (m_sortCountSRV)		m_sortCountSRV->Release();
+	if (m_sortArgsUAV)		m_sortArgsUAV->Release();
+	if (m_sortCountBuff)	AlphaBlendState::Release();
+
+	ReleaseForceField();
+}
+
+void GPUEmitter::ReleaseForceField()
+{
+	if (m_attractorSRV)		m_attractorSRV->Release();
+	if (m_vortexSRV)		m_vortexSRV->Release();
+	if (m_curlWaveSRV)		m_curlWaveSRV->Release();
+	if (m_forceGridSRV)		m_forceGridSRV->Release();
+	m_attractorSRV = m_vortexSRV = m_curlWaveSRV = m_forceGridSRV = nullptr;
+
+	m_attractorCount = m_vortexCount = m_curlWaveCount = 0;
+	m_forceGrid = false;
+}
+
+void GPUEmitter::SetForceField(ID3D11Device* device, const ForceField* field)
+{
+	ReleaseForceField();
+
+	//the bounds grow or shrink by the difference in how far the field can push
+	float reach = field ? field->GetReach(m_lifeTime) : 0.0f;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		m_bounds.min[axis] -= reach - m_forceReach;
+		m_bounds.max[axis] += reach - m_forceReach;
+	}
+	m_forceReach = reach;
+
+	if (!field)
+		return;
+
+	m_attractorSRV = CreateStructuredSRV(device, field->GetAttractors());
+	m_vortexSRV = CreateStructuredSRV(device, field->GetVortices());
+	m_curlWaveSRV = CreateStructuredSRV(device, field->GetCurlWaves());
+	m_attractorCount = (unsigned int)field->GetAttractors().size();
+	m_vortexCount = (unsigned int)field->GetVortices().size();
+	m_curlWaveCount = (unsigned int)field->GetCurlWaves().size();
+
+	if (!field->HasGrid())
+		return;
+
+	//the grid's float4 corners are a volume texture as they are, read with Load so no sampler is needed
+	const ForceGrid& grid = field->GetGrid();
+	D3D11_TEXTURE3D_DESC gridDesc = {};
+	gridDesc.Width = grid.size[0];
+	gridDesc.Height = grid.size[1];
+	gridDesc.Depth = grid.size[2];
+	gridDesc.MipLevels = 1;
+	gridDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	gridDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	gridDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA gridData = {};
+	gridData.pSysMem = grid.values.data();
+	gridData.SysMemPitch = sizeof(float) * 4 * grid.size[0];
+	gridData.SysMemSlicePitch = gridData.SysMemPitch * grid.size[1];
+
+	ID3D11Texture3D* gridTexture = nullptr;
+	device->CreateTexture3D(&gridDesc, &gridData, &gridTexture);
+	device->CreateShaderResourceView(gridTexture, 0, &m_forceGridSRV);
+	gridTexture->Release();
+
+	m_forceGrid = true;
+	m_gridOrigin = DirectX::XMFLOAT3(grid.origin[0], grid.origin[1], grid.origin[2]);
+	m_gridInvCellSize = 1.0f / grid.cellSize;
+	m_gridLast = DirectX::XMFLOAT3((float)(grid.size[0] - 1), (float)(grid.size[1] - 1), (float)(grid.size[2] - 1));
+}
+
+ID3D11ShaderResourceView* GPUEmitter::CreateGroundSRV(ID3D11Device* device, const Heightfield& ground)
+{
+	//one texel row per x corner, the padding row and column included so the border cell needs no clamp
+	D3D11_TEXTURE2D_DESC groundDesc = {};
+	groundDesc.Width = ground.GetCountZ() + 1;
+	groundDesc.Height = ground.GetCountX() + 1;
+	groundDesc.MipLevels = 1;
+	groundDesc.ArraySize = 1;
+	groundDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	groundDesc.SampleDesc.Count = 1;
+	groundDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	groundDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA groundData = {};
+	groundData.pSysMem = ground.GetPaddedHeights().data();
+	groundData.SysMemPitch = sizeof(float) * groundDesc.Width;
+
+	ID3D11Texture2D* groundTexture = nullptr;
+	ID3D11ShaderResourceView* groundSRV = nullptr;
+	device->CreateTexture2D(&groundDesc, &groundData, &groundTexture);
+	device->CreateShaderResourceView(groundTexture, 0, &groundSRV);
+	groundTexture->Release();
+	return groundSRV;
+}
+
+void GPUEmitter::SetCollision(const Heightfield* ground, ID3D11ShaderResourceView* groundSRV, const ParticleCollision& collision)
+{
+	bool colliding = ground && groundSRV && collision.mode != ParticleCollision_None;
+	m_groundSRV = colliding ? groundSRV : nullptr;
+	m_collisionMode = colliding ? collision.mode : ParticleCollision_None;
+	m_restitution = collision.restitution;
+	m_friction = collision.friction;
+
+	//a bounce only turns a particle, so it stays within its top speed's reach of the spawn box; the kernel has no acceleration
+	float velocity[3] = { m_startVel.x, m_startVel.y, m_startVel.z };
+	float velocityRange[3] = { m_velRange.x, m_velRange.y, m_velRange.z };
+	float noAcceleration[3] = { 0, 0, 0 };
+	float reach = m_collisionMode == ParticleCollision_Bounce ? GetBounceReach(velocity, velocityRange, noAcceleration, m_lifeTime) : 0.0f;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		m_bounds.min[axis] -= reach - m_bounceReach;
+		m_bounds.max[axis] += reach - m_bounceReach;
+	}
+	m_bounceReach = reach;
+
+	if (!colliding)
+		return;
+
+	const float* origin = ground->GetOrigin();
+	m_groundOrigin = DirectX::XMFLOAT3(origin[0], origin[1], origin[2]);
+	m_groundInvCellSize = 1.0f / ground->GetCellSize();
+	m_groundLast = DirectX::XMFLOAT2((float)(ground->GetCountX() - 1), (float)(ground->GetCountZ() - 1));
+}
+
+void GPUEmitter::EnableDepthSort(ID3D11Device* device, SimpleComputeShader* sortArgs, SimpleComputeShader* sortLocal, SimpleComputeShader* sortStep, SimpleComputeShader* sortMerge)
+{
+	m_sortArgsCS = sortArgs;
+	m_sortLocalCS = sortLocal;
+	m_sortStepCS = sortStep;
+	m_sortMergeCS = sortMerge;
+
+	if (m_sortCountBuff)
+		return;
+
+	//the order is only visible under alpha over, so a sorted emitter draws with that instead of m_blendState
+	AlphaBlendState::Acquire(device);
+
+	//CopyStructureCount target, read by every sort pass
+	D3D11_BUFFER_DESC countDesc = {};
+	countDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	countDesc.ByteWidth = sizeof(unsigned int) * 4;
+	countDesc.Usage = D3D11_USAGE_DEFAULT;
+	device->CreateBuffer(&countDesc, 0, &m_sortCountBuff);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC countSRVDesc = {};
+	countSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	countSRVDesc.Format = DXGI_FORMAT_R32_UINT;
+	countSRVDesc.Buffer.FirstElement = 0;
+	countSRVDesc.Buffer.NumElements = 1;
+	device->CreateShaderResourceView(m_sortCountBuff, &countSRVDesc, &m_sortCountSRV);
+
+	//dispatch args: groups of blocks at 0, groups of pairs at 3
+	D3D11_BUFFER_DESC argsDesc = {};
+	argsDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	argsDesc.ByteWidth = sizeof(unsigned int) * 6;
+	argsDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+	argsDesc.Usage = D3D11_USAGE_DEFAULT;
+	device->CreateBuffer(&argsDesc, 0, &m_sortArgsBuff);
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC argsUAVDesc = {};
+	argsUAVDesc.Format = DXGI_FORMAT_R32_UINT;
+	argsUAVDesc.Buffer.FirstElement = 0;
+	argsUAVDesc.Buffer.NumElements = 6;
+	argsUAVDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	device->CreateUnorderedAccessView(m_sortArgsBuff, &argsUAVDesc, &m_sortArgsUAV);
+}
+
+void GPUEmitter::Restart(const DirectX::XMFLOAT3& position)
+{
+	float offset[3] = { position.x - m_emitterPos.x, position.y - m_emitterPos.y, position.z - m_emitterPos.z };
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		m_bounds.min[axis] += offset[axis];
+		m_bounds.max[axis] += offset[axis];
+	}
+	m_emitterPos = position;
+	m_randomKey = NextParticleRandomKey();
+	m_spawnIndex = 0;
+	m_emitTimeCounter = 0.0f;
+
+	ID3D11UnorderedAccessView* none[8] = {};
+	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
+
+	//a zeroed pool is all dead, then the dead list is refilled from an empty counter
+	const UINT zero[4] = {};
+	m_context->ClearUnorderedAccessViewUint(m_particlePoolUAV, zero);
+
+	m_initParticlesCS->SetShader();
+	m_initParticlesCS->SetInt("maxParticles", m_maxParticles);
+	m_initParticlesCS->SetUnorderedAccessView("DeadList", m_deadParticleUAV, 0);
+	m_initParticlesCS->CopyAllBufferData();
+	m_initParticlesCS->DispatchByThreads(m_maxParticles, 1, 1);
+
+	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
 }
 
 void GPUEmitter::Update(float dt, float totaltime)
@@ -216,14 +457,15 @@ void GPUEmitter::Update(float dt, float totaltime)
 	ID3D11UnorderedAccessView* none[8] = {};
 	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
 
-	s_emitTimeCounter += dt;
+	m_emitTimeCounter += dt;
 
-	if (s_emitTimeCounter >= m_timePerEmit)
+	float timePerEmit = m_timePerEmit * m_detail;
+	if (m_emitTimeCounter >= timePerEmit)
 	{
-		int emitCount = (int)(s_emitTimeCounter / m_timePerEmit);
+		int emitCount = (int)(m_emitTimeCounter / timePerEmit);
 		emitCount = min(emitCount, 65535);
 
-		s_emitTimeCounter = fmod(s_emitTimeCounter, m_timePerEmit);
+		m_emitTimeCounter = fmod(m_emitTimeCounter, timePerEmit);
 
 		m_emitParticleCS->SetShader();
 		m_emitParticleCS->SetFloat3("startPos", m_emitterPos);
@@ -235,10 +477,14 @@ void GPUEmitter::Update(float dt, float totaltime)
 		m_emitParticleCS->SetFloat("totalTime", totaltime);
 		m_emitParticleCS->SetInt("emitCount", emitCount);
 		m_emitParticleCS->SetInt("maxParticle", m_maxParticles);
+		m_emitParticleCS->SetInt("randomKey", (int)m_randomKey);
+		m_emitParticleCS->SetInt("spawnBase", (int)m_spawnIndex);
 		m_emitParticleCS->SetUnorderedAccessView("ParticlePool", m_particlePoolUAV);
 		m_emitParticleCS->SetUnorderedAccessView("DeadList", m_deadParticleUAV);
 		m_emitParticleCS->CopyAllBufferData();
 		m_emitParticleCS->DispatchByThreads(emitCount, 1, 1);
+
+		m_spawnIndex += emitCount;
 	}
 
 	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
@@ -254,6 +500,25 @@ void GPUEmitter::Update(float dt, float totaltime)
 	m_updateParticleCS->SetFloat("startSize", m_startSize);
 	m_updateParticleCS->SetFloat("endSize", m_endSize);
 	m_updateParticleCS->SetInt("maxParticles", m_maxParticles);
+	m_updateParticleCS->SetFloat3("viewPos", m_viewPos);
+	m_updateParticleCS->SetInt("attractorCount", m_attractorCount);
+	m_updateParticleCS->SetInt("vortexCount", m_vortexCount);
+	m_updateParticleCS->SetInt("curlWaveCount", m_curlWaveCount);
+	m_updateParticleCS->SetInt("gridEnabled", m_forceGrid);
+	m_updateParticleCS->SetFloat3("gridOrigin", m_gridOrigin);
+	m_updateParticleCS->SetFloat("gridInvCellSize", m_gridInvCellSize);
+	m_updateParticleCS->SetFloat3("gridLast", m_gridLast);
+	m_updateParticleCS->SetShaderResourceView("Attractors", m_attractorSRV);
+	m_updateParticleCS->SetShaderResourceView("Vortices", m_vortexSRV);
+	m_updateParticleCS->SetShaderResourceView("CurlWaves", m_curlWaveSRV);
+	m_updateParticleCS->SetShaderResourceView("ForceGrid", m_forceGridSRV);
+	m_updateParticleCS->SetInt("collisionMode", m_collisionMode);
+	m_updateParticleCS->SetFloat("restitution", m_restitution);
+	m_updateParticleCS->SetFloat("friction", m_friction);
+	m_updateParticleCS->SetFloat("groundInvCellSize", m_groundInvCellSize);
+	m_updateParticleCS->SetFloat3("groundOrigin", m_groundOrigin);
+	m_updateParticleCS->SetFloat2("groundLast", m_groundLast);
+	m_updateParticleCS->SetShaderResourceView("GroundHeights", m_groundSRV);
 	m_updateParticleCS->SetUnorderedAccessView("ParticlePool", m_particlePoolUAV);
 	m_updateParticleCS->SetUnorderedAccessView("DeadList", m_deadParticleUAV);
 	m_updateParticleCS->SetUnorderedAccessView("DrawList", m_drawParticleUAV, 0);
@@ -262,6 +527,9 @@ void GPUEmitter::Update(float dt, float totaltime)
 
 	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
 
+	if (m_sortLocalCS)
+		SortDrawList();
+
 	m_updateArgsBufferCS->SetShader();
 	m_updateArgsBufferCS->SetInt("vertsPerParticle", 6);
 	m_updateArgsBufferCS->SetUnorderedAccessView("DrawArgs", m_drawArgsUAV);
@@ -272,12 +540,65 @@ void GPUEmitter::Update(float dt, float totaltime)
 	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
 }
 
+void GPUEmitter::SortDrawList()
+{
+	ID3D11UnorderedAccessView* none[8] = {};
+	ID3D11ShaderResourceView* noSRV[1] = {};
+
+	//the live count only exists on the gpu, so the passes read it there and launch only the groups it needs
+	m_context->CopyStructureCount(m_sortCountBuff, 0, m_drawParticleUAV);
+
+	m_sortArgsCS->SetShader();
+	m_sortArgsCS->SetShaderResourceView("SortCount", m_sortCountSRV);
+	m_sortArgsCS->SetUnorderedAccessView("SortArgs", m_sortArgsUAV);
+	m_sortArgsCS->CopyAllBufferData();
+	m_sortArgsCS->DispatchByThreads(1, 1, 1);
+
+	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
+
+	m_sortLocalCS->SetShader();
+	m_sortLocalCS->SetShaderResourceView("SortCount", m_sortCountSRV);
+	m_sortLocalCS->SetUnorderedAccessView("DrawList", m_drawParticleUAV);
+	m_sortLocalCS->CopyAllBufferData();
+	m_context->DispatchIndirect(m_sortArgsBuff, 0);
+
+	//the cpu does not know the count, so it issues the stages for the largest pool; stages past the count launch no work
+	unsigned int sortLimit = c_sortBlock;
+	while (sortLimit < m_maxParticles)
+		sortLimit *= 2;
+
+	for (unsigned int sortSize = c_sortBlock * 2; sortSize <= sortLimit; sortSize *= 2)
+	{
+		//steps that cross blocks go through the draw list, the rest finish in groupshared memory
+		for (unsigned int step = sortSize / 2; step >= c_sortBlock; step /= 2)
+		{
+			m_sortStepCS->SetShader();
+			m_sortStepCS->SetInt("sortSize", sortSize);
+			m_sortStepCS->SetInt("sortStep", step);
+			m_sortStepCS->SetShaderResourceView("SortCount", m_sortCountSRV);
+			m_sortStepCS->SetUnorderedAccessView("DrawList", m_drawParticleUAV);
+			m_sortStepCS->CopyAllBufferData();
+			m_context->DispatchIndirect(m_sortArgsBuff, sizeof(unsigned int) * 3);
+		}
+
+		m_sortMergeCS->SetShader();
+		m_sortMergeCS->SetInt("sortSize", sortSize);
+		m_sortMergeCS->SetShaderResourceView("SortCount", m_sortCountSRV);
+		m_sortMergeCS->SetUnorderedAccessView("DrawList", m_drawParticleUAV);
+		m_sortMergeCS->CopyAllBufferData();
+		m_context->DispatchIndirect(m_sortArgsBuff, 0);
+	}
+
+	m_context->CSSetUnorderedAccessViews(0, 8, none, 0);
+	m_context->CSSetShaderResources(0, 1, noSRV);
+}
+
 void GPUEmitter::Draw(Camera* camera)
 {
-	m_context->OMSetBlendState(m_blendState, 0, 0xFFFFFFFF);
+	m_context->OMSetBlendState(m_sortLocalCS ? AlphaBlendState::Get() : m_blendState, 0, 0xFFFFFFFF);
 	m_context->OMSetDepthStencilState(m_depthState, 0);
 
-	m_context->IASetIndexBuffer(m_indexBuff, DXGI_FORMAT_R32_UINT, 0);
+	QuadIndexBuffer::Bind(m_context, m_maxParticles);
 
 	m_context->VSSetShaderResources(0, 1, &m_particlePoolSRV);
 	m_context->VSSetShaderResources(1, 1, &m_drawParticleSRV);
@@ -6,6 +6,14 @@
 #include "SimpleShader.h"
 #include "Camera.h"
 #include "Textures.h"
+#include "ParticleRandom.h"
+#include "QuadIndexBuffer.h"
+#include "AlphaBlendState.h"
+#include "GpuParticleReference.h"
+#include "ParticleBounds.h"
+#include "EmitterDesc.h"
+#include "ForceField.h"
+#include "Heightfield.h"
 
 struct GPUParticle 
 {
@@ -18,36 +26,76 @@ struct GPUParticle
 	DirectX::XMFLOAT3 padding;
 };
 
+//the headless reference in GpuParticleReference runs on the same layouts
+static_assert(sizeof(GPUParticle) == sizeof(GpuParticleRecord), "GPUParticle must match GpuParticleRecord");
+
 struct ParticleSort
 {
 	int index;
+	float distanceSq;
 };
+static_assert(sizeof(ParticleSort) == sizeof(GpuDrawRecord), "ParticleSort must match GpuDrawRecord");
 
 class GPUEmitter 
 {
 private:
 
-	static float s_emitTimeCounter;
 	unsigned int m_maxParticles, m_emitRate;
 	float m_timePerEmit, m_lifeTime;
+	//time not yet spent on emits, this emitter's own so pooled emitters never share a budget
+	float m_emitTimeCounter;
+	unsigned int m_randomKey, m_spawnIndex;
+
+	//level of detail: the emit rate is divided by m_detail
+	unsigned int m_detail = 1;
 
 	//emitterDescriptors
 	float m_startSize, m_endSize;
 	DirectX::XMFLOAT3 m_emitterPos, m_startRot, m_startVel , m_posRange, m_velRange;
 	DirectX::XMFLOAT4 m_startColor, m_endColor, m_rotRange;
 
+	ParticleBounds m_bounds;
+
 	SimpleComputeShader* m_initParticlesCS = nullptr,* m_updateParticleCS = nullptr,* m_emitParticleCS = nullptr,* m_updateArgsBufferCS = nullptr;
+	SimpleComputeShader* m_sortArgsCS = nullptr, * m_sortLocalCS = nullptr, * m_sortStepCS = nullptr, * m_sortMergeCS = nullptr;
 	SimpleVertexShader* m_VS = nullptr;
 	SimplePixelShader* m_PS = nullptr;
 	ID3D11DeviceContext* m_context = nullptr;
 
 
-	ID3D11Buffer* m_indexBuff = nullptr , * m_drawArgsBuff = nullptr;
+	ID3D11Buffer* m_drawArgsBuff = nullptr;
 	ID3D11UnorderedAccessView* m_particlePoolUAV = nullptr, * m_deadParticleUAV = nullptr , * m_drawParticleUAV = nullptr, * m_drawArgsUAV = nullptr;
 	ID3D11ShaderResourceView* m_particlePoolSRV = nullptr, * m_drawParticleSRV = nullptr, * m_texture = nullptr;
 	ID3D11DepthStencilState* m_depthState = nullptr;
+
+	//back to front sort of the draw list, sized on the gpu from the draw list counter
+	DirectX::XMFLOAT3 m_viewPos = DirectX::XMFLOAT3(0, 0, 0);
+	ID3D11Buffer* m_sortCountBuff = nullptr, * m_sortArgsBuff = nullptr;
+	ID3D11ShaderResourceView* m_sortCountSRV = nullptr;
+	ID3D11UnorderedAccessView* m_sortArgsUAV = nullptr;
+
+	void SortDrawList();
 	ID3D11BlendState* m_blendState = nullptr;
 
+	//snapshot of a ForceField for ForceField.hlsli, the counts are all zero without one
+	ID3D11ShaderResourceView* m_attractorSRV = nullptr, * m_vortexSRV = nullptr, * m_curlWaveSRV = nullptr, * m_forceGridSRV = nullptr;
+	unsigned int m_attractorCount = 0, m_vortexCount = 0, m_curlWaveCount = 0;
+	bool m_forceGrid = false;
+	DirectX::XMFLOAT3 m_gridOrigin = DirectX::XMFLOAT3(0, 0, 0), m_gridLast = DirectX::XMFLOAT3(0, 0, 0);
+	float m_gridInvCellSize = 0.0f;
+	float m_forceReach = 0.0f;
+
+	void ReleaseForceField();
+
+	//ground for Heightfield.hlsli, collision mode zero without one; the heights view is shared, not owned
+	ID3D11ShaderResourceView* m_groundSRV = nullptr;
+	unsigned int m_collisionMode = ParticleCollision_None;
+	float m_restitution = 0.0f, m_friction = 0.0f;
+	DirectX::XMFLOAT3 m_groundOrigin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT2 m_groundLast = DirectX::XMFLOAT2(0, 0);
+	float m_groundInvCellSize = 0.0f;
+	float m_bounceReach = 0.0f;
+
 public:
 
 	GPUEmitter
@@ -60,9 +108,42 @@ public:
 		SimpleComputeShader* updateArgsBuffer, SimpleVertexShader* vertexShader, SimplePixelShader* pixelShader, ID3D11ShaderResourceView* texture
 	);
 
+	GPUEmitter
+	(
+		const EmitterDesc& desc, ID3D11Device* device, ID3D11DeviceContext* context,
+		SimpleComputeShader* initParticles, SimpleComputeShader* updateParticles, SimpleComputeShader* emitParticles,
+		SimpleComputeShader* updateArgsBuffer, SimpleVertexShader* vertexShader, SimplePixelShader* pixelShader, ID3D11ShaderResourceView* texture
+	);
+
 	~GPUEmitter();
 
+	//sorts the draw list back to front between the update and the draw args and draws alpha over instead of additive
+	void EnableDepthSort(ID3D11Device* device, SimpleComputeShader* sortArgs, SimpleComputeShader* sortLocal, SimpleComputeShader* sortStep, SimpleComputeShader* sortMerge);
+
+	//emits one particle for every detail the full rate would, which also thins the whole pool after a lifetime
+	void SetDetail(unsigned int detail) { m_detail = detail > 0 ? detail : 1; }
+	unsigned int GetMaxParticles() const { return m_maxParticles; }
+
+	//uploads the field for ParticleUpdateCS to add to the particles' velocity, null to remove it
+	//the gpu keeps a copy, so set it again after the field changes
+	void SetForceField(ID3D11Device* device, const ForceField* field);
+
+	//the heights of a Heightfield as a texture for Heightfield.hlsli, which any number of emitters can share; the caller releases it
+	static ID3D11ShaderResourceView* CreateGroundSRV(ID3D11Device* device, const Heightfield& ground);
+
+	//collides the particles with ground in ParticleUpdateCS, groundSRV made from it by CreateGroundSRV
+	//null or ParticleCollision_None to let them through; the view must stay alive while it is set
+	void SetCollision(const Heightfield* ground, ID3D11ShaderResourceView* groundSRV, const ParticleCollision& collision);
+
+	//where the sort distances are measured from
+	void SetViewPosition(const DirectX::XMFLOAT3& viewPos) { m_viewPos = viewPos; }
+
+	//kills every particle and starts emitting somewhere else, reusing every buffer, for pooled effects
+	void Restart(const DirectX::XMFLOAT3& position);
+
 	void Update(float deltaTime, float totalTime);
 
 	void Draw(Camera* camera);
+
+	const ParticleBounds& GetBounds() const { return m_bounds; }
 };
\ No newline at end of file
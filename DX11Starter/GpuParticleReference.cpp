@@ -0,0 +1,331 @@
+#include "GpuParticleReference.h"
+#include "JobSystem.h"
+#include "ParticleRandom.h"
+#include "ForceField.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//[numthreads(32, 1, 1)], and how many groups one job takes
+	const unsigned int c_groupSize = 32;
+	const unsigned int c_groupsPerJob = 64;
+}
+
+GpuParticleReference::GpuParticleReference(const GpuEmitterSettings& settings, JobSystem* jobs)
+	: m_settings(settings), m_jobs(jobs)
+{
+	m_pool.assign(m_settings.maxParticles, GpuParticleRecord{});
+	m_deadList.assign(m_settings.maxParticles, 0);
+	m_drawList.assign(m_settings.maxParticles, GpuDrawRecord{});
+	m_drawArgs = {};
+	m_viewPos[0] = m_viewPos[1] = m_viewPos[2] = 0.0f;
+
+	m_emitTimeCounter = 0.0f;
+	m_spawnIndex = 0;
+
+	DispatchDeadInit();
+}
+
+template <typename Kernel>
+void GpuParticleReference::Dispatch(unsigned int threadCount, const Kernel& kernel)
+{
+	//DispatchByThreads rounds up to whole groups, the kernels bounds check the extra threads themselves
+	unsigned int dispatched = (threadCount + c_groupSize - 1) / c_groupSize * c_groupSize;
+
+	if (!m_jobs)
+	{
+		for (unsigned int id = 0; id < dispatched; id++)
+			kernel(id);
+		return;
+	}
+
+	JobGroup group;
+	m_jobs->ParallelFor(group, dispatched, c_groupSize * c_groupsPerJob, [&kernel](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int id = begin; id < end; id++)
+			kernel(id);
+	});
+	m_jobs->Wait(group);
+}
+
+bool GpuParticleReference::Consume(uint32_t& out)
+{
+	//Consume decrements the hidden counter and reads the element it lands on
+	uint32_t count = m_deadCount.load();
+	do
+	{
+		if (count == 0)
+		{
+			m_consumeUnderflows.fetch_add(1);
+			return false;
+		}
+	} while (!m_deadCount.compare_exchange_weak(count, count - 1));
+
+	out = m_deadList[count - 1];
+	return true;
+}
+
+void GpuParticleReference::Append(uint32_t index)
+{
+	//Append writes at the counter and then increments it
+	m_deadList[m_deadCount.fetch_add(1)] = index;
+}
+
+uint32_t GpuParticleReference::IncrementDrawCounter()
+{
+	//IncrementCounter returns the value before the increment
+	return m_drawCount.fetch_add(1);
+}
+
+void GpuParticleReference::Update(float dt, float totalTime)
+{
+	//same emit count as GPUEmitter::Update, but the time counter belongs to this instance
+	float timePerEmit = 1.0f / m_settings.emitRate;
+	m_emitTimeCounter += dt;
+
+	if (m_emitTimeCounter >= timePerEmit)
+	{
+		int emitCount = (int)(m_emitTimeCounter / timePerEmit);
+		emitCount = (std::min)(emitCount, 65535);
+
+		m_emitTimeCounter = fmod(m_emitTimeCounter, timePerEmit);
+
+		DispatchEmit((unsigned int)emitCount, totalTime);
+	}
+
+	DispatchUpdate(dt, totalTime);
+	if (m_settings.depthSort)
+		DispatchSort();
+	DispatchSetArgs(6);
+}
+
+void GpuParticleReference::SetViewPosition(const float viewPos[3])
+{
+	for (unsigned int axis = 0; axis < 3; axis++)
+		m_viewPos[axis] = viewPos[axis];
+}
+
+void GpuParticleReference::DispatchDeadInit()
+{
+	const unsigned int maxParticles = m_settings.maxParticles;
+	Dispatch(maxParticles, [this, maxParticles](unsigned int id)
+	{
+		if (id >= maxParticles) return;
+
+		Append(id);
+	});
+}
+
+void GpuParticleReference::DispatchEmit(unsigned int emitCount, float totalTime)
+{
+	(void)totalTime;
+	const GpuEmitterSettings& s = m_settings;
+	const uint32_t spawnBase = m_spawnIndex;
+
+	Dispatch(emitCount, [this, &s, emitCount, spawnBase](unsigned int id)
+	{
+		if (id >= emitCount) return;
+
+		uint32_t emitIndex;
+		if (!Consume(emitIndex))
+			return;
+
+		uint32_t spawnIndex = spawnBase + id;
+
+		GpuParticleRecord particle = m_pool[emitIndex];
+
+		particle.age = 0.0f;
+		particle.size = s.startSize;
+		for (unsigned int c = 0; c < 4; c++)
+			particle.color[c] = s.startColor[c];
+		particle.alive = 1.0f;
+
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			particle.velocity[axis] = s.startVel[axis] + (ParticleRandomFloat(s.randomKey, spawnIndex, c_randomVelX + axis) * 2 - 1) * s.velRange[axis];
+			particle.position[axis] = s.emitterPos[axis] + (ParticleRandomFloat(s.randomKey, spawnIndex, c_randomPosX + axis) * 2 - 1) * s.posRange[axis];
+		}
+
+		m_pool[emitIndex] = particle;
+	});
+
+	m_spawnIndex += emitCount;
+}
+
+void GpuParticleReference::DispatchUpdate(float dt, float totalTime)
+{
+	const GpuEmitterSettings& s = m_settings;
+
+	//GPUEmitter binds the draw list with an initial count of 0 for this dispatch
+	m_drawCount = 0;
+
+	Dispatch(s.maxParticles, [this, &s, dt, totalTime](unsigned int id)
+	{
+		if (id >= s.maxParticles) return;
+
+		GpuParticleRecord particle = m_pool[id];
+
+		if (particle.alive == 0.0f) return;
+
+		//the kernel ages the particle twice per step, once before and once after the alive test; mirrored as is
+		particle.age += dt;
+		particle.alive = (float)(particle.age < s.lifeTime);
+		if (m_forceField)
+		{
+			float force[3];
+			m_forceField->Evaluate(&particle.position[0], &particle.position[1], &particle.position[2], 1, totalTime, &force[0], &force[1], &force[2]);
+			for (unsigned int axis = 0; axis < 3; axis++)
+				particle.velocity[axis] += force[axis] * dt;
+		}
+		for (unsigned int axis = 0; axis < 3; axis++)
+			particle.position[axis] += particle.velocity[axis] * dt;
+		if (m_ground && m_collision.mode != ParticleCollision_None)
+			CollideGround(particle);
+
+		particle.age += dt;
+
+		float agePercentage = particle.age / s.lifeTime;
+		for (unsigned int c = 0; c < 4; c++)
+			particle.color[c] = s.startColor[c] + (s.endColor[c] - s.startColor[c]) * agePercentage;
+		particle.size = s.startSize + (s.endSize - s.startSize) * agePercentage;
+
+		m_pool[id] = particle;
+
+		if (particle.alive == 0.0f)
+		{
+			Append(id);
+		}
+		else
+		{
+			uint32_t drawIndex = IncrementDrawCounter();
+
+			GpuDrawRecord drawData;
+			drawData.index = id;
+
+			float toView[3] = { particle.position[0] - m_viewPos[0], particle.position[1] - m_viewPos[1], particle.position[2] - m_viewPos[2] };
+			drawData.distanceSq = toView[0] * toView[0] + toView[1] * toView[1] + toView[2] * toView[2];
+
+			m_drawList[drawIndex] = drawData;
+		}
+	});
+}
+
+void GpuParticleReference::CollideGround(GpuParticleRecord& particle) const
+{
+	float height, normal[3];
+	m_ground->Sample(&particle.position[0], &particle.position[2], 1, &height, &normal[0], &normal[1], &normal[2]);
+	if (particle.position[1] >= height)
+		return;
+
+	if (m_collision.mode == ParticleCollision_Kill)
+	{
+		particle.alive = 0.0f;
+		return;
+	}
+
+	float into = particle.velocity[0] * normal[0] + particle.velocity[1] * normal[1] + particle.velocity[2] * normal[2];
+	if (into < 0.0f)
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float tangent = particle.velocity[axis] - into * normal[axis];
+			particle.velocity[axis] = tangent * (1.0f - m_collision.friction) - into * m_collision.restitution * normal[axis];
+		}
+	}
+	particle.position[1] = height;
+}
+
+void GpuParticleReference::DispatchSort()
+{
+	//the counter the gpu copies out with CopyStructureCount
+	const uint32_t count = m_drawCount.load();
+
+	uint32_t sortLimit = 1;
+	while (sortLimit < count)
+		sortLimit *= 2;
+
+	//every comparison is ascending: the first step of a stage pairs mirrored elements, the rest are half cleaners,
+	//and a pair reaching past the count is skipped, as if that slot held the largest key
+	for (uint32_t sortSize = 2; sortSize <= sortLimit; sortSize *= 2)
+	{
+		for (uint32_t step = sortSize / 2; step > 0; step /= 2)
+		{
+			Dispatch(count, [this, count, sortSize, step](unsigned int p)
+			{
+				uint32_t block = p / step;
+				uint32_t offset = p % step;
+				uint32_t lower = block * step * 2 + offset;
+				uint32_t upper = (step * 2 == sortSize) ? block * sortSize + sortSize - 1 - offset : lower + step;
+
+				if (upper >= count) return;
+
+				//farther particles draw first
+				if (m_drawList[upper].distanceSq > m_drawList[lower].distanceSq)
+					std::swap(m_drawList[lower], m_drawList[upper]);
+			});
+		}
+	}
+}
+
+void GpuParticleReference::DispatchSetArgs(unsigned int vertsPerParticle)
+{
+	//a single thread
+	m_drawArgs.indexCountPerInstance = IncrementDrawCounter() * vertsPerParticle;
+	m_drawArgs.instanceCount = 1;
+	m_drawArgs.startIndexLocation = 0;
+	m_drawArgs.baseVertexLocation = 0;
+	m_drawArgs.startInstanceLocation = 0;
+}
+
+std::string GpuParticleReference::Validate() const
+{
+	const unsigned int maxParticles = m_settings.maxParticles;
+	uint32_t deadCount = m_deadCount.load();
+
+	if (deadCount > maxParticles)
+		return "dead list counter is past the end of the dead list";
+
+	//every slot is either on the dead list or alive, never both and never twice
+	std::vector<unsigned char> seen(maxParticles, 0);
+	for (uint32_t i = 0; i < deadCount; i++)
+	{
+		uint32_t index = m_deadList[i];
+		if (index >= maxParticles)
+			return "dead list holds an index outside the pool";
+		if (seen[index]++)
+			return "dead list holds an index twice";
+		if (m_pool[index].alive != 0.0f)
+			return "dead list holds a live particle";
+	}
+
+	uint32_t alive = 0;
+	for (unsigned int i = 0; i < maxParticles; i++)
+	{
+		if (m_pool[i].alive != 0.0f)
+			alive++;
+	}
+	if (alive + deadCount != maxParticles)
+		return "live and dead particles do not add up to the pool size";
+
+	//after SetArgs the counter sits one past the draw count, because that dispatch increments it too
+	uint32_t drawCount = m_drawArgs.indexCountPerInstance / 6;
+	if (drawCount > maxParticles)
+		return "draw args cover more particles than the pool";
+
+	std::fill(seen.begin(), seen.end(), 0);
+	for (uint32_t i = 0; i < drawCount; i++)
+	{
+		uint32_t index = m_drawList[i].index;
+		if (index >= maxParticles)
+			return "draw list holds an index outside the pool";
+		if (seen[index]++)
+			return "draw list holds an index twice";
+		if (m_pool[index].alive == 0.0f)
+			return "draw list holds a dead particle";
+		if (m_settings.depthSort && i > 0 && m_drawList[i - 1].distanceSq < m_drawList[i].distanceSq)
+			return "draw list is not sorted back to front";
+	}
+
+	return std::string();
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Heightfield.h"
+
+class JobSystem;
+class ForceField;
+
+//cpu reference of the GPUEmitter compute pipeline (ParticleDeadInitCS, ParticleEmitCS, ParticleUpdateCS, ParticleSetArgsBuffCS)
+//same buffers, same append/consume and IncrementCounter semantics, same indirect args, no d3d
+//kernels run as parallel jobs when given a JobSystem, so like on the gpu the dead list and draw list order is not fixed;
+//compare results with Validate and order independent checks, not element by element
+
+//Particle in ParticleIncludes.hlsli
+struct GpuParticleRecord
+{
+	float color[4];
+	float age;
+	float position[3];
+	float size;
+	float velocity[3];
+	float alive;
+	float padding[3];
+};
+static_assert(sizeof(GpuParticleRecord) == 64, "GpuParticleRecord must match Particle in ParticleIncludes.hlsli");
+
+//ParticleDraw in ParticleIncludes.hlsli
+struct GpuDrawRecord
+{
+	uint32_t index;
+	float distanceSq;
+};
+static_assert(sizeof(GpuDrawRecord) == 8, "GpuDrawRecord must match ParticleDraw in ParticleIncludes.hlsli");
+
+//D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS, as written by ParticleSetArgsBuffCS
+struct GpuDrawArgs
+{
+	uint32_t indexCountPerInstance;
+	uint32_t instanceCount;
+	uint32_t startIndexLocation;
+	int32_t baseVertexLocation;
+	uint32_t startInstanceLocation;
+};
+static_assert(sizeof(GpuDrawArgs) == 20, "GpuDrawArgs must match the indirect args buffer");
+
+//what GPUEmitter feeds the kernels through their cbuffers
+struct GpuEmitterSettings
+{
+	unsigned int maxParticles;
+	unsigned int emitRate;
+	float lifeTime;
+	float startSize, endSize;
+	float emitterPos[3];
+	float startVel[3];
+	float posRange[3];
+	float velRange[3];
+	float startColor[4], endColor[4];
+	uint32_t randomKey;
+
+	//GPUEmitter::EnableDepthSort
+	bool depthSort;
+};
+
+class GpuParticleReference
+{
+public:
+	//jobs may be null to run every kernel on the calling thread
+	GpuParticleReference(const GpuEmitterSettings& settings, JobSystem* jobs = nullptr);
+
+	GpuParticleReference(const GpuParticleReference&) = delete;
+	GpuParticleReference& operator=(const GpuParticleReference&) = delete;
+
+	//one GPUEmitter::Update: emit what the elapsed time allows, update every particle, sort if enabled, write the draw args
+	void Update(float dt, float totalTime);
+
+	void SetViewPosition(const float viewPos[3]);
+
+	//the field ParticleUpdateCS reads through ForceField.hlsli, null for none; not owned
+	void SetForceField(const ForceField* field) { m_forceField = field; }
+
+	//the ground ParticleUpdateCS collides with through Heightfield.hlsli, null for none; not owned
+	void SetCollision(const Heightfield* ground, const ParticleCollision& collision) { m_ground = ground; m_collision = collision; }
+
+	//the kernels on their own, with the thread counts GPUEmitter dispatches
+	void DispatchDeadInit();
+	void DispatchEmit(unsigned int emitCount, float totalTime);
+	void DispatchUpdate(float dt, float totalTime);
+	void DispatchSetArgs(unsigned int vertsPerParticle);
+
+	//the compare exchanges of the ParticleSort*CS passes, in the same order; the result is fully determined by the input
+	void DispatchSort();
+
+	const std::vector<GpuParticleRecord>& GetPool() const { return m_pool; }
+	const std::vector<uint32_t>& GetDeadList() const { return m_deadList; }
+	uint32_t GetDeadCount() const { return m_deadCount.load(); }
+	const std::vector<GpuDrawRecord>& GetDrawList() const { return m_drawList; }
+	uint32_t GetDrawCount() const { return m_drawCount.load(); }
+	const GpuDrawArgs& GetDrawArgs() const { return m_drawArgs; }
+
+	//consumes attempted on an empty dead list, undefined on the gpu and skipped here
+	uint32_t GetConsumeUnderflows() const { return m_consumeUnderflows.load(); }
+
+	//checks the invariants the kernels rely on, returns an empty string when they hold
+	std::string Validate() const;
+
+private:
+	GpuEmitterSettings m_settings;
+	JobSystem* m_jobs;
+
+	std::vector<GpuParticleRecord> m_pool;
+	std::vector<uint32_t> m_deadList;
+	std::vector<GpuDrawRecord> m_drawList;
+	GpuDrawArgs m_drawArgs;
+	float m_viewPos[3];
+	const ForceField* m_forceField = nullptr;
+	const Heightfield* m_ground = nullptr;
+	ParticleCollision m_collision = { ParticleCollision_None, 0.0f, 0.0f };
+
+	//hidden uav counters of the append/consume dead list and the counter draw list
+	std::atomic<uint32_t> m_deadCount{ 0 };
+	std::atomic<uint32_t> m_drawCount{ 0 };
+	std::atomic<uint32_t> m_consumeUnderflows{ 0 };
+
+	//GPUEmitter keeps these on the cpu
+	float m_emitTimeCounter;
+	uint32_t m_spawnIndex;
+
+	template <typename Kernel>
+	void Dispatch(unsigned int threadCount, const Kernel& kernel);
+
+	bool Consume(uint32_t& out);
+	void Append(uint32_t index);
+	uint32_t IncrementDrawCounter();
+
+	//CollideGround in Heightfield.hlsli, clearing alive on a kill
+	void CollideGround(GpuParticleRecord& particle) const;
+};
@@ -0,0 +1,256 @@
+#include "Heightfield.h"
+#include "SimdLanes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	inline __m128 Lerp(__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)); }
+
+	//the four corners and the position inside the cell under four points
+	struct CellBlock
+	{
+		__m128 h00, h01, h10, h11;
+		__m128 fx, fz;
+
+		//zero on an axis where the point is off the grid, so the border extends flat
+		__m128 insideX, insideZ;
+	};
+
+	//what the cell lookups need from a Heightfield, read once per call
+	struct GridView
+	{
+		const float* heights;
+		unsigned int rowPitch;
+		float origin[3];
+		float invCellSize;
+		float lastX, lastZ;
+
+		explicit GridView(const Heightfield& ground)
+		{
+			heights = ground.GetPaddedHeights().data();
+			rowPitch = ground.GetCountZ() + 1;
+			for (unsigned int axis = 0; axis < 3; axis++)
+				origin[axis] = ground.GetOrigin()[axis];
+			invCellSize = 1.0f / ground.GetCellSize();
+			lastX = (float)(ground.GetCountX() - 1);
+			lastZ = (float)(ground.GetCountZ() - 1);
+		}
+	};
+
+	inline void LoadCells(const GridView& grid, __m128 x, __m128 z, CellBlock& out)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 lastX = _mm_set1_ps(grid.lastX);
+		const __m128 lastZ = _mm_set1_ps(grid.lastZ);
+
+		//max before min, so a NaN position (a killed particle) clamps to corner zero instead of indexing anywhere
+		__m128 cellX = _mm_mul_ps(_mm_sub_ps(x, _mm_set1_ps(grid.origin[0])), _mm_set1_ps(grid.invCellSize));
+		__m128 cellZ = _mm_mul_ps(_mm_sub_ps(z, _mm_set1_ps(grid.origin[2])), _mm_set1_ps(grid.invCellSize));
+		out.insideX = _mm_and_ps(_mm_cmpge_ps(cellX, zero), _mm_cmple_ps(cellX, lastX));
+		out.insideZ = _mm_and_ps(_mm_cmpge_ps(cellZ, zero), _mm_cmple_ps(cellZ, lastZ));
+		cellX = _mm_min_ps(_mm_max_ps(cellX, zero), lastX);
+		cellZ = _mm_min_ps(_mm_max_ps(cellZ, zero), lastZ);
+
+		//the cells are never negative, so truncating is flooring; the padding row and column cover the border cell
+		__m128 wholeX = _mm_cvtepi32_ps(_mm_cvttps_epi32(cellX));
+		__m128 wholeZ = _mm_cvtepi32_ps(_mm_cvttps_epi32(cellZ));
+		out.fx = _mm_sub_ps(cellX, wholeX);
+		out.fz = _mm_sub_ps(cellZ, wholeZ);
+
+		alignas(16) int index[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(wholeX, _mm_set1_ps((float)grid.rowPitch)), wholeZ)));
+
+		//two adjacent heights per row and lane, then transposed into one vector per corner
+		__m128 row0[4], row1[4];
+		for (unsigned int k = 0; k < 4; k++)
+		{
+			row0[k] = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(grid.heights + index[k]));
+			row1[k] = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(grid.heights + index[k] + grid.rowPitch));
+		}
+		__m128 low0 = _mm_movelh_ps(row0[0], row0[1]), high0 = _mm_movelh_ps(row0[2], row0[3]);
+		__m128 low1 = _mm_movelh_ps(row1[0], row1[1]), high1 = _mm_movelh_ps(row1[2], row1[3]);
+		out.h00 = _mm_shuffle_ps(low0, high0, _MM_SHUFFLE(2, 0, 2, 0));
+		out.h01 = _mm_shuffle_ps(low0, high0, _MM_SHUFFLE(3, 1, 3, 1));
+		out.h10 = _mm_shuffle_ps(low1, high1, _MM_SHUFFLE(2, 0, 2, 0));
+		out.h11 = _mm_shuffle_ps(low1, high1, _MM_SHUFFLE(3, 1, 3, 1));
+	}
+
+	inline __m128 CellHeight(const GridView& grid, const CellBlock& cell)
+	{
+		return _mm_add_ps(_mm_set1_ps(grid.origin[1]), Lerp(Lerp(cell.h00, cell.h01, cell.fz), Lerp(cell.h10, cell.h11, cell.fz), cell.fx));
+	}
+
+	//normal of the bilinear patch: (-dh/dx, 1, -dh/dz) normalized
+	inline void CellNormal(const GridView& grid, const CellBlock& cell, __m128& nx, __m128& ny, __m128& nz)
+	{
+		__m128 invCellSize = _mm_set1_ps(grid.invCellSize);
+		__m128 slopeX = _mm_mul_ps(Lerp(_mm_sub_ps(cell.h10, cell.h00), _mm_sub_ps(cell.h11, cell.h01), cell.fz), invCellSize);
+		__m128 slopeZ = _mm_mul_ps(Lerp(_mm_sub_ps(cell.h01, cell.h00), _mm_sub_ps(cell.h11, cell.h10), cell.fx), invCellSize);
+		slopeX = _mm_and_ps(slopeX, cell.insideX);
+		slopeZ = _mm_and_ps(slopeZ, cell.insideZ);
+
+		//the estimate and one newton step, plenty for a normal
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeZ, slopeZ)), _mm_set1_ps(1.0f));
+		__m128 estimate = _mm_rsqrt_ps(lengthSq);
+		__m128 inverseLength = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), estimate), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(estimate, estimate), lengthSq)));
+		nx = _mm_mul_ps(_mm_xor_ps(slopeX, _mm_set1_ps(-0.0f)), inverseLength);
+		ny = inverseLength;
+		nz = _mm_mul_ps(_mm_xor_ps(slopeZ, _mm_set1_ps(-0.0f)), inverseLength);
+	}
+}
+
+Heightfield::Heightfield(const float* heights, unsigned int stride, unsigned int countX, unsigned int countZ, const float origin[3], float cellSize)
+{
+	m_countX = std::max(countX, 1u);
+	m_countZ = std::max(countZ, 1u);
+	for (unsigned int axis = 0; axis < 3; axis++)
+		m_origin[axis] = origin[axis];
+	m_cellSize = cellSize;
+
+	unsigned int rowPitch = m_countZ + 1;
+	m_heights.assign((size_t)(m_countX + 1) * rowPitch, 0.0f);
+	if (countX == 0 || countZ == 0)
+		return;
+
+	for (unsigned int i = 0; i <= m_countX; i++)
+	{
+		unsigned int row = std::min(i, m_countX - 1);
+		for (unsigned int j = 0; j <= m_countZ; j++)
+		{
+			unsigned int column = std::min(j, m_countZ - 1);
+			const char* corner = reinterpret_cast<const char*>(heights) + ((size_t)row * m_countZ + column) * stride;
+			m_heights[(size_t)i * rowPitch + j] = *reinterpret_cast<const float*>(corner);
+		}
+	}
+}
+
+float Heightfield::GetHeight(float x, float z) const
+{
+	float height;
+	SampleHeights(&x, &z, 1, &height);
+	return height;
+}
+
+void Heightfield::SampleHeights(const float* x, const float* z, unsigned int count, float* outHeight) const
+{
+	GridView grid(*this);
+	alignas(16) float height[4];
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		unsigned int lanes = std::min(count - i, 4u);
+
+		CellBlock cell;
+		LoadCells(grid, LoadLanes(x + i, lanes), LoadLanes(z + i, lanes), cell);
+		_mm_store_ps(height, CellHeight(grid, cell));
+		std::copy(height, height + lanes, outHeight + i);
+	}
+}
+
+void Heightfield::Sample(const float* x, const float* z, unsigned int count, float* outHeight, float* outNormalX, float* outNormalY, float* outNormalZ) const
+{
+	GridView grid(*this);
+	alignas(16) float results[4][4];
+	float* outputs[4] = { outHeight, outNormalX, outNormalY, outNormalZ };
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		unsigned int lanes = std::min(count - i, 4u);
+
+		CellBlock cell;
+		LoadCells(grid, LoadLanes(x + i, lanes), LoadLanes(z + i, lanes), cell);
+
+		__m128 nx, ny, nz;
+		CellNormal(grid, cell, nx, ny, nz);
+		_mm_store_ps(results[0], CellHeight(grid, cell));
+		_mm_store_ps(results[1], nx);
+		_mm_store_ps(results[2], ny);
+		_mm_store_ps(results[3], nz);
+		for (unsigned int output = 0; output < 4; output++)
+			std::copy(results[output], results[output] + lanes, outputs[output] + i);
+	}
+}
+
+void CollideParticles(const Heightfield& ground, const ParticleCollision& collision, ParticleStreams& s, unsigned int begin, unsigned int end, float time, const float acc[3])
+{
+	if (collision.mode == ParticleCollision_None)
+		return;
+
+	float* position[3] = { s.posX, s.posY, s.posZ };
+	float* velocity[3] = { s.velX, s.velY, s.velZ };
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 halfAcc[3] = { _mm_set1_ps(0.5f * acc[0]), _mm_set1_ps(0.5f * acc[1]), _mm_set1_ps(0.5f * acc[2]) };
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	GridView grid(ground);
+
+	const __m128 keep = _mm_set1_ps(1.0f - collision.friction);
+	const __m128 restitution = _mm_set1_ps(collision.restitution);
+	const __m128 accel[3] = { _mm_set1_ps(acc[0]), _mm_set1_ps(acc[1]), _mm_set1_ps(acc[2]) };
+	auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+
+	for (unsigned int first = begin; first < end; first += 4)
+	{
+		unsigned int lanes = std::min(end - first, 4u);
+
+		//where the closed form has the particles now, and the ground under them
+		__m128 particleAge = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(time), LoadLanes(s.spawnTime + first, lanes)), zero);
+		__m128 p[3], v0[3], p0[3];
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			v0[axis] = LoadLanes(velocity[axis] + first, lanes);
+			p0[axis] = LoadLanes(position[axis] + first, lanes);
+			p[axis] = _mm_add_ps(p0[axis], _mm_mul_ps(_mm_add_ps(v0[axis], _mm_mul_ps(halfAcc[axis], particleAge)), particleAge));
+		}
+
+		CellBlock cell;
+		LoadCells(grid, p[0], p[2], cell);
+		__m128 groundHeight = CellHeight(grid, cell);
+
+		//almost every block is in the air, and NaN (killed) lanes never compare below
+		__m128 below = _mm_cmplt_ps(p[1], groundHeight);
+		if (!(_mm_movemask_ps(below) & ((1 << lanes) - 1)))
+			continue;
+
+		if (collision.mode == ParticleCollision_Kill)
+		{
+			StoreLanes(s.posX + first, select(below, _mm_set1_ps(nan), p0[0]), lanes);
+			continue;
+		}
+
+		__m128 n[3];
+		CellNormal(grid, cell, n[0], n[1], n[2]);
+
+		//velocity now, split along the normal: the part into the ground comes back scaled, the rest loses friction
+		__m128 v[3];
+		for (unsigned int axis = 0; axis < 3; axis++)
+			v[axis] = _mm_add_ps(v0[axis], _mm_mul_ps(accel[axis], particleAge));
+		__m128 into = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0], n[0]), _mm_mul_ps(v[1], n[1])), _mm_mul_ps(v[2], n[2]));
+		__m128 reflect = _mm_and_ps(below, _mm_cmplt_ps(into, zero));
+		__m128 out = _mm_mul_ps(into, restitution);
+
+		//lifted onto the surface, then back into closed form with this position and velocity at time
+		p[1] = groundHeight;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			__m128 tangent = _mm_sub_ps(v[axis], _mm_mul_ps(into, n[axis]));
+			__m128 bounced = _mm_sub_ps(_mm_mul_ps(tangent, keep), _mm_mul_ps(out, n[axis]));
+			__m128 startVelocity = _mm_sub_ps(select(reflect, bounced, v[axis]), _mm_mul_ps(accel[axis], particleAge));
+			__m128 startPosition = _mm_sub_ps(p[axis], _mm_mul_ps(_mm_add_ps(startVelocity, _mm_mul_ps(halfAcc[axis], particleAge)), particleAge));
+			StoreLanes(velocity[axis] + first, select(below, startVelocity, v0[axis]), lanes);
+			StoreLanes(position[axis] + first, select(below, startPosition, p0[axis]), lanes);
+		}
+	}
+}
+
+float GetBounceReach(const float startVel[3], const float velRange[3], const float acc[3], float lifeTime)
+{
+	float speed = 0.0f, accel = 0.0f;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		float fastest = std::fabs(startVel[axis]) + std::fabs(velRange[axis]);
+		speed += fastest * fastest;
+		accel += acc[axis] * acc[axis];
+	}
+	return std::sqrt(speed) * lifeTime + 0.5f * std::sqrt(accel) * lifeTime * lifeTime;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ParticleStreams.h"
+
+//ground heights on a regular grid in the xz plane, for particles to collide with the terrain
+//corner (i, j) is at x = origin[0] + i * cellSize, z = origin[2] + j * cellSize and y = origin[1] + height
+//between corners the surface is bilinear, outside the grid the border extends forever
+class Heightfield
+{
+public:
+	//countX * countZ heights, corner (i, j) at heights + (i * countZ + j) * stride bytes, so terrain vertices can be read in place
+	Heightfield(const float* heights, unsigned int stride, unsigned int countX, unsigned int countZ, const float origin[3], float cellSize);
+
+	float GetHeight(float x, float z) const;
+
+	//world space heights under count points, four at a time
+	void SampleHeights(const float* x, const float* z, unsigned int count, float* outHeight) const;
+
+	//heights and unit normals of the bilinear surface under count points
+	void Sample(const float* x, const float* z, unsigned int count, float* outHeight, float* outNormalX, float* outNormalY, float* outNormalZ) const;
+
+	//what the gpu side uploads: (countX + 1) rows of (countZ + 1) heights, the last row and column repeating the border,
+	//relative to origin[1]
+	const std::vector<float>& GetPaddedHeights() const { return m_heights; }
+	unsigned int GetCountX() const { return m_countX; }
+	unsigned int GetCountZ() const { return m_countZ; }
+	const float* GetOrigin() const { return m_origin; }
+	float GetCellSize() const { return m_cellSize; }
+
+private:
+	//padded by one row and column so the four corners of any clamped cell are in bounds without a branch
+	std::vector<float> m_heights;
+	unsigned int m_countX, m_countZ;
+	float m_origin[3];
+	float m_cellSize;
+};
+
+//what a particle does when it reaches the ground
+enum ParticleCollisionMode : uint32_t
+{
+	ParticleCollision_None,
+	ParticleCollision_Bounce,
+	ParticleCollision_Kill
+};
+
+struct ParticleCollision
+{
+	ParticleCollisionMode mode;
+
+	//bounce: the share of the speed into the ground that comes back out, and of the speed along it that is lost, both in [0, 1]
+	float restitution;
+	float friction;
+};
+
+//collides the particles in slots [begin, end) with the ground where the closed form has them at time
+//a bouncing particle is lifted onto the surface and its velocity reflected, kept in closed form like ApplyForceField does:
+//the new start velocity and position put it there with that velocity at time
+//a killed particle gets a NaN start position, which every expansion carries into its corners and the rasterizer drops
+//acc is the emitter's constant acceleration
+void CollideParticles(const Heightfield& ground, const ParticleCollision& collision, ParticleStreams& streams, unsigned int begin, unsigned int end, float time, const float acc[3]);
+
+//furthest a bouncing particle can get from its spawn box in any direction: bounces only turn the velocity, never speed it up
+float GetBounceReach(const float startVel[3], const float velRange[3], const float acc[3], float lifeTime);
@@ -0,0 +1,70 @@
+#ifndef __HEIGHTFIELD
+#define __HEIGHTFIELD
+
+//port of Heightfield.cpp: bilinear ground heights on a grid in the xz plane, and what a particle does when it gets under them
+//with collision off it costs one uniform branch
+
+cbuffer HeightfieldData : register(b2)
+{
+	//0 none, 1 bounce, 2 kill, as ParticleCollisionMode
+	uint collisionMode;
+	float restitution;
+	float friction;
+	float groundInvCellSize;
+
+	float3 groundOrigin;
+
+	//count - 1 per axis, the last corner
+	float2 groundLast;
+}
+
+//Heightfield::GetPaddedHeights, one row per x corner, so Load(int3(j, i, 0)) is corner (i, j)
+Texture2D<float> GroundHeights : register(t4);
+
+//bilinear by hand like the cpu, the border extends flat outside the grid
+void SampleGround(float3 position, out float height, out float3 normal)
+{
+	float2 unclamped = (position.xz - groundOrigin.xz) * groundInvCellSize;
+	float2 cell = clamp(unclamped, 0.0f, groundLast);
+	float2 inside = (float2)(unclamped == cell);
+	int2 base = (int2)cell;
+	float2 t = cell - (float2)base;
+
+	//the padding row and column cover the border cell
+	float h00 = GroundHeights.Load(int3(base.y, base.x, 0));
+	float h01 = GroundHeights.Load(int3(base.y + 1, base.x, 0));
+	float h10 = GroundHeights.Load(int3(base.y, base.x + 1, 0));
+	float h11 = GroundHeights.Load(int3(base.y + 1, base.x + 1, 0));
+
+	height = groundOrigin.y + lerp(lerp(h00, h01, t.y), lerp(h10, h11, t.y), t.x);
+
+	float2 slope = float2(lerp(h10 - h00, h11 - h01, t.y), lerp(h01 - h00, h11 - h10, t.x)) * groundInvCellSize * inside;
+	normal = normalize(float3(-slope.x, 1.0f, -slope.y));
+}
+
+//true when the particle should die; a bounce lifts it onto the ground and reflects its velocity
+bool CollideGround(inout float3 position, inout float3 velocity)
+{
+	if (collisionMode == 0)
+		return false;
+
+	float height;
+	float3 normal;
+	SampleGround(position, height, normal);
+	if (position.y >= height)
+		return false;
+
+	if (collisionMode == 2)
+		return true;
+
+	float into = dot(velocity, normal);
+	if (into < 0.0f)
+	{
+		float3 tangent = velocity - into * normal;
+		velocity = tangent * (1.0f - friction) - into * restitution * normal;
+	}
+	position.y = height;
+	return false;
+}
+
+#endif
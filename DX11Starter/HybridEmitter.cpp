@@ -1,4 +1,5 @@
 #include"HybridEmitter.h"
+#include "JobSystem.h"
 #include <iostream>
 HybridEmitter::HybridEmitter
 (
@@ -25,10 +26,19 @@ HybridEmitter::HybridEmitter
 	m_endSize = endSize;
 
 	m_timePerEmission = 1.0f / m_emitRate;
+
+	m_surface = nullptr;
+	UpdateBounds();
 	m_aliveHead = 0; 
 	m_deadHead = 0; 
 	m_liveParticles = 0;
-	m_timeSinceEmit = 0;
+
+	m_randomKey = NextParticleRandomKey();
+
+	m_schedule.burstCount = 0;
+	m_schedule.interval = m_timePerEmission;
+	m_time = 0;
+	m_nextSpawn = 0;
 
 	m_vs = vs;
 	m_ps = ps;
@@ -38,27 +48,8 @@ HybridEmitter::HybridEmitter
 	m_particleArr = new HybridParticle[m_maxParticles];
 	ZeroMemory(m_particleArr, sizeof(HybridParticle) * m_maxParticles);
 
-	unsigned int* m_indexArr = new unsigned int[6 * m_maxParticles];
-	unsigned int index = 0;
-	for (unsigned int i = 0; i < 4 * m_maxParticles; i += 4)
-	{
-		m_indexArr[index++] = i;
-		m_indexArr[index++] = i + 1;
-		m_indexArr[index++] = i + 2;
-		m_indexArr[index++] = i;
-		m_indexArr[index++] = i + 2;
-		m_indexArr[index++] = i + 3;
-	}
-
-	D3D11_SUBRESOURCE_DATA indexData = {};
-	indexData.pSysMem = m_indexArr;
-
-	D3D11_BUFFER_DESC indexDesc = {};
-	indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexDesc.CPUAccessFlags = 0;
-	indexDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexDesc.ByteWidth = sizeof(unsigned int) * 6 * m_maxParticles;
-	device->CreateBuffer(&indexDesc, &indexData, &m_Ibuff);
+	QuadIndexBuffer::Acquire(device, m_maxParticles);
+	AlphaBlendState::Acquire(device);
 
 	D3D11_BUFFER_DESC particleBuffDesc = {};
 	particleBuffDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
@@ -66,83 +57,184 @@ HybridEmitter::HybridEmitter
 	particleBuffDesc.Usage = D3D11_USAGE_DYNAMIC;
 	particleBuffDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 	particleBuffDesc.StructureByteStride = sizeof(HybridParticle);
-	particleBuffDesc.ByteWidth = sizeof(HybridParticle) * m_maxParticles;
+	particleBuffDesc.ByteWidth = sizeof(HybridParticle) * m_maxParticles * c_uploadRingFrames;
 	device->CreateBuffer(&particleBuffDesc, 0, &m_particleBuff);
 
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 	srvDesc.Buffer.FirstElement = 0;
-	srvDesc.Buffer.NumElements = maxParticles;
+	srvDesc.Buffer.NumElements = maxParticles * c_uploadRingFrames;
 	device->CreateShaderResourceView(m_particleBuff, &srvDesc, &m_particleBuffSRV);
-	
-	delete[]m_indexArr;
+
+	//spawned particles never change, so only new ones are appended to the ring each frame
+	//appending into a buffer the vertex shader reads as an SRV needs the 11.1 NO_OVERWRITE support
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	m_appendUploads = options.MapNoOverwriteOnDynamicBufferSRV != 0;
+
+	m_upload.Reset(m_maxParticles * c_uploadRingFrames);
+	m_gpuHead = 0;
+	m_gpuTail = 0;
+	m_fullUpload = false;
+
+	D3D11_BUFFER_DESC orderDesc = particleBuffDesc;
+	orderDesc.StructureByteStride = sizeof(unsigned int);
+	orderDesc.ByteWidth = sizeof(unsigned int) * m_maxParticles;
+	device->CreateBuffer(&orderDesc, 0, &m_orderBuff);
+
+	srvDesc.Buffer.NumElements = m_maxParticles;
+	device->CreateShaderResourceView(m_orderBuff, &srvDesc, &m_orderSRV);
+
+	m_detail = 1;
+	m_depthSort = false;
+	m_sortJobs = nullptr;
+}
+
+HybridEmitter::HybridEmitter(const EmitterDesc& desc, ID3D11Device* device, SimpleVertexShader* vs, SimplePixelShader* ps, ID3D11ShaderResourceView* srv)
+	: HybridEmitter
+	(
+		XMFLOAT3(desc.velocity), XMFLOAT4(desc.startColor), XMFLOAT4(desc.endColor),
+		XMFLOAT4(desc.rotationRange), XMFLOAT3(desc.velocityRange), XMFLOAT3(desc.positionRange),
+		XMFLOAT3(desc.position), XMFLOAT3(desc.acceleration),
+		desc.maxParticles, desc.emitRate, desc.lifeTime, desc.startSize, desc.endSize,
+		device, vs, ps, srv
+	)
+{
 }
 
 HybridEmitter::~HybridEmitter()
 {
 	delete[] m_particleArr;
-	m_Ibuff->Release();
+	QuadIndexBuffer::Release();
+	AlphaBlendState::Release();
 	m_particleBuff->Release();
 	m_particleBuffSRV->Release();
+	m_orderBuff->Release();
+	m_orderSRV->Release();
 }
 
-void HybridEmitter::UpdateEmitter(float delta, float totalTime)
+void HybridEmitter::SetDepthSort(bool enabled, JobSystem* jobs)
 {
-	if (m_liveParticles > 0) 
-	{
-		if (m_aliveHead < m_deadHead)
-		{
-			for (unsigned int i = m_aliveHead; i < m_deadHead; i++)
-				UpdateParticle(i, totalTime);
-		}
-		else if (m_deadHead<m_aliveHead)
-		{
-		
-			for (unsigned int i = 0; i < m_deadHead; i++) 
-				UpdateParticle(i, totalTime);
+	m_depthSort = enabled;
+	m_sortJobs = jobs;
+}
 
-			for (unsigned int i = m_aliveHead; i < m_maxParticles; i++) 
-				UpdateParticle(i, totalTime);
-		}
-		else 
+void HybridEmitter::SetSurface(const MeshSampler* surface)
+{
+	m_surface = surface;
+	UpdateBounds();
+
+	//same spawn indices and times, new start positions, and the gpu copy no longer matches
+	SpawnParticles(m_nextSpawn - m_liveParticles, m_nextSpawn);
+	InvalidateUpload();
+}
+
+void HybridEmitter::UpdateBounds()
+{
+	//everything the particles can reach over their life, for culling
+	ParticleMotion motion =
+	{
+		{ m_emitterPos.x, m_emitterPos.y, m_emitterPos.z }, { m_posRange.x, m_posRange.y, m_posRange.z },
+		{ m_startVel.x, m_startVel.y, m_startVel.z }, { m_velRange.x, m_velRange.y, m_velRange.z },
+		{ m_emitterAcc.x, m_emitterAcc.y, m_emitterAcc.z },
+		m_lifeTime, max(m_startSize, m_endSize)
+	};
+
+	//on a surface the start positions are the mesh's box at the emitter
+	if (m_surface)
+	{
+		const ParticleBounds& mesh = m_surface->GetBounds();
+		for (unsigned int axis = 0; axis < 3; axis++)
 		{
-			for (unsigned int i = 0; i < m_maxParticles; i++) 
-				UpdateParticle(i, totalTime);
+			motion.origin[axis] += 0.5f * (mesh.min[axis] + mesh.max[axis]);
+			motion.posRange[axis] = 0.5f * (mesh.max[axis] - mesh.min[axis]);
 		}
 	}
-	
-	m_timeSinceEmit += delta;
+	m_bounds = ComputeParticleBounds(motion);
+}
+
+void HybridEmitter::UpdateEmitter(float delta)
+{
+	m_time += delta;
+
+	unsigned int liveBefore = m_liveParticles;
+	unsigned int expired = CountExpiredParticles(reinterpret_cast<const HybridParticleRecord*>(m_particleArr), m_maxParticles, m_aliveHead, m_liveParticles, m_time, m_lifeTime);
+	m_liveParticles -= expired;
+
+	//when the pool is full the oldest particles make room, same as the live set Seek rebuilds
+	unsigned int last = m_schedule.SpawnedBy(m_time);
+	unsigned int first = max(m_nextSpawn, last - min(last, m_maxParticles));
+	unsigned int overflow = m_liveParticles + (last - first);
+	overflow = overflow > m_maxParticles ? overflow - m_maxParticles : 0;
+	m_liveParticles -= overflow;
+
+	//the oldest particles retire first, and those are the ones at the gpu head
+	m_gpuHead = min(m_gpuHead + (liveBefore - m_liveParticles), m_gpuTail);
+
+	SpawnParticles(first, last);
+	m_liveParticles += last - first;
+	m_nextSpawn = last;
+	m_aliveHead = (last - m_liveParticles) % m_maxParticles;
+	m_deadHead = last % m_maxParticles;
+}
 
-	while (m_timeSinceEmit > m_timePerEmission) 
+void HybridEmitter::Restart(const DirectX::XMFLOAT3& position)
+{
+	//the bounds only depend on the position through the origin
+	float offset[3] = { position.x - m_emitterPos.x, position.y - m_emitterPos.y, position.z - m_emitterPos.z };
+	for (unsigned int axis = 0; axis < 3; axis++)
 	{
-		SpawnParticle(totalTime);
-		m_timeSinceEmit -= m_timePerEmission;
+		m_bounds.min[axis] += offset[axis];
+		m_bounds.max[axis] += offset[axis];
 	}
+	m_emitterPos = position;
+	m_randomKey = NextParticleRandomKey();
+
+	//empty pool at time zero, like a new emitter
+	m_time = 0;
+	m_nextSpawn = 0;
+	m_liveParticles = 0;
+	m_aliveHead = 0;
+	m_deadHead = 0;
+	InvalidateUpload();
 }
 
-void HybridEmitter::UpdateParticle(unsigned int index, float totalTime)
+void HybridEmitter::Seek(double time)
 {
-	float age = totalTime - m_particleArr[index].spawnTime;
-	if (age >= m_lifeTime) 
+	if (time >= m_time)
 	{
-		++m_aliveHead %= m_maxParticles;
-		m_liveParticles--;
+		UpdateEmitter((float)(time - m_time));
+		return;
 	}
+
+	//rewinding rebuilds the live set in closed form, reusing the spawn indices that are still resident
+	ParticleLiveRange live = LiveRangeAt(m_schedule, time, m_lifeTime, m_maxParticles);
+	unsigned int first = live.first, last = live.last;
+
+	unsigned int firstResident = m_nextSpawn - m_liveParticles;
+	SpawnParticles(first, min(last, firstResident));
+	SpawnParticles(max(first, m_nextSpawn), last);
+
+	m_time = time;
+	m_nextSpawn = last;
+	m_liveParticles = last - first;
+	m_aliveHead = first % m_maxParticles;
+	m_deadHead = last % m_maxParticles;
+
+	//the gpu copy no longer matches, upload every live particle again
+	InvalidateUpload();
 }
 
-void HybridEmitter::DrawEmitter(ID3D11DeviceContext* context, Camera* camera, float totalTime)
+void HybridEmitter::DrawEmitter(ID3D11DeviceContext* context, Camera* camera)
 {
-	D3D11_MAPPED_SUBRESOURCE mapped = {};
-	context->Map(m_particleBuff, 0, D3D11_MAP_WRITE_DISCARD, 0 , &mapped);
-	memcpy(mapped.pData, m_particleArr, sizeof(HybridParticle) * m_maxParticles);
-	context->Unmap(m_particleBuff, 0);
+	UploadParticles(context);
 
 	UINT stride = 0;
 	UINT offset = 0;
 	ID3D11Buffer* nullbuffer = 0;
 	context->IASetVertexBuffers(0, 1, &nullbuffer, &stride, &offset);
-	context->IASetIndexBuffer(m_Ibuff, DXGI_FORMAT_R32_UINT, 0);
+	QuadIndexBuffer::Bind(context, m_maxParticles);
 
 	m_vs->SetMatrix4x4("view", camera->GetView());
 	m_vs->SetMatrix4x4("projection", camera->GetProjection());
@@ -153,59 +245,165 @@ void HybridEmitter::DrawEmitter(ID3D11DeviceContext* context, Camera* camera, fl
 	m_vs->SetFloat("startSize", m_startSize);
 	m_vs->SetFloat("endSize", m_endSize);
 	m_vs->SetFloat("lifeTime", m_lifeTime);
-	m_vs->SetFloat("totalTime", totalTime);
+	m_vs->SetFloat("totalTime", (float)m_time);
 
 	m_vs->SetShader();
 
 	context->VSSetShaderResources(0, 1, &m_particleBuffSRV);
+
+	bool useDrawOrder = (m_depthSort || m_detail > 1) && m_liveParticles > 0;
+	unsigned int drawCount = useDrawOrder ? BuildDrawOrder(context, camera) : m_liveParticles;
+	m_vs->SetInt("useDrawOrder", useDrawOrder);
+	context->VSSetShaderResources(1, 1, &m_orderSRV);
+
 	m_ps->SetShaderResourceView("particleTex", m_texture);
 	m_ps->SetShader();
 
 	//std::cout << "live : " << m_liveParticles << " m_oldestAlive : " << m_aliveHead << " oldestDead : " << m_deadHead << "\n";
 
-	if (m_aliveHead < m_deadHead)
+	//the gpu copy is contiguous, so the ring wrap never splits the draw
+	m_vs->SetInt("startIndex", m_gpuHead);
+	m_vs->CopyAllBufferData();
+
+	//sorted only matters under alpha over, the scene's blend is put back for the emitters after this one
+	ID3D11BlendState* sceneBlend = m_depthSort ? AlphaBlendState::Bind(context) : nullptr;
+	context->DrawIndexed(drawCount * 6, 0, 0);
+	if (m_depthSort)
+		AlphaBlendState::Restore(context, sceneBlend);
+}
+
+void HybridEmitter::InvalidateUpload()
+{
+	//nothing on the gpu counts as uploaded until the repack, so pending is every live particle and never underflows
+	m_gpuHead = 0;
+	m_gpuTail = 0;
+	m_fullUpload = true;
+}
+
+void HybridEmitter::UploadParticles(ID3D11DeviceContext* context)
+{
+	unsigned int uploaded = m_gpuTail - m_gpuHead;
+	unsigned int pending = m_liveParticles - uploaded;
+	if (pending == 0)
+		return;
+
+	unsigned int newestFirst = (m_aliveHead + uploaded) % m_maxParticles;
+
+	//appending continues at the ring cursor, which after an invalidate is not where the copy starts
+	if (!m_fullUpload && m_appendUploads && m_upload.CanAppend(pending))
 	{
-		m_vs->SetInt("startIndex", m_aliveHead);
-		m_vs->CopyAllBufferData();
-		context->DrawIndexed(m_liveParticles * 6, 0, 0);
+		//only the particles spawned since the last upload cross the bus
+		unsigned int offset = 0;
+		HybridParticle* out = static_cast<HybridParticle*>(m_upload.Append(context, m_particleBuff, pending, sizeof(HybridParticle), offset));
+		if (!out)
+			return;
+
+		CopyParticles(out, newestFirst, pending);
+		m_gpuTail = offset + pending;
 	}
-	else 
+	else
 	{
-		m_vs->SetInt("startIndex", 0);
-		m_vs->CopyAllBufferData();
-		context->DrawIndexed(m_deadHead*6,0,0);
-
-		m_vs->SetInt("startIndex", m_aliveHead);
-		m_vs->CopyAllBufferData();
-		context->DrawIndexed((m_maxParticles-m_aliveHead)*6,0,0);
+		//wrapped, invalidated (or no append support): DISCARD and repack every live particle from element zero
+		HybridParticle* out = static_cast<HybridParticle*>(m_upload.Restart(context, m_particleBuff, m_liveParticles));
+		if (!out)
+			return;
+
+		CopyParticles(out, m_aliveHead, m_liveParticles);
+		m_gpuHead = 0;
+		m_gpuTail = m_liveParticles;
+		m_fullUpload = false;
 	}
+
+	context->Unmap(m_particleBuff, 0);
+}
+
+void HybridEmitter::CopyParticles(HybridParticle* out, unsigned int first, unsigned int count)
+{
+	unsigned int firstCount = min(count, m_maxParticles - first);
+	memcpy(out, m_particleArr + first, sizeof(HybridParticle) * firstCount);
+	memcpy(out + firstCount, m_particleArr, sizeof(HybridParticle) * (count - firstCount));
 }
 
 
-void HybridEmitter::SpawnParticle(float totalTime)
+void HybridEmitter::SpawnParticles(unsigned int first, unsigned int last)
 {
-	if (m_liveParticles == m_maxParticles)
-		return;
+	ParticleSpawnParams params =
+	{
+		{ m_emitterPos.x, m_emitterPos.y, m_emitterPos.z }, { m_posRange.x, m_posRange.y, m_posRange.z },
+		{ m_startVel.x, m_startVel.y, m_startVel.z }, { m_velRange.x, m_velRange.y, m_velRange.z },
+		{ m_rotRange.x, m_rotRange.y, m_rotRange.z, m_rotRange.w },
+		m_randomKey,
+		m_surface
+	};
+	SpawnHybridParticles(reinterpret_cast<HybridParticleRecord*>(m_particleArr), m_maxParticles, m_schedule, params, first, last);
+}
+
+void HybridEmitter::ComputeDepths(unsigned int first, unsigned int count, const XMFLOAT3& forward)
+{
+	//the same closed form the vertex shader evaluates, projected on the view direction
+	float time = (float)m_time;
+	for (unsigned int j = first; j < first + count; j++)
+	{
+		const HybridParticle& particle = m_particleArr[(m_aliveHead + m_drawSlots[j]) % m_maxParticles];
+		float t = time - particle.spawnTime;
+
+		float x = particle.StartPosition.x + (particle.StartVelocity.x + m_emitterAcc.x * t * 0.5f) * t;
+		float y = particle.StartPosition.y + (particle.StartVelocity.y + m_emitterAcc.y * t * 0.5f) * t;
+		float z = particle.StartPosition.z + (particle.StartVelocity.z + m_emitterAcc.z * t * 0.5f) * t;
+		m_depths[j] = x * forward.x + y * forward.y + z * forward.z;
+	}
+}
+
+unsigned int HybridEmitter::BuildDrawOrder(ID3D11DeviceContext* context, Camera* camera)
+{
+	const unsigned int depthsPerJob = 16384;
 
-	HybridParticle* currParticle = m_particleArr + m_deadHead;
+	//live indices to draw, the gpu copy keeps live particle k at startIndex + k
+	//thinning goes by spawn index, so a particle is either drawn for its whole life or not at all
+	unsigned int firstSpawn = m_nextSpawn - m_liveParticles;
+	m_drawSlots.clear();
+	for (unsigned int n = (firstSpawn + m_detail - 1) / m_detail * m_detail; n < m_nextSpawn; n += m_detail)
+		m_drawSlots.push_back(n - firstSpawn);
 
-	currParticle->spawnTime = totalTime;
+	unsigned int drawCount = (unsigned int)m_drawSlots.size();
+	m_order.resize(drawCount);
 
-	currParticle->StartPosition = m_emitterPos;
-	currParticle->StartPosition.x += (((float)rand() / RAND_MAX) * 2 - 1) * m_posRange.x;
-	currParticle->StartPosition.y += (((float)rand() / RAND_MAX) * 2 - 1) * m_posRange.y;
-	currParticle->StartPosition.z += (((float)rand() / RAND_MAX) * 2 - 1) * m_posRange.z;
+	if (m_depthSort)
+	{
+		XMFLOAT4X4 view = camera->GetView();
+		XMFLOAT3 forward(view._31, view._32, view._33);
 
-	currParticle->StartVelocity = m_startVel;
-	currParticle->StartVelocity.x += (((float)rand() / RAND_MAX) * 2 - 1) * m_velRange.x;
-	currParticle->StartVelocity.y += (((float)rand() / RAND_MAX) * 2 - 1) * m_velRange.y;
-	currParticle->StartVelocity.z += (((float)rand() / RAND_MAX) * 2 - 1) * m_velRange.z;
+		m_depths.resize(drawCount);
+		if (m_sortJobs && drawCount > depthsPerJob)
+		{
+			JobGroup group;
+			m_sortJobs->ParallelFor(group, drawCount, depthsPerJob, [this, &forward](unsigned int begin, unsigned int end)
+			{
+				ComputeDepths(begin, end - begin, forward);
+			});
+			m_sortJobs->Wait(group);
+		}
+		else
+		{
+			ComputeDepths(0, drawCount, forward);
+		}
 
-	currParticle->RotationStart = ((float)rand() / RAND_MAX) * (m_rotRange.y - m_rotRange.x) + m_rotRange.x;
+		m_sortOrder.resize(drawCount);
+		SortBackToFront(m_depths.data(), drawCount, m_sortOrder.data(), m_sortScratch, m_sortJobs);
 
-	currParticle->RotationEnd = ((float)rand() / RAND_MAX) * (m_rotRange.w - m_rotRange.z) + m_rotRange.z;
+		for (unsigned int j = 0; j < drawCount; j++)
+			m_order[j] = m_drawSlots[m_sortOrder[j]];
+	}
+	else
+	{
+		m_order.swap(m_drawSlots);
+	}
 
-	++m_deadHead %= m_maxParticles;
-	m_liveParticles++;
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(m_orderBuff, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return 0;
 
+	memcpy(mapped.pData, m_order.data(), sizeof(unsigned int) * drawCount);
+	context->Unmap(m_orderBuff, 0);
+	return drawCount;
 }
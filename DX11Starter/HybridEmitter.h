@@ -5,6 +5,18 @@
 
 #include "SimpleShader.h"
 #include "Camera.h"
+#include "UploadRing.h"
+#include "ParticleRandom.h"
+#include "SpawnSchedule.h"
+#include "ParticleSimulation.h"
+#include "QuadIndexBuffer.h"
+#include "AlphaBlendState.h"
+#include "DepthSort.h"
+#include "ParticleBounds.h"
+#include "EmitterDesc.h"
+#include "MeshSampler.h"
+
+#include <vector>
 
 struct HybridParticle 
 {
@@ -18,6 +30,9 @@ struct HybridParticle
 	DirectX::XMFLOAT3 padding;
 };
 
+//the cpu spawn and retire code in ParticleSimulation works on the same layout
+static_assert(sizeof(HybridParticle) == sizeof(HybridParticleRecord), "HybridParticle must match HybridParticleRecord");
+
 class HybridEmitter 
 {
 private:
@@ -29,16 +44,50 @@ private:
 	DirectX::XMFLOAT4 m_rotRange, m_startColor, m_endColor;
 
 	unsigned int m_emitRate, m_liveParticles, m_maxParticles, m_aliveHead, m_deadHead;
-	float m_timePerEmission, m_timeSinceEmit, m_lifeTime, m_startSize, m_endSize;
+	float m_timePerEmission, m_lifeTime, m_startSize, m_endSize;
+	unsigned int m_randomKey;
+
+	//emitter clock, spawn index n lives in slot n % m_maxParticles and m_nextSpawn is one past the newest
+	SpawnSchedule m_schedule;
+	double m_time;
+	unsigned int m_nextSpawn;
+
+	ParticleBounds m_bounds;
 
-	ID3D11Buffer* m_particleBuff, *m_Ibuff;
+	//optional mesh to spawn on instead of the position range box; shared, not owned
+	const MeshSampler* m_surface;
+
+	ID3D11Buffer* m_particleBuff;
 	ID3D11ShaderResourceView* m_particleBuffSRV, * m_texture;
 
+	//gpu copy of the live particles, kept contiguous in [m_gpuHead, m_gpuTail) of the upload ring
+	//m_fullUpload throws it away: the next upload DISCARDs and repacks every live particle from element zero
+	UploadRing m_upload;
+	unsigned int m_gpuHead, m_gpuTail;
+	bool m_appendUploads, m_fullUpload;
+
+	//level of detail: only spawn indices that are multiples of m_detail are drawn
+	unsigned int m_detail;
+
+	//thinned or back to front: the vertex shader reads live particle DrawOrder[quad] instead of quad
+	bool m_depthSort;
+	JobSystem* m_sortJobs;
+	std::vector<float> m_depths;
+	std::vector<unsigned int> m_drawSlots, m_sortOrder, m_order;
+	DepthSortScratch m_sortScratch;
+	ID3D11Buffer* m_orderBuff;
+	ID3D11ShaderResourceView* m_orderSRV;
+
 	SimpleVertexShader* m_vs;
 	SimplePixelShader* m_ps;
 
-	void UpdateParticle(unsigned int index, float totalTime);
-	void SpawnParticle(float totalTime);
+	void SpawnParticles(unsigned int first, unsigned int last);
+	void UpdateBounds();
+	void UploadParticles(ID3D11DeviceContext* context);
+	void InvalidateUpload();
+	void CopyParticles(HybridParticle* out, unsigned int first, unsigned int count);
+	void ComputeDepths(unsigned int first, unsigned int count, const DirectX::XMFLOAT3& forward);
+	unsigned int BuildDrawOrder(ID3D11DeviceContext* context, Camera* camera);
 
 public:
 	HybridEmitter
@@ -50,8 +99,29 @@ public:
 		ID3D11Device* device, SimpleVertexShader* vs, SimplePixelShader* ps, ID3D11ShaderResourceView* srv
 	);
 
+	HybridEmitter(const EmitterDesc& desc, ID3D11Device* device, SimpleVertexShader* vs, SimplePixelShader* ps, ID3D11ShaderResourceView* srv);
 	~HybridEmitter();
 
-	void UpdateEmitter(float delta, float TotalTime);
-	void DrawEmitter(ID3D11DeviceContext* context, Camera* camera, float totalTime);
+	//draws back to front with alpha over blending instead of the scene's additive one, sorting on jobs when given and the pool is large
+	void SetDepthSort(bool enabled, JobSystem* jobs = nullptr);
+
+	//draws one particle in every detail spawned, as if the emit rate were divided by detail
+	void SetDetail(unsigned int detail) { m_detail = detail > 0 ? detail : 1; }
+
+	//spawns on the surface of a mesh placed at the emitter position instead of in the position range box, null for the box
+	//the live particles respawn on it at once; the sampler must outlive the emitter or be unset first
+	void SetSurface(const MeshSampler* surface);
+
+	void UpdateEmitter(float delta);
+	void DrawEmitter(ID3D11DeviceContext* context, Camera* camera);
+
+	//starts over at time zero somewhere else with fresh randoms, reusing every buffer, for pooled effects
+	void Restart(const DirectX::XMFLOAT3& position);
+
+	//moves the emitter clock to any time, forwards or backwards, in O(live) without stepping
+	void Seek(double time);
+	double GetTime() const { return m_time; }
+
+	const ParticleBounds& GetBounds() const { return m_bounds; }
+	unsigned int GetLiveParticles() const { return m_liveParticles; }
 };
\ No newline at end of file
@@ -13,6 +13,9 @@ cbuffer external : register(b0)
 	float endSize;
 	float lifeTime;
 	float totalTime;
+
+	//set when DrawOrder lists the live particles to draw, thinned and/or back to front
+	int useDrawOrder;
 }
 
 struct Particle
@@ -29,6 +32,7 @@ struct Particle
 
 
 StructuredBuffer<Particle> ParticleBuff: register(t0);
+StructuredBuffer<uint> DrawOrder: register(t1);
 
 struct VertexToPixel
 {
@@ -42,6 +46,8 @@ VertexToPixel main(uint id: SV_VertexID)
 	VertexToPixel output;
 
 	uint particleID = id / 4;
+	if (useDrawOrder)
+		particleID = DrawOrder[particleID];
 	uint cornerID = id % 4;
 
 	Particle particle = ParticleBuff.Load(particleID + startIndex);
@@ -0,0 +1,141 @@
+#include "JobSystem.h"
+
+namespace
+{
+	//which pool a thread works for and the queue it owns there, threads outside any pool use queue 0
+	thread_local const JobSystem* t_pool = nullptr;
+	thread_local unsigned int t_queueIndex = 0;
+}
+
+JobSystem::JobSystem(unsigned int workerCount)
+{
+	if (workerCount == 0)
+	{
+		unsigned int hardware = std::thread::hardware_concurrency();
+		workerCount = hardware > 1 ? hardware - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i <= workerCount; i++)
+		m_queues.emplace_back(new WorkQueue());
+
+	for (unsigned int i = 0; i < workerCount; i++)
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_sleepLock);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+void JobSystem::Run(JobGroup& group, Job job)
+{
+	group.pending.fetch_add(1);
+
+	WorkQueue& queue = *m_queues[CurrentQueue()];
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.jobs.push_back(QueuedJob{ std::move(job), &group });
+	}
+
+	//taking the sleep lock orders the push before any worker's empty check, so no wake up is lost
+	{
+		std::lock_guard<std::mutex> guard(m_sleepLock);
+		m_queued.fetch_add(1);
+	}
+	m_wake.notify_one();
+}
+
+void JobSystem::ParallelFor(JobGroup& group, unsigned int count, unsigned int chunkSize, const RangeJob& job)
+{
+	if (chunkSize == 0)
+		chunkSize = 1;
+
+	for (unsigned int begin = 0; begin < count; begin += chunkSize)
+	{
+		unsigned int end = (count - begin > chunkSize) ? begin + chunkSize : count;
+		Run(group, [job, begin, end]() { job(begin, end); });
+	}
+}
+
+void JobSystem::Wait(JobGroup& group)
+{
+	unsigned int queueIndex = CurrentQueue();
+	while (group.pending.load() > 0)
+	{
+		if (!TryRunJob(queueIndex))
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerLoop(unsigned int queueIndex)
+{
+	t_pool = this;
+	t_queueIndex = queueIndex;
+
+	while (true)
+	{
+		if (TryRunJob(queueIndex))
+			continue;
+
+		std::unique_lock<std::mutex> guard(m_sleepLock);
+		m_wake.wait(guard, [this]() { return m_stop.load() || m_queued.load() > 0; });
+		if (m_stop.load() && m_queued.load() == 0)
+			return;
+	}
+}
+
+bool JobSystem::TryRunJob(unsigned int queueIndex)
+{
+	QueuedJob queued;
+	if (!PopJob(queueIndex, queued))
+		return false;
+
+	queued.job();
+	queued.group->pending.fetch_sub(1);
+	return true;
+}
+
+bool JobSystem::PopJob(unsigned int queueIndex, QueuedJob& out)
+{
+	//own queue first, newest job while its data is still warm in cache
+	{
+		WorkQueue& own = *m_queues[queueIndex];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.jobs.empty())
+		{
+			out = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			m_queued.fetch_sub(1);
+			return true;
+		}
+	}
+
+	//then steal the oldest job from the others, which tends to be the biggest piece of work left
+	unsigned int queueCount = (unsigned int)m_queues.size();
+	for (unsigned int step = 1; step < queueCount; step++)
+	{
+		WorkQueue& victim = *m_queues[(queueIndex + step) % queueCount];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.jobs.empty())
+		{
+			out = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			m_queued.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+unsigned int JobSystem::CurrentQueue() const
+{
+	return t_pool == this ? t_queueIndex : 0;
+}
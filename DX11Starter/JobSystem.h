@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//jobs that can be waited on together
+struct JobGroup
+{
+	std::atomic<unsigned int> pending{ 0 };
+};
+
+//work stealing thread pool, portable (no d3d or win32) so headless tools can use it too
+//every worker owns a deque: it pops its own newest job and steals the oldest from the others when it runs dry
+//a thread in Wait helps run jobs instead of blocking, so waiting from inside a job cannot deadlock
+class JobSystem
+{
+public:
+	typedef std::function<void()> Job;
+	typedef std::function<void(unsigned int begin, unsigned int end)> RangeJob;
+
+	//workerCount 0 uses one worker per hardware thread besides the caller's
+	explicit JobSystem(unsigned int workerCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void Run(JobGroup& group, Job job);
+
+	//splits [0, count) into chunks of at most chunkSize and runs job on each
+	void ParallelFor(JobGroup& group, unsigned int count, unsigned int chunkSize, const RangeJob& job);
+
+	//runs queued jobs until every job in group has finished
+	void Wait(JobGroup& group);
+
+	unsigned int GetWorkerCount() const { return (unsigned int)m_workers.size(); }
+
+private:
+	struct QueuedJob
+	{
+		Job job;
+		JobGroup* group;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex lock;
+		std::deque<QueuedJob> jobs;
+	};
+
+	//queue 0 takes work from threads outside the pool, worker i owns queue i + 1
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_sleepLock;
+	std::condition_variable m_wake;
+	std::atomic<unsigned int> m_queued{ 0 };
+	std::atomic<bool> m_stop{ false };
+
+	void WorkerLoop(unsigned int queueIndex);
+	bool TryRunJob(unsigned int queueIndex);
+	bool PopJob(unsigned int queueIndex, QueuedJob& out);
+	unsigned int CurrentQueue() const;
+};
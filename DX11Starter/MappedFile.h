@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+//a whole file mapped read only into memory, so loaders parse straight out of the page cache without copying it first
+//portable: win32 file mapping on windows, mmap elsewhere, so headless tools can use it too
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//false when the file cannot be opened; an empty file opens with a null view
+	bool Open(const char* path);
+	void Close();
+
+	const char* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
@@ -3,194 +3,82 @@
 #include <DirectXMath.h>
 #include "Mesh.h"
 #include <vector>
-#include <fstream>
 #include <iostream>
+#include <cstddef>
+#include "MeshCache.h"
 using namespace DirectX;
 
+//cooked vertices go to the gpu as they are
+static_assert(sizeof(Vertex) == sizeof(MeshFileVertex) && offsetof(Vertex, Position) == offsetof(MeshFileVertex, position) &&
+	offsetof(Vertex, Normal) == offsetof(MeshFileVertex, normal) && offsetof(Vertex, UV) == offsetof(MeshFileVertex, uv), "Vertex and MeshFileVertex differ");
+static_assert(sizeof(WaterVertex) == 44 && offsetof(WaterVertex, UV) == 24 && offsetof(WaterVertex, Tangent) == 32, "WaterVertex and c_waterVertexLayout differ");
 
-
-
-
-Mesh::Mesh(const char* objFile, ID3D11Device* device)
+Mesh::Mesh(const char* objFile, ID3D11Device* device, bool keepSurface, JobSystem* jobs, const char* cacheFile)
 {
-	// File input object
-	std::ifstream obj(objFile);
-
-	// Check for successful open
-	if (!obj.is_open())
-	{
-		std::cout << "File not found" << std::endl;
-		return;
-	}
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;     // Positions from the file
-	std::vector<XMFLOAT3> normals;       // Normals from the file
-	std::vector<XMFLOAT2> uvs;           // UVs from the file
-	std::vector<Vertex> verts;           // Verts we're assembling
-	std::vector<UINT> indices;           // Indices of these verts
-	unsigned int vertCounter = 0;        // Count of vertices/indices
-	char chars[100];                     // String for line reading
+	std::string error;
 
-	// Still have data left?
-	while (obj.good())
+	// A cooked file still current for the obj is uploaded straight out of its mapping,
+	// or decoded into the memory the buffers are created from when it is encoded
+	if (cacheFile)
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
-
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
+		MeshFile file;
+		if (file.Open(cacheFile, c_meshFileVertexLayout, error) && file.IsCurrent(objFile))
 		{
-			// Read the face indices into an array
-			unsigned int i[12];
-			int facesRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-
-			// Add three more indices
-			indices.push_back(vertCounter); vertCounter += 1;
-			indices.push_back(vertCounter); vertCounter += 1;
-			indices.push_back(vertCounter); vertCounter += 1;
-
-			// Was there a 4th face?
-			if (facesRead == 12)
+			const MeshFileHeader& header = file.GetHeader();
+			const Vertex* verts = static_cast<const Vertex*>(file.GetVertices());
+			const unsigned int* indices = file.GetIndices();
+			ObjArray<MeshFileVertex> decodedVertices;
+			ObjArray<uint32_t> decodedIndices;
+			bool decoded = true;
+			if (file.IsEncoded())
 			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-
-				// Add three more indices
-				indices.push_back(vertCounter); vertCounter += 1;
-				indices.push_back(vertCounter); vertCounter += 1;
-				indices.push_back(vertCounter); vertCounter += 1;
+				decodedVertices.resize(header.vertexCount);
+				decodedIndices.resize(header.indexCount);
+				decoded = file.Decode(decodedVertices.data(), decodedIndices.data());
+				verts = reinterpret_cast<const Vertex*>(decodedVertices.data());
+				indices = decodedIndices.data();
 			}
+			if (decoded)
+			{
+				CreatingBuffer(verts, indices, header.vertexCount, header.indexCount, device);
+				if (keepSurface)
+					BuildSurface(verts, indices, header.vertexCount, header.indexCount);
+				return;
+			}
+			std::cout << cacheFile << ": corrupt, cooking again" << std::endl;
 		}
 	}
 
-	// Close the file and create the actual buffers
-	obj.close();
-	
+	CookedMesh cooked;
+	if (!CookObj(objFile, cooked, error, jobs))
+	{
+		std::cout << objFile << ": " << error << std::endl;
+		return;
+	}
+	if (cooked.indices.empty())
+	{
+		std::cout << objFile << ": no faces" << std::endl;
+		return;
+	}
+
+	// a cache that cannot be written only costs the next launch a cook
+	if (cacheFile && !WriteMeshFile(cacheFile, cooked, objFile, error))
+		std::cout << objFile << ": " << error << std::endl;
 
-	std::cout << verts.size() << "  " << indices.size() << std::endl;
-	
-	CreatingBuffer(&verts[0],&indices[0],vertCounter,vertCounter,device);
+	unsigned int vertCounter = (unsigned int)cooked.vertices.size();
+	unsigned int indexCounter = (unsigned int)cooked.indices.size();
+	std::cout << vertCounter << "  " << indexCounter << std::endl;
 
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
-	//
-	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
-	//
-	// - "vertCounter" is BOTH the number of vertices and the number of indices
-	// - Yes, the indices are a bit redundant here (one per vertex).  Could you skip using
-	//    an index buffer in this case?  Sure!  Though, if your mesh class assumes you have
-	//    one, you'll need to write some extra code to handle cases when you don't.
+	const Vertex* verts = reinterpret_cast<const Vertex*>(cooked.vertices.data());
+	CreatingBuffer(verts, cooked.indices.data(), vertCounter, indexCounter, device);
+	if (keepSurface)
+		BuildSurface(verts, cooked.indices.data(), vertCounter, indexCounter);
 }
 
 Mesh::~Mesh()
 {
 	if (vertexPointer) { vertexPointer->Release();}
 	if (indexPointer) { indexPointer->Release();}
+	delete surface;
 }
 
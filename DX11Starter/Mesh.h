@@ -1,31 +1,53 @@
 #pragma once
 #include "Vertex.h"
 #include "types.h"
+#include "MeshSampler.h"
+#include "MeshOptimizer.h"
+
+class JobSystem;
 
 //creating mesh class
 class Mesh
 {
 	ID3D11Buffer *vertexPointer = nullptr, *indexPointer = nullptr;
 	int indexCount=NULL;
+	//cpu copy of the triangles for emitters that spawn on the mesh, only when asked for
+	MeshSampler* surface = nullptr;
 	//Vertex*VertexArr=nullptr;
 	//unsigned int* indexarr=nullptr;
 public: 
 	template <typename T>
 	Mesh(T* vertextArray, unsigned int * intArray, int totalVertices, int totalIndices, ID3D11Device* device);
 	
-	Mesh(const char* objFile, ID3D11Device* device);
+	//keepSurface builds a MeshSampler so particles can spawn on the mesh
+	//with jobs, big files are parsed and assembled in parallel (see ObjParser.h)
+	//with a cacheFile, a cooked copy of the obj is mapped and uploaded as it is while it is current,
+	//and cooked again when it is not (see MeshCache.h)
+	Mesh(const char* objFile, ID3D11Device* device, bool keepSurface = false, JobSystem* jobs = nullptr, const char* cacheFile = nullptr);
 	~Mesh();
 	
 	ID3D11Buffer* GetVertexBuffer() { return vertexPointer; }
 	ID3D11Buffer* GetIndexBuffer() { return indexPointer; }
 	int GetIndexCount() { return indexCount; }
+	//null unless the mesh was built with one
+	const MeshSampler* GetSurface() { return surface; }
+
+	template <typename T>
+	void CreatingBuffer(const T* vertextArray, const unsigned int* intArray, int totalVertices, int totalIndices, ID3D11Device* device);
 
+	//area weighted sampler over the triangles, for any vertex type with a Position
 	template <typename T>
-	void CreatingBuffer(T* vertextArray, unsigned int* intArray, int totalVertices, int totalIndices, ID3D11Device* device);
+	void BuildSurface(const T* vertextArray, const unsigned int* intArray, int totalVertices, int totalIndices);
+
+	//reorders the triangles for the post transform cache and overdraw, then the vertices for fetch (see MeshOptimizer.h),
+	//in place before CreatingBuffer, for any vertex type with a Position; returns how many vertices are used, those first
+	//generated grids skip this and come out of BuildGridIndices in cache order already
+	template <typename T>
+	static int Optimize(T* vertextArray, unsigned int* intArray, int totalVertices, int totalIndices);
 };
 
 template<typename T>
-void Mesh::CreatingBuffer(T* vertextArray, unsigned int* intArray, int totalVertices, int totalIndices, ID3D11Device* device)
+void Mesh::CreatingBuffer(const T* vertextArray, const unsigned int* intArray, int totalVertices, int totalIndices, ID3D11Device* device)
 {
 	indexCount = totalIndices;
 	D3D11_BUFFER_DESC vbd;
@@ -53,6 +75,21 @@ void Mesh::CreatingBuffer(T* vertextArray, unsigned int* intArray, int totalVert
 
 }
 
+template<typename T>
+void Mesh::BuildSurface(const T* vertextArray, const unsigned int* intArray, int totalVertices, int totalIndices)
+{
+	delete surface;
+	surface = new MeshSampler(&vertextArray->Position, sizeof(T), totalVertices, intArray, totalIndices);
+}
+
+template<typename T>
+int Mesh::Optimize(T* vertextArray, unsigned int* intArray, int totalVertices, int totalIndices)
+{
+	OptimizeVertexCache(intArray, totalIndices, totalVertices);
+	OptimizeOverdraw(intArray, totalIndices, &vertextArray->Position, sizeof(T), totalVertices);
+	return OptimizeVertexFetch(vertextArray, sizeof(T), totalVertices, intArray, totalIndices);
+}
+
 template<typename T>
 Mesh::Mesh(T* vertextArray, unsigned int* intArray, int totalVertices, int totalIndices, ID3D11Device* device)
 {
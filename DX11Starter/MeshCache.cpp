@@ -0,0 +1,382 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <vector>
+
+#include "JobSystem.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	const char c_meshFileMagic[4] = { 'M', 'E', 'S', 'H' };
+	const uint32_t c_meshFileVersion = 2;
+
+	//vertices per job when building them in parallel
+	const unsigned int c_cookVertices = 1 << 16;
+
+	const uint64_t c_hashPrime1 = 0x9e3779b185ebca87ull;
+	const uint64_t c_hashPrime2 = 0xc2b2ae3d27d4eb4full;
+	const uint64_t c_hashPrime3 = 0x165667b19e3779f9ull;
+
+	inline uint64_t RotateLeft(uint64_t x, int bits) { return (x << bits) | (x >> (64 - bits)); }
+	inline uint64_t HashRound(uint64_t lane, uint64_t word) { return RotateLeft(lane + word * c_hashPrime2, 31) * c_hashPrime1; }
+
+	inline uint64_t AlignOffset(uint64_t offset) { return (offset + c_meshFileAlignment - 1) / c_meshFileAlignment * c_meshFileAlignment; }
+
+	//size and last write time of a file, false when it is not there
+	bool StampSource(const char* path, uint64_t& size, int64_t& time)
+	{
+		std::error_code error;
+		size = fs::file_size(path, error);
+		if (error)
+			return false;
+		time = (int64_t)fs::last_write_time(path, error).time_since_epoch().count();
+		return !error;
+	}
+
+	//a cache is written next to itself and renamed over, so a write cut short never looks like a valid cache
+	struct FilePiece
+	{
+		const void* data;
+		uint64_t size;
+	};
+
+	bool WriteTemporary(const std::string& temporary, std::initializer_list<FilePiece> pieces)
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		for (const FilePiece& piece : pieces)
+			file.write(static_cast<const char*>(piece.data), piece.size);
+		return (bool)file.flush();
+	}
+
+	bool ReplaceWithTemporary(const std::string& temporary, const char* path, std::string& error)
+	{
+		std::error_code fsError;
+		fs::rename(temporary, path, fsError);
+		if (fsError)
+		{
+			fs::remove(temporary, fsError);
+			error = std::string("cannot write ") + path;
+			return false;
+		}
+		return true;
+	}
+}
+
+const MeshVertexLayout c_meshFileVertexLayout =
+{
+	sizeof(MeshFileVertex), 3,
+	{
+		{ MeshAttribute_Position, 3, offsetof(MeshFileVertex, position) },
+		{ MeshAttribute_Normal, 3, offsetof(MeshFileVertex, normal) },
+		{ MeshAttribute_UV, 2, offsetof(MeshFileVertex, uv) }
+	}
+};
+
+const MeshVertexLayout c_waterVertexLayout =
+{
+	44, 4,
+	{
+		{ MeshAttribute_Position, 3, 0 },
+		{ MeshAttribute_Normal, 3, 12 },
+		{ MeshAttribute_UV, 2, 24 },
+		{ MeshAttribute_Tangent, 3, 32 }
+	}
+};
+
+bool operator==(const MeshVertexLayout& a, const MeshVertexLayout& b)
+{
+	if (a.stride != b.stride || a.elementCount != b.elementCount)
+		return false;
+	for (uint32_t i = 0; i < a.elementCount; i++)
+	{
+		const MeshVertexElement& x = a.elements[i], & y = b.elements[i];
+		if (x.attribute != y.attribute || x.components != y.components || x.offset != y.offset)
+			return false;
+	}
+	return true;
+}
+
+uint64_t HashMeshSource(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t lanes[4] = { c_hashPrime1 + c_hashPrime2, c_hashPrime2, 0, 0 - c_hashPrime1 };
+
+	size_t blocks = size / 32;
+	for (size_t b = 0; b < blocks; b++)
+	{
+		uint64_t words[4];
+		memcpy(words, bytes + b * 32, 32);
+		for (int i = 0; i < 4; i++)
+			lanes[i] = HashRound(lanes[i], words[i]);
+	}
+
+	uint64_t hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+	hash += size;
+
+	//the last few bytes, zero padded to a word
+	for (size_t offset = blocks * 32; offset < size; offset += 8)
+	{
+		uint64_t word = 0;
+		memcpy(&word, bytes + offset, std::min<size_t>(8, size - offset));
+		hash = RotateLeft(hash ^ HashRound(0, word), 27) * c_hashPrime1 + c_hashPrime3;
+	}
+
+	hash ^= hash >> 33;
+	hash *= c_hashPrime2;
+	hash ^= hash >> 29;
+	hash *= c_hashPrime3;
+	return hash ^ (hash >> 32);
+}
+
+bool CookObj(const char* objPath, CookedMesh& out, std::string& error, JobSystem* jobs)
+{
+	ObjData obj;
+	if (!LoadObj(objPath, obj, error, jobs))
+		return false;
+
+	//corners with the same position, uv and normal become one vertex, and the indices say which
+	ObjArray<ObjCorner> unique;
+	WeldObj(obj, unique, out.indices, jobs);
+	unsigned int vertexCount = (unsigned int)unique.size();
+	unsigned int indexCount = (unsigned int)out.indices.size();
+	out.vertices.resize(vertexCount);
+
+	// The model is most likely in a right-handed space,
+	// especially if it came from Maya.  We want to convert
+	// to a left-handed space for DirectX.  This means we
+	// need to:
+	//  - Invert the Z position
+	//  - Invert the normal's Z
+	//  - Flip the winding order
+	// We also need to flip the UV coordinate since DirectX
+	// defines (0,0) as the top left of the texture, and many
+	// 3D modeling packages use the bottom left as (0,0)
+	auto buildVertices = [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; i++)
+		{
+			const ObjCorner& corner = unique[i];
+			MeshFileVertex& v = out.vertices[i];
+
+			const float* position = &obj.positions[(size_t)corner.position * 3];
+			v.position[0] = position[0];
+			v.position[1] = position[1];
+			v.position[2] = -position[2];
+
+			//corners without a uv or normal get zeros instead of reading out of bounds
+			if (corner.uv != c_objNone)
+			{
+				v.uv[0] = obj.uvs[(size_t)corner.uv * 2];
+				v.uv[1] = 1.0f - obj.uvs[(size_t)corner.uv * 2 + 1];
+			}
+			else
+			{
+				v.uv[0] = v.uv[1] = 0.0f;
+			}
+			if (corner.normal != c_objNone)
+			{
+				const float* normal = &obj.normals[(size_t)corner.normal * 3];
+				v.normal[0] = normal[0];
+				v.normal[1] = normal[1];
+				v.normal[2] = -normal[2];
+			}
+			else
+			{
+				v.normal[0] = v.normal[1] = v.normal[2] = 0.0f;
+			}
+		}
+	};
+	if (jobs)
+	{
+		JobGroup group;
+		jobs->ParallelFor(group, vertexCount, c_cookVertices, buildVertices);
+		jobs->Wait(group);
+	}
+	else
+	{
+		buildVertices(0, vertexCount);
+	}
+
+	//corners a, b, c go in as a, c, b
+	for (unsigned int t = 0; t + 2 < indexCount; t += 3)
+		std::swap(out.indices[t + 1], out.indices[t + 2]);
+
+	OptimizeVertexCache(out.indices.data(), indexCount, vertexCount);
+	OptimizeOverdraw(out.indices.data(), indexCount, out.vertices.data(), sizeof(MeshFileVertex), vertexCount);
+	out.vertices.resize(OptimizeVertexFetch(out.vertices.data(), sizeof(MeshFileVertex), vertexCount, out.indices.data(), indexCount));
+
+	for (int k = 0; k < 3; k++)
+	{
+		out.boundsMin[k] = out.vertices.empty() ? 0.0f : out.vertices[0].position[k];
+		out.boundsMax[k] = out.boundsMin[k];
+	}
+	for (const MeshFileVertex& v : out.vertices)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			out.boundsMin[k] = std::min(out.boundsMin[k], v.position[k]);
+			out.boundsMax[k] = std::max(out.boundsMax[k], v.position[k]);
+		}
+	}
+	return true;
+}
+
+bool WriteMeshFile(const char* cachePath, const CookedMesh& mesh, const char* sourcePath, std::string& error, MeshEncoding encoding)
+{
+	MeshFileHeader header = {};
+	memcpy(header.magic, c_meshFileMagic, 4);
+	header.version = c_meshFileVersion;
+
+	MappedFile source;
+	if (!StampSource(sourcePath, header.sourceSize, header.sourceTime) || !source.Open(sourcePath))
+	{
+		error = std::string("cannot open ") + sourcePath;
+		return false;
+	}
+	header.sourceHash = HashMeshSource(source.GetData(), source.GetSize());
+
+	header.layout = c_meshFileVertexLayout;
+	header.vertexCount = (uint32_t)mesh.vertices.size();
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.encoding = encoding;
+	memcpy(header.boundsMin, mesh.boundsMin, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, mesh.boundsMax, sizeof(header.boundsMax));
+
+	const void* vertexBlob = mesh.vertices.data();
+	const void* indexBlob = mesh.indices.data();
+	header.vertexBytes = (uint64_t)header.vertexCount * sizeof(MeshFileVertex);
+	header.indexBytes = (uint64_t)header.indexCount * sizeof(uint32_t);
+
+	std::vector<unsigned char> encodedVertices, encodedIndices;
+	if (encoding == MeshEncoding_Codec)
+	{
+		ObjArray<MeshFileVertex> quantized(mesh.vertices);
+		QuantizeVertices(quantized.data(), quantized.size(), c_meshFileVertexLayout);
+		EncodeVertices(quantized.data(), quantized.size(), sizeof(MeshFileVertex), encodedVertices);
+		EncodeIndices(mesh.indices.data(), mesh.indices.size(), encodedIndices);
+		vertexBlob = encodedVertices.data();
+		indexBlob = encodedIndices.data();
+		header.vertexBytes = encodedVertices.size();
+		header.indexBytes = encodedIndices.size();
+	}
+
+	header.vertexOffset = AlignOffset(sizeof(header));
+	header.indexOffset = AlignOffset(header.vertexOffset + header.vertexBytes);
+
+	std::error_code fsError;
+	fs::path path(cachePath);
+	if (path.has_parent_path())
+		fs::create_directories(path.parent_path(), fsError);
+
+	std::string temporary = std::string(cachePath) + ".tmp";
+	const char padding[c_meshFileAlignment] = {};
+	if (!WriteTemporary(temporary, {
+		{ &header, sizeof(header) },
+		{ padding, header.vertexOffset - sizeof(header) },
+		{ vertexBlob, header.vertexBytes },
+		{ padding, header.indexOffset - header.vertexOffset - header.vertexBytes },
+		{ indexBlob, header.indexBytes } }))
+	{
+		error = std::string("cannot write ") + temporary;
+		return false;
+	}
+	return ReplaceWithTemporary(temporary, cachePath, error);
+}
+
+bool MeshFile::Open(const char* cachePath, const MeshVertexLayout& layout, std::string& error)
+{
+	m_header = nullptr;
+	m_path = cachePath;
+	if (!m_file.Open(cachePath))
+	{
+		error = std::string("cannot open ") + cachePath;
+		return false;
+	}
+
+	const MeshFileHeader* header = reinterpret_cast<const MeshFileHeader*>(m_file.GetData());
+	if (m_file.GetSize() < sizeof(MeshFileHeader) || memcmp(header->magic, c_meshFileMagic, 4) != 0 || header->version != c_meshFileVersion)
+	{
+		error = "mesh file from a different version, cook it again";
+		return false;
+	}
+	if (!(header->layout == layout))
+	{
+		error = "mesh file has a different vertex layout";
+		return false;
+	}
+
+	//every blob inside the file, whatever the header claims; encoded blobs are checked as they decode
+	uint64_t size = m_file.GetSize();
+	bool raw = header->encoding == MeshEncoding_Raw;
+	if (header->encoding > MeshEncoding_Codec ||
+		(raw && (header->vertexBytes != (uint64_t)header->vertexCount * layout.stride || header->indexBytes != (uint64_t)header->indexCount * sizeof(uint32_t))) ||
+		header->vertexOffset > size || header->vertexBytes > size - header->vertexOffset ||
+		header->indexOffset > size || header->indexBytes > size - header->indexOffset)
+	{
+		error = "mesh file is cut short";
+		return false;
+	}
+
+	m_header = header;
+	return true;
+}
+
+bool MeshFile::Decode(void* vertices, uint32_t* indices) const
+{
+	const MeshFileHeader& header = *m_header;
+	if (!IsEncoded())
+	{
+		memcpy(vertices, GetVertices(), header.vertexBytes);
+		memcpy(indices, GetIndices(), header.indexBytes);
+		return true;
+	}
+	return DecodeVertices(GetVertices(), header.vertexBytes, vertices, header.vertexCount, header.layout.stride) &&
+		DecodeIndices(GetIndices(), header.indexBytes, indices, header.indexCount);
+}
+
+bool MeshFile::IsCurrent(const char* sourcePath)
+{
+	uint64_t size;
+	int64_t time;
+	if (!m_header || !StampSource(sourcePath, size, time) || size != m_header->sourceSize)
+		return false;
+	if (time == m_header->sourceTime)
+		return true;
+
+	//touched, maybe not changed: a checkout or a copy moves the time but keeps the bytes
+	MappedFile source;
+	if (!source.Open(sourcePath) || HashMeshSource(source.GetData(), source.GetSize()) != m_header->sourceHash)
+		return false;
+	Restamp(time);
+	return m_header != nullptr;
+}
+
+void MeshFile::Restamp(int64_t sourceTime)
+{
+	MeshFileHeader header = *m_header;
+	header.sourceTime = sourceTime;
+	std::string path = m_path, temporary = m_path + ".tmp", error;
+	if (!WriteTemporary(temporary, {
+		{ &header, sizeof(header) },
+		{ m_file.GetData() + sizeof(header), m_file.GetSize() - sizeof(header) } }))
+	{
+		std::error_code fsError;
+		fs::remove(temporary, fsError);
+		return;
+	}
+
+	//windows will not rename over a mapped file, so the view goes first and comes back on whichever file is there after
+	m_header = nullptr;
+	m_file.Close();
+	ReplaceWithTemporary(temporary, path.c_str(), error);
+	Open(path.c_str(), header.layout, error);
+}
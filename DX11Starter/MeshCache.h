@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+#include "ObjParser.h"
+
+class JobSystem;
+
+//cooked meshes: what Mesh builds out of an obj (welded, left handed, optimized), written once in the layout the gpu
+//buffers take, so later launches map the file and upload straight out of it
+//  header        MeshFileHeader: the source it was cooked from, the vertex layout, bounds and where the blobs are
+//  vertex blob   vertexCount * layout.stride bytes, or those vertices through EncodeVertices (MeshCodec.h)
+//  index blob    indexCount 32 bit indices, or those through EncodeIndices
+//both blobs start at a multiple of c_meshFileAlignment; little endian, like every target the game builds for
+
+//blob offsets are multiples of this, so a mapped blob starts on a cache line
+const uint32_t c_meshFileAlignment = 64;
+
+enum MeshAttribute : uint32_t
+{
+	MeshAttribute_Position,
+	MeshAttribute_Normal,
+	MeshAttribute_UV,
+	MeshAttribute_Tangent
+};
+
+//one vertex attribute: components floats at a byte offset
+struct MeshVertexElement
+{
+	MeshAttribute attribute;
+	uint32_t components;
+	uint32_t offset;
+};
+
+const uint32_t c_maxMeshVertexElements = 8;
+
+struct MeshVertexLayout
+{
+	uint32_t stride;
+	uint32_t elementCount;
+	MeshVertexElement elements[c_maxMeshVertexElements];
+};
+bool operator==(const MeshVertexLayout& a, const MeshVertexLayout& b);
+
+//what cooked obj vertices hold, laid out like Vertex
+struct MeshFileVertex
+{
+	float position[3];
+	float normal[3];
+	float uv[2];
+};
+extern const MeshVertexLayout c_meshFileVertexLayout;
+
+//the generated streams' layouts, for encoding them the same way: TerrainVertex is laid out like Vertex, WaterVertex
+//adds a tangent
+extern const MeshVertexLayout c_waterVertexLayout;
+
+//how the blobs are stored
+enum MeshEncoding : uint32_t
+{
+	//as the gpu takes them, mapped and uploaded in place: the fastest load once the file is in the os cache
+	MeshEncoding_Raw,
+	//quantized and encoded (MeshCodec.h): well under half the size, for files that ship or load cold, decoded at
+	//memory speed on the way to the gpu
+	MeshEncoding_Codec
+};
+
+struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	//the source as it was cooked: when its size or write time moved, the hash decides whether to cook again
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+
+	MeshVertexLayout layout;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	MeshEncoding encoding;
+	uint32_t reserved;
+
+	//box around every vertex
+	float boundsMin[3];
+	float boundsMax[3];
+
+	uint64_t vertexOffset, vertexBytes;
+	uint64_t indexOffset, indexBytes;
+};
+static_assert(sizeof(MeshFileHeader) == 208, "changing MeshFileHeader changes the mesh file format, bump c_meshFileVersion");
+
+//a cooked mesh in memory, before it is written
+struct CookedMesh
+{
+	ObjArray<MeshFileVertex> vertices;
+	ObjArray<uint32_t> indices;
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+//64 bit hash of a file's bytes, eight at a time in four independent lanes
+uint64_t HashMeshSource(const void* data, size_t size);
+
+//parses, welds and turns an obj left handed the way the game draws it, then optimizes it for the gpu (MeshOptimizer.h)
+bool CookObj(const char* objPath, CookedMesh& out, std::string& error, JobSystem* jobs = nullptr);
+
+//writes a cooked mesh through a temporary file, so a write cut short never looks like a valid cache
+//the source is stamped by size, write time and content hash
+//MeshEncoding_Codec rounds the vertices with QuantizeVertices before encoding them, the mesh in memory is left alone
+bool WriteMeshFile(const char* cachePath, const CookedMesh& mesh, const char* sourcePath, std::string& error, MeshEncoding encoding = MeshEncoding_Raw);
+
+//a mesh file mapped into memory, the blobs read in place
+class MeshFile
+{
+public:
+	//false with a reason when the file is missing, cut short, from another version or laid out other than layout
+	bool Open(const char* cachePath, const MeshVertexLayout& layout, std::string& error);
+
+	//whether the file was cooked from the source as it is now: size and write time first, and only when those moved
+	//the content hash, so an untouched source is never read. a source that was touched but hashes the same gets its
+	//new time stamped into the file, so only the first launch after a checkout pays for the hash
+	bool IsCurrent(const char* sourcePath);
+
+	const MeshFileHeader& GetHeader() const { return *m_header; }
+
+	//the blobs as stored, only in the gpu's layout while the file is not encoded
+	bool IsEncoded() const { return m_header->encoding != MeshEncoding_Raw; }
+	const void* GetVertices() const { return m_file.GetData() + m_header->vertexOffset; }
+	const uint32_t* GetIndices() const { return reinterpret_cast<const uint32_t*>(m_file.GetData() + m_header->indexOffset); }
+
+	//the blobs in the gpu's layout, into vertexCount * layout.stride bytes and indexCount indices, whatever the encoding
+	//false when an encoded blob does not decode to the counts in the header
+	bool Decode(void* vertices, uint32_t* indices) const;
+
+private:
+	//rewrites the file with a new source time through a temporary, mapped again afterwards
+	void Restamp(int64_t sourceTime);
+
+	MappedFile m_file;
+	const MeshFileHeader* m_header = nullptr;
+	std::string m_path;
+};
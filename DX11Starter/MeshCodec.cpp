@@ -0,0 +1,308 @@
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
+
+#include "MeshCache.h"
+
+namespace
+{
+	//values per block, one sse register of bytes
+	const unsigned int c_blockSize = 16;
+
+	//widest vertex the decoder has room for, a block of its planes sits on the stack
+	const unsigned int c_maxCodecStride = 256;
+
+	//bits per byte of a vertex plane block, by its 2 bit code
+	const unsigned int c_planeBits[4] = { 0, 2, 4, 8 };
+
+	//bytes per index of an index block, by its code byte
+	const unsigned int c_indexWidths[3] = { 1, 2, 4 };
+
+	inline unsigned int KeptBits(MeshAttribute attribute)
+	{
+		switch (attribute)
+		{
+		case MeshAttribute_Position: return c_quantizePositionBits;
+		case MeshAttribute_UV: return c_quantizeUVBits;
+		default: return c_quantizeDirectionBits;
+		}
+	}
+
+	inline unsigned char ZigzagByte(unsigned char delta) { return (unsigned char)((delta << 1) ^ (unsigned char)((signed char)delta >> 7)); }
+	inline uint32_t ZigzagIndex(uint32_t delta) { return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31); }
+
+	inline __m128i Load16(const unsigned char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+	//16 plane bytes of a block back from their packed bits; values i, i + 4, i + 8 and i + 12 share byte i at 2 bits,
+	//i and i + 8 share byte i at 4, so each value group comes out with one shift and one mask
+	inline __m128i UnpackPlane(const unsigned char* data, unsigned int bits)
+	{
+		switch (bits)
+		{
+		case 0:
+			return _mm_setzero_si128();
+		case 2:
+		{
+			int word;
+			memcpy(&word, data, 4);
+			__m128i packed = _mm_cvtsi32_si128(word);
+			__m128i mask = _mm_set1_epi8(3);
+			__m128i x0 = _mm_and_si128(packed, mask);
+			__m128i x1 = _mm_and_si128(_mm_srli_epi16(packed, 2), mask);
+			__m128i x2 = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+			__m128i x3 = _mm_and_si128(_mm_srli_epi16(packed, 6), mask);
+			return _mm_or_si128(_mm_or_si128(x0, _mm_slli_si128(x1, 4)), _mm_or_si128(_mm_slli_si128(x2, 8), _mm_slli_si128(x3, 12)));
+		}
+		case 4:
+		{
+			__m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+			__m128i mask = _mm_set1_epi8(15);
+			return _mm_or_si128(_mm_and_si128(packed, mask), _mm_slli_si128(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), 8));
+		}
+		default:
+			return Load16(data);
+		}
+	}
+
+	//zigzagged byte deltas to bytes: undo the zigzag, then a running sum over the 16 lanes on top of the byte before
+	inline __m128i DecodePlane(__m128i zigzag, unsigned char previous)
+	{
+		__m128i zero = _mm_setzero_si128();
+		__m128i negate = _mm_sub_epi8(zero, _mm_and_si128(zigzag, _mm_set1_epi8(1)));
+		__m128i x = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(zigzag, 1), _mm_set1_epi8(0x7f)), negate);
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		return _mm_add_epi8(x, _mm_set1_epi8((char)previous));
+	}
+
+	//4 planes of a block, 16 bytes each, back to 4 bytes in each of 16 vertices
+	inline void StoreQuad(const unsigned char* planes, unsigned char* out, unsigned int stride)
+	{
+		__m128i p0 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes));
+		__m128i p1 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes + 16));
+		__m128i p2 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes + 32));
+		__m128i p3 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes + 48));
+		__m128i low01 = _mm_unpacklo_epi8(p0, p1), high01 = _mm_unpackhi_epi8(p0, p1);
+		__m128i low23 = _mm_unpacklo_epi8(p2, p3), high23 = _mm_unpackhi_epi8(p2, p3);
+		__m128i quads[4] = { _mm_unpacklo_epi16(low01, low23), _mm_unpackhi_epi16(low01, low23), _mm_unpacklo_epi16(high01, high23), _mm_unpackhi_epi16(high01, high23) };
+		for (int q = 0; q < 4; q++)
+		{
+			__m128i x = quads[q];
+			for (int i = 0; i < 4; i++, x = _mm_srli_si128(x, 4))
+			{
+				int word = _mm_cvtsi128_si32(x);
+				memcpy(out + (q * 4 + i) * stride, &word, 4);
+			}
+		}
+	}
+
+	//16 zigzagged index deltas to indices on top of the index before, in previous' last lane
+	inline __m128i DecodeIndexQuad(__m128i zigzag, __m128i& previous)
+	{
+		__m128i negate = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zigzag, _mm_set1_epi32(1)));
+		__m128i x = _mm_xor_si128(_mm_srli_epi32(zigzag, 1), negate);
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi32(x, _mm_shuffle_epi32(previous, 0xff));
+		previous = x;
+		return x;
+	}
+}
+
+void QuantizeVertices(void* vertices, size_t count, const MeshVertexLayout& layout)
+{
+	unsigned char* bytes = static_cast<unsigned char*>(vertices);
+	for (uint32_t e = 0; e < layout.elementCount; e++)
+	{
+		const MeshVertexElement& element = layout.elements[e];
+		unsigned int dropped = 23 - KeptBits(element.attribute);
+		uint32_t half = 1u << (dropped - 1), mask = ~((1u << dropped) - 1);
+		for (size_t v = 0; v < count; v++)
+		{
+			unsigned char* attribute = bytes + v * layout.stride + element.offset;
+			for (uint32_t c = 0; c < element.components; c++)
+			{
+				uint32_t word;
+				memcpy(&word, attribute + c * 4, 4);
+				//infinities and nans stay as they are, rounding up may carry into the exponent like it should
+				if ((word & 0x7f800000) != 0x7f800000)
+					word = (word + half) & mask;
+				memcpy(attribute + c * 4, &word, 4);
+			}
+		}
+	}
+}
+
+void EncodeIndices(const uint32_t* indices, size_t count, std::vector<unsigned char>& out)
+{
+	uint32_t previous = 0;
+	for (size_t first = 0; first < count; first += c_blockSize)
+	{
+		//the last block is padded with repeats of its last index, which cost zero deltas
+		uint32_t zigzag[c_blockSize] = {};
+		uint32_t widest = 0;
+		for (size_t i = 0; i < c_blockSize && first + i < count; i++)
+		{
+			zigzag[i] = ZigzagIndex(indices[first + i] - previous);
+			previous = indices[first + i];
+			widest = std::max(widest, zigzag[i]);
+		}
+
+		unsigned char code = widest <= 0xff ? 0 : widest <= 0xffff ? 1 : 2;
+		unsigned int width = c_indexWidths[code];
+		out.push_back(code);
+		for (unsigned int i = 0; i < c_blockSize; i++)
+			for (unsigned int b = 0; b < width; b++)
+				out.push_back((unsigned char)(zigzag[i] >> (b * 8)));
+	}
+}
+
+bool DecodeIndices(const void* data, size_t size, uint32_t* out, size_t count)
+{
+	const unsigned char* in = static_cast<const unsigned char*>(data);
+	const unsigned char* end = in + size;
+	const __m128i zero = _mm_setzero_si128();
+	__m128i previous = zero;
+
+	for (size_t first = 0; first < count; first += c_blockSize)
+	{
+		if (in == end || *in > 2)
+			return false;
+		unsigned int width = c_indexWidths[*in++];
+		if ((size_t)(end - in) < width * c_blockSize)
+			return false;
+
+		__m128i zigzag[4];
+		if (width == 1)
+		{
+			__m128i x = Load16(in);
+			__m128i low = _mm_unpacklo_epi8(x, zero), high = _mm_unpackhi_epi8(x, zero);
+			zigzag[0] = _mm_unpacklo_epi16(low, zero);
+			zigzag[1] = _mm_unpackhi_epi16(low, zero);
+			zigzag[2] = _mm_unpacklo_epi16(high, zero);
+			zigzag[3] = _mm_unpackhi_epi16(high, zero);
+		}
+		else if (width == 2)
+		{
+			__m128i low = Load16(in), high = Load16(in + 16);
+			zigzag[0] = _mm_unpacklo_epi16(low, zero);
+			zigzag[1] = _mm_unpackhi_epi16(low, zero);
+			zigzag[2] = _mm_unpacklo_epi16(high, zero);
+			zigzag[3] = _mm_unpackhi_epi16(high, zero);
+		}
+		else
+		{
+			for (int q = 0; q < 4; q++)
+				zigzag[q] = Load16(in + q * 16);
+		}
+		in += width * c_blockSize;
+
+		if (first + c_blockSize <= count)
+		{
+			for (int q = 0; q < 4; q++)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + first + q * 4), DecodeIndexQuad(zigzag[q], previous));
+		}
+		else
+		{
+			uint32_t tail[c_blockSize];
+			for (int q = 0; q < 4; q++)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(tail + q * 4), DecodeIndexQuad(zigzag[q], previous));
+			memcpy(out + first, tail, (count - first) * sizeof(uint32_t));
+		}
+	}
+	return in == end;
+}
+
+void EncodeVertices(const void* vertices, size_t count, unsigned int stride, std::vector<unsigned char>& out)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(vertices);
+	unsigned int headerBytes = (stride + 3) / 4;
+
+	for (size_t first = 0; first < count; first += c_blockSize)
+	{
+		size_t header = out.size();
+		out.resize(header + headerBytes, 0);
+
+		for (unsigned int k = 0; k < stride; k++)
+		{
+			//the last block is padded with repeats of its last vertex, which cost zero deltas
+			unsigned char zigzag[c_blockSize] = {};
+			unsigned char previous = first ? bytes[(first - 1) * stride + k] : 0;
+			unsigned char widest = 0;
+			for (size_t i = 0; i < c_blockSize && first + i < count; i++)
+			{
+				unsigned char byte = bytes[(first + i) * stride + k];
+				zigzag[i] = ZigzagByte((unsigned char)(byte - previous));
+				previous = byte;
+				widest = std::max(widest, zigzag[i]);
+			}
+
+			unsigned int code = widest == 0 ? 0 : widest < 4 ? 1 : widest < 16 ? 2 : 3;
+			out[header + k / 4] |= (unsigned char)(code << (k % 4 * 2));
+			switch (c_planeBits[code])
+			{
+			case 2:
+				for (unsigned int i = 0; i < 4; i++)
+					out.push_back((unsigned char)(zigzag[i] | zigzag[i + 4] << 2 | zigzag[i + 8] << 4 | zigzag[i + 12] << 6));
+				break;
+			case 4:
+				for (unsigned int i = 0; i < 8; i++)
+					out.push_back((unsigned char)(zigzag[i] | zigzag[i + 8] << 4));
+				break;
+			case 8:
+				out.insert(out.end(), zigzag, zigzag + c_blockSize);
+				break;
+			}
+		}
+	}
+}
+
+bool DecodeVertices(const void* data, size_t size, void* out, size_t count, unsigned int stride)
+{
+	if (stride % 4 != 0 || stride > c_maxCodecStride)
+		return false;
+	const unsigned char* in = static_cast<const unsigned char*>(data);
+	const unsigned char* end = in + size;
+	unsigned char* vertices = static_cast<unsigned char*>(out);
+	unsigned int headerBytes = stride / 4;
+
+	//plane k of the block at planes + k * 16, the last lane of each is the byte the next block's deltas start from
+	alignas(16) unsigned char planes[c_maxCodecStride * c_blockSize] = {};
+
+	for (size_t first = 0; first < count; first += c_blockSize)
+	{
+		if ((size_t)(end - in) < headerBytes)
+			return false;
+		const unsigned char* header = in;
+		in += headerBytes;
+
+		for (unsigned int k = 0; k < stride; k++)
+		{
+			unsigned int bits = c_planeBits[(header[k / 4] >> (k % 4 * 2)) & 3];
+			unsigned int bytes = bits * c_blockSize / 8;
+			if ((size_t)(end - in) < bytes)
+				return false;
+			unsigned char* plane = planes + k * c_blockSize;
+			_mm_store_si128(reinterpret_cast<__m128i*>(plane), DecodePlane(UnpackPlane(in, bits), plane[c_blockSize - 1]));
+			in += bytes;
+		}
+
+		unsigned char* block = vertices + first * stride;
+		if (first + c_blockSize <= count)
+		{
+			for (unsigned int k = 0; k < stride; k += 4)
+				StoreQuad(planes + k * c_blockSize, block + k, stride);
+		}
+		else
+		{
+			for (size_t i = 0; first + i < count; i++)
+				for (unsigned int k = 0; k < stride; k++)
+					block[i * stride + k] = planes[k * c_blockSize + i];
+		}
+	}
+	return in == end;
+}
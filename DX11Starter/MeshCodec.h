@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MeshVertexLayout;
+
+//compression for mesh files: lossless for indices, lossy only where QuantizeVertices rounds, and decoded with SSE2 at
+//memory speed straight into the memory the gpu buffers are created from
+//  indices   each index as the zigzagged difference to the one before, in blocks of 16 stored at the narrowest of
+//            1, 2 or 4 bytes that holds the whole block
+//  vertices  every byte of the vertex is a plane across the vertices: the difference to the same byte of the vertex
+//            before, zigzagged, in blocks of 16 vertices at 0, 2, 4 or 8 bits per byte; the bytes QuantizeVertices
+//            cleared cost nothing, and smooth attributes cost a few bits in their high bytes
+//decoding gives the vertices back in their own layout, plain floats for the input layouts as they are
+
+//mantissa bits QuantizeVertices keeps of each attribute, so whole low bytes clear: positions and uvs to about
+//1 / 65000 of their size, a fraction of a texel even on the tiled terrain, normals and tangents to a quarter degree
+const unsigned int c_quantizePositionBits = 15;
+const unsigned int c_quantizeUVBits = 15;
+const unsigned int c_quantizeDirectionBits = 7;
+
+//rounds every float attribute of layout to its c_quantize bits in place, so encoding packs them tighter
+void QuantizeVertices(void* vertices, size_t count, const MeshVertexLayout& layout);
+
+//appends the encoded form to out
+void EncodeIndices(const uint32_t* indices, size_t count, std::vector<unsigned char>& out);
+void EncodeVertices(const void* vertices, size_t count, unsigned int stride, std::vector<unsigned char>& out);
+
+//false when data is cut short or was encoded for another count; the stride has to be a multiple of four
+bool DecodeIndices(const void* data, size_t size, uint32_t* out, size_t count);
+bool DecodeVertices(const void* data, size_t size, void* out, size_t count, unsigned int stride);
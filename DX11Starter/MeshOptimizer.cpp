@@ -0,0 +1,452 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const unsigned int c_none = 0xffffffff;
+
+	//Forsyth's scoring: the cache it simulates is an lru of this many, and the three vertices of the triangle just drawn
+	//score a little less than the next few so the strip does not turn back on itself
+	const unsigned int c_scoreCacheSize = 32;
+	const float c_cacheDecayPower = 1.5f;
+	const float c_lastTriangleScore = 0.75f;
+
+	//vertices with few triangles left are worth finishing off, so they do not come back as a miss later
+	const float c_valenceBoostScale = 2.0f;
+	const float c_valenceBoostPower = 0.5f;
+	const unsigned int c_maxScoredValence = 64;
+
+	//live triangles looked at per cached vertex and step: the centre of a big fan would make every step as slow as the
+	//fan is wide, and a triangle it leaves out still comes up through its other two vertices
+	const unsigned int c_maxScannedTriangles = 64;
+
+	//the fetch stats' memory: 64 byte lines in a 16 KB direct mapped cache
+	const unsigned int c_fetchLineBytes = 64;
+	const unsigned int c_fetchLines = 256;
+
+	//both score parts looked up instead of two pow per vertex per step
+	struct ScoreTables
+	{
+		float cache[c_scoreCacheSize];
+		float valence[c_maxScoredValence];
+
+		ScoreTables()
+		{
+			for (unsigned int i = 0; i < c_scoreCacheSize; i++)
+				cache[i] = i < 3 ? c_lastTriangleScore : powf(1.0f - (float)(i - 3) / (c_scoreCacheSize - 3), c_cacheDecayPower);
+			for (unsigned int i = 0; i < c_maxScoredValence; i++)
+				valence[i] = i == 0 ? 0.0f : c_valenceBoostScale * powf((float)i, -c_valenceBoostPower);
+		}
+
+		//a vertex with nothing left to draw scores nothing, so its triangles never come up again
+		float Score(unsigned int cachePosition, unsigned int liveTriangles) const
+		{
+			if (liveTriangles == 0)
+				return -1.0f;
+			float score = cachePosition < c_scoreCacheSize ? cache[cachePosition] : 0.0f;
+			return score + valence[std::min(liveTriangles, c_maxScoredValence - 1)];
+		}
+	};
+
+	//a fifo of vertex numbers, simulated by when each vertex was last transformed
+	class FifoCache
+	{
+	public:
+		FifoCache(unsigned int vertexCount, unsigned int size) : m_stamps(vertexCount, 0), m_size(size), m_time(size + 1) {}
+
+		//whether v missed and had to be transformed
+		bool Transform(unsigned int v)
+		{
+			if (m_time - m_stamps[v] <= m_size)
+				return false;
+			m_stamps[v] = m_time++;
+			return true;
+		}
+
+		//cache misses drawing the triangle
+		unsigned int Draw(const unsigned int* triangle) { return Transform(triangle[0]) + Transform(triangle[1]) + Transform(triangle[2]); }
+
+		//everything out, as at a cut between clusters
+		void Flush() { m_time += m_size + 1; }
+
+	private:
+		std::vector<unsigned int> m_stamps;
+		unsigned int m_size;
+		unsigned int m_time;
+	};
+
+	struct Cluster
+	{
+		unsigned int begin, end;
+		float order;
+	};
+}
+
+void OptimizeVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount)
+{
+	static const ScoreTables tables;
+	unsigned int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	//every vertex's corners (triangle * 3 + k), the ones still to draw first
+	std::vector<unsigned int> live(vertexCount, 0), offsets(vertexCount + 1, 0);
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+		live[indices[i]]++;
+	for (unsigned int v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	//and where every corner sits in its vertex's list, so drawing a triangle takes it out in constant time
+	std::vector<unsigned int> adjacency(offsets[vertexCount]), place(triangleCount * 3), fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+	{
+		place[i] = fill[indices[i]]++;
+		adjacency[place[i]] = i;
+	}
+
+	std::vector<unsigned int> cachePosition(vertexCount, c_none);
+	std::vector<float> vertexScore(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		vertexScore[v] = tables.Score(c_none, live[v]);
+
+	std::vector<bool> drawn(triangleCount, false);
+	unsigned int best = 0;
+	float bestScore = -1.0f;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		const unsigned int* triangle = &indices[t * 3];
+		float score = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+		if (score > bestScore)
+		{
+			bestScore = score;
+			best = t;
+		}
+	}
+
+	//the simulated lru, the triangle just drawn in front and up to three that fell out at the back
+	unsigned int cache[c_scoreCacheSize + 3], next[c_scoreCacheSize + 3];
+	unsigned int cacheCount = 0;
+
+	std::vector<unsigned int> output(triangleCount * 3);
+	unsigned int cursor = 0;
+	for (unsigned int drawnCount = 0; drawnCount < triangleCount; drawnCount++)
+	{
+		//nothing near the cache left to draw: start over from the first triangle not drawn yet, in file order
+		if (best == c_none)
+		{
+			while (drawn[cursor])
+				cursor++;
+			best = cursor;
+		}
+
+		const unsigned int* triangle = &indices[best * 3];
+		memcpy(&output[drawnCount * 3], triangle, 3 * sizeof(unsigned int));
+		drawn[best] = true;
+
+		unsigned int nextCount = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int v = triangle[k];
+
+			//swap the corner past the vertex's live ones
+			unsigned int corner = best * 3 + k;
+			unsigned int last = offsets[v] + --live[v];
+			unsigned int moved = adjacency[last];
+			adjacency[place[corner]] = moved;
+			place[moved] = place[corner];
+			adjacency[last] = corner;
+			place[corner] = last;
+
+			//a degenerate triangle names a vertex twice, the cache holds it once
+			if (k > 0 && (v == triangle[0] || (k == 2 && v == triangle[1])))
+				continue;
+			next[nextCount++] = v;
+		}
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				next[nextCount++] = v;
+		}
+
+		cacheCount = std::min(nextCount, c_scoreCacheSize);
+		for (unsigned int i = 0; i < nextCount; i++)
+		{
+			unsigned int v = next[i];
+			cachePosition[v] = i < c_scoreCacheSize ? i : c_none;
+			vertexScore[v] = tables.Score(cachePosition[v], live[v]);
+		}
+		memcpy(cache, next, cacheCount * sizeof(unsigned int));
+
+		//only the triangles around the cache changed score, so the next one to draw is among them
+		best = c_none;
+		bestScore = -1.0f;
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			const unsigned int* list = &adjacency[offsets[v]];
+			for (unsigned int j = 0, count = std::min(live[v], c_maxScannedTriangles); j < count; j++)
+			{
+				unsigned int t = list[j] / 3;
+				const unsigned int* corners = &indices[t * 3];
+				float score = vertexScore[corners[0]] + vertexScore[corners[1]] + vertexScore[corners[2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, output.data(), triangleCount * 3 * sizeof(unsigned int));
+}
+
+void OptimizeOverdraw(unsigned int* indices, unsigned int indexCount, const void* positions, unsigned int stride, unsigned int vertexCount, float threshold)
+{
+	unsigned int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+	auto position = [&](unsigned int v) { return reinterpret_cast<const float*>(static_cast<const char*>(positions) + (size_t)v * stride); };
+
+	//hard cuts: triangles that miss on all three vertices start over in the cache anyway, so nothing is lost there
+	std::vector<unsigned int> hard;
+	FifoCache cache(vertexCount, c_vertexCacheSize);
+	for (unsigned int t = 0; t < triangleCount; t++)
+		if (cache.Draw(&indices[t * 3]) == 3 || t == 0)
+			hard.push_back(t);
+	hard.push_back(triangleCount);
+
+	//soft cuts: inside every hard run, wherever the acmr since the last cut is already as good as the run's
+	std::vector<Cluster> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		unsigned int begin = hard[h], end = hard[h + 1];
+
+		cache.Flush();
+		unsigned int runMisses = 0;
+		for (unsigned int t = begin; t < end; t++)
+			runMisses += cache.Draw(&indices[t * 3]);
+		float cut = threshold * (float)runMisses / (float)(end - begin);
+
+		cache.Flush();
+		unsigned int start = begin, misses = 0;
+		for (unsigned int t = begin; t < end; t++)
+		{
+			misses += cache.Draw(&indices[t * 3]);
+			if (t + 1 < end && (float)misses <= cut * (float)(t + 1 - start))
+			{
+				clusters.push_back({ start, t + 1, 0.0f });
+				start = t + 1;
+				misses = 0;
+				cache.Flush();
+			}
+		}
+		clusters.push_back({ start, end, 0.0f });
+	}
+
+	//the middle of the mesh, over the vertices its triangles use
+	double middle[3] = { 0, 0, 0 };
+	std::vector<bool> used(vertexCount, false);
+	unsigned int usedCount = 0;
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+	{
+		unsigned int v = indices[i];
+		if (used[v])
+			continue;
+		used[v] = true;
+		usedCount++;
+		const float* p = position(v);
+		for (unsigned int c = 0; c < 3; c++)
+			middle[c] += p[c];
+	}
+	for (unsigned int c = 0; c < 3; c++)
+		middle[c] /= usedCount;
+
+	//a cluster facing away from the middle is drawn before the ones it is likely to hide; the area weighted sum of
+	//cross products faces out on the clockwise triangles direct3d draws
+	for (Cluster& cluster : clusters)
+	{
+		float centroid[3] = { 0, 0, 0 }, normal[3] = { 0, 0, 0 }, area = 0.0f;
+		for (unsigned int t = cluster.begin; t < cluster.end; t++)
+		{
+			const float* a = position(indices[t * 3]), * b = position(indices[t * 3 + 1]), * c = position(indices[t * 3 + 2]);
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				centroid[k] += (a[k] + b[k] + c[k]) * (length / 3.0f);
+				normal[k] += n[k];
+			}
+			area += length;
+		}
+
+		float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (area <= 0.0f || normalLength <= 0.0f)
+			continue;
+		float order = 0.0f;
+		for (unsigned int k = 0; k < 3; k++)
+			order += (centroid[k] / area - (float)middle[k]) * normal[k] / normalLength;
+		cluster.order = order;
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.order > b.order; });
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	for (const Cluster& cluster : clusters)
+		output.insert(output.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+	memcpy(indices, output.data(), triangleCount * 3 * sizeof(unsigned int));
+}
+
+unsigned int OptimizeVertexFetch(void* vertices, unsigned int stride, unsigned int vertexCount, unsigned int* indices, unsigned int indexCount)
+{
+	//first use order, and the order the vertices already have with the unused ones squeezed out
+	std::vector<unsigned int> firstUse(vertexCount, c_none), kept(vertexCount, c_none);
+	unsigned int used = 0;
+	for (unsigned int i = 0; i < indexCount; i++)
+	{
+		unsigned int& to = firstUse[indices[i]];
+		if (to == c_none)
+			to = used++;
+	}
+	for (unsigned int v = 0, next = 0; v < vertexCount; v++)
+		if (firstUse[v] != c_none)
+			kept[v] = next++;
+
+	std::vector<unsigned int> byFirstUse(indexCount), byKept(indexCount);
+	for (unsigned int i = 0; i < indexCount; i++)
+	{
+		byFirstUse[i] = firstUse[indices[i]];
+		byKept[i] = kept[indices[i]];
+	}
+	bool reorder = AnalyzeVertexFetch(byFirstUse.data(), indexCount, used, stride).bytesFetched <
+		AnalyzeVertexFetch(byKept.data(), indexCount, used, stride).bytesFetched;
+	const std::vector<unsigned int>& remap = reorder ? firstUse : kept;
+	memcpy(indices, (reorder ? byFirstUse : byKept).data(), (size_t)indexCount * sizeof(unsigned int));
+
+	//moved through a copy of the used ones; unused vertices keep their bytes at the back, in no particular order
+	char* bytes = static_cast<char*>(vertices);
+	std::vector<char> moved((size_t)used * stride);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		if (remap[v] != c_none)
+			memcpy(&moved[(size_t)remap[v] * stride], bytes + (size_t)v * stride, stride);
+	memcpy(bytes, moved.data(), moved.size());
+	return used;
+}
+
+unsigned int GridIndexCount(unsigned int countA, unsigned int countB)
+{
+	if (countA < 2 || countB < 2)
+		return 0;
+
+	//a band of w cells loads its w + 1 first row corners two to a degenerate triangle
+	unsigned int width = c_vertexCacheSize - 2, cellsB = countB - 1;
+	unsigned int fullBands = cellsB / width, rest = cellsB % width;
+	unsigned int primes = fullBands * ((width + 2) / 2) + (rest ? (rest + 2) / 2 : 0);
+	return 3 * primes + 6 * (countA - 1) * cellsB;
+}
+
+void BuildGridIndices(unsigned int* indices, unsigned int countA, unsigned int countB)
+{
+	if (countA < 2 || countB < 2)
+		return;
+
+	//an old corner is last used w + 1 misses after it went into the fifo, so w = c_vertexCacheSize - 2 keeps it in with
+	//one to spare
+	unsigned int width = c_vertexCacheSize - 2;
+	for (unsigned int first = 0; first + 1 < countB; first += width)
+	{
+		unsigned int last = std::min(first + width, countB - 1);
+		for (unsigned int b = first; b <= last; b += 2)
+		{
+			unsigned int next = std::min(b + 1, last);
+			*indices++ = b;
+			*indices++ = next;
+			*indices++ = next;
+		}
+
+		for (unsigned int a = 0; a + 1 < countA; a++)
+		{
+			for (unsigned int b = first; b < last; b++)
+			{
+				unsigned int corner = a * countB + b, below = corner + countB;
+				*indices++ = corner;
+				*indices++ = corner + 1;
+				*indices++ = below;
+				*indices++ = corner + 1;
+				*indices++ = below + 1;
+				*indices++ = below;
+			}
+		}
+	}
+}
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats = { 0, 0.0f, 0.0f };
+	unsigned int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return stats;
+
+	FifoCache cache(vertexCount, cacheSize);
+	for (unsigned int t = 0; t < triangleCount; t++)
+		stats.transformed += cache.Draw(&indices[t * 3]);
+
+	std::vector<bool> used(vertexCount, false);
+	unsigned int usedCount = 0;
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+	{
+		usedCount += !used[indices[i]];
+		used[indices[i]] = true;
+	}
+
+	stats.acmr = (float)stats.transformed / triangleCount;
+	stats.atvr = (float)stats.transformed / usedCount;
+	return stats;
+}
+
+VertexFetchStats AnalyzeVertexFetch(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount, unsigned int stride)
+{
+	VertexFetchStats stats = { 0, 0.0f };
+	unsigned int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return stats;
+
+	//only a vertex missing in the post transform cache is fetched
+	FifoCache transform(vertexCount, c_vertexCacheSize);
+	std::vector<size_t> lines(c_fetchLines, (size_t)-1);
+	std::vector<bool> used(vertexCount, false);
+	unsigned int usedCount = 0;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t * 3 + k];
+			usedCount += !used[v];
+			used[v] = true;
+
+			if (!transform.Transform(v))
+				continue;
+			size_t first = (size_t)v * stride / c_fetchLineBytes, last = ((size_t)v * stride + stride - 1) / c_fetchLineBytes;
+			for (size_t line = first; line <= last; line++)
+			{
+				size_t& slot = lines[line % c_fetchLines];
+				if (slot != line)
+				{
+					slot = line;
+					stats.bytesFetched += c_fetchLineBytes;
+				}
+			}
+		}
+	}
+
+	stats.overfetch = (float)stats.bytesFetched / ((float)usedCount * stride);
+	return stats;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+
+//index and vertex order for the gpu: how often a vertex is transformed again after it fell out of the post transform
+//cache, how much is drawn behind what is already on screen, and how much of the vertex buffer every fetch drags in
+//everything works on 32 bit triangle lists and positions at a stride, so it runs on any vertex type, at load time
+//through Mesh::Optimize or headless in MeshBench
+
+//the post transform cache the reorder aims at and the stats assume: a 16 entry fifo is about what hardware gives a
+//vertex of a few float4 outputs
+const unsigned int c_vertexCacheSize = 16;
+
+//reorders the triangles so their vertices are reused while still in the cache: Forsyth's linear speed heuristic,
+//which keeps taking the triangle whose vertices are recent in a simulated cache or have few triangles left to draw
+void OptimizeVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount);
+
+//keeps a cache friendly order but draws clusters of it facing out from the middle of the mesh first, so the rest is
+//more likely to fail the depth test (Sander, Nehab and Barczak); clusters are cut where the cache starts over anyway, or
+//where the acmr so far is within threshold of the whole run's, so threshold 1.05 costs at most 5% of the cache gain
+//positions are three floats every stride bytes
+void OptimizeOverdraw(unsigned int* indices, unsigned int indexCount, const void* positions, unsigned int stride, unsigned int vertexCount, float threshold = 1.05f);
+
+//renumbers the vertices in the order the indices first use them and moves them there, so fetches walk the buffer
+//forward; when AnalyzeVertexFetch says that reads more than the order they already have (a grid laid out along its
+//rows, say), they keep that order instead; returns how many are used, and those come first
+unsigned int OptimizeVertexFetch(void* vertices, unsigned int stride, unsigned int vertexCount, unsigned int* indices, unsigned int indexCount);
+
+//generated grids need none of the passes above: corner (a, b) of a countA x countB grid at vertex a * countB + b, cells
+//in bands c_vertexCacheSize - 2 wide along b, each walked row by row along a, so every row reuses the one before from
+//the cache and reads its vertices in a run; a band starts with degenerate triangles that load its first row, which
+//the rasterizer drops (acmr 0.54 and overfetch 1.17 on a 1000 x 1000 grid, where the passes get 0.67 and 1.5)
+unsigned int GridIndexCount(unsigned int countA, unsigned int countB);
+
+//writes GridIndexCount(countA, countB) indices, two triangles a cell wound (a, b) (a, b + 1) (a + 1, b)
+void BuildGridIndices(unsigned int* indices, unsigned int countA, unsigned int countB);
+
+struct VertexCacheStats
+{
+	//vertex shader runs in a fifo of the given size
+	unsigned int transformed;
+
+	//average cache miss ratio, runs per triangle: 3 at worst, about 0.5 on big smooth meshes
+	float acmr;
+
+	//average transform to vertex ratio, runs per used vertex: 1 is every vertex once
+	float atvr;
+};
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount, unsigned int cacheSize = c_vertexCacheSize);
+
+struct VertexFetchStats
+{
+	//64 byte lines read from memory by the transformed vertices, through a small direct mapped cache
+	size_t bytesFetched;
+
+	//bytesFetched over the bytes of the used vertices: 1 is every byte once
+	float overfetch;
+};
+VertexFetchStats AnalyzeVertexFetch(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount, unsigned int stride);
@@ -0,0 +1,159 @@
+#include "MeshSampler.h"
+
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+#include "ParticleRandom.h"
+
+namespace
+{
+	//points picked ahead of reading their triangles
+	const unsigned int c_sampleBatch = 64;
+}
+
+MeshSampler::MeshSampler(const void* positions, unsigned int stride, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount)
+{
+	auto position = [&](unsigned int vertex)
+	{
+		return reinterpret_cast<const float*>(static_cast<const char*>(positions) + (size_t)vertex * stride);
+	};
+
+	unsigned int triangleCount = indexCount / 3;
+	m_triangles.resize(triangleCount);
+	std::vector<double> areas(triangleCount);
+	double total = 0.0;
+
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		const float* a = position(indices[t * 3]);
+		const float* b = position(indices[t * 3 + 1]);
+		const float* c = position(indices[t * 3 + 2]);
+
+		SurfaceTriangle& triangle = m_triangles[t];
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			triangle.corner[axis] = a[axis];
+			triangle.edge1[axis] = b[axis] - a[axis];
+			triangle.edge2[axis] = c[axis] - a[axis];
+		}
+		triangle.padding = 0.0f;
+
+		//half the length of the edges' cross product, in double so long thin triangles on big meshes keep their share
+		double e1[3] = { triangle.edge1[0], triangle.edge1[1], triangle.edge1[2] };
+		double e2[3] = { triangle.edge2[0], triangle.edge2[1], triangle.edge2[2] };
+		double cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		areas[t] = 0.5 * std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+		total += areas[t];
+	}
+
+	m_area = (float)total;
+
+	//nothing to spread over: one degenerate triangle on the first vertex keeps sampling branch free
+	if (!(total > 0.0))
+	{
+		m_triangles.assign(1, SurfaceTriangle());
+		if (vertexCount > 0)
+			memcpy(m_triangles[0].corner, position(0), sizeof(float) * 3);
+		triangleCount = 1;
+		areas.assign(1, 1.0);
+		total = 1.0;
+	}
+
+	//vose's alias method: every column starts with its area times count / total, an average of one
+	//columns under one are topped up from a column over one, which then goes back on the matching list
+	std::vector<double> scaled(triangleCount);
+	std::vector<uint32_t> light, heavy;
+	light.reserve(triangleCount);
+	heavy.reserve(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		scaled[t] = areas[t] * triangleCount / total;
+		(scaled[t] < 1.0 ? light : heavy).push_back(t);
+	}
+
+	while (!light.empty() && !heavy.empty())
+	{
+		uint32_t under = light.back();
+		light.pop_back();
+		uint32_t over = heavy.back();
+
+		m_triangles[under].threshold = (float)scaled[under];
+		m_triangles[under].alias = over;
+
+		scaled[over] -= 1.0 - scaled[under];
+		if (scaled[over] < 1.0)
+		{
+			heavy.pop_back();
+			light.push_back(over);
+		}
+	}
+
+	//whatever is left is one up to rounding and always keeps itself
+	for (uint32_t t : heavy)
+	{
+		m_triangles[t].threshold = 1.0f;
+		m_triangles[t].alias = t;
+	}
+	for (uint32_t t : light)
+	{
+		m_triangles[t].threshold = 1.0f;
+		m_triangles[t].alias = t;
+	}
+
+	//a triangle's corners bound every point on it
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		m_bounds.min[axis] = m_triangles[0].corner[axis];
+		m_bounds.max[axis] = m_triangles[0].corner[axis];
+	}
+	for (const SurfaceTriangle& triangle : m_triangles)
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float corners[3] = { triangle.corner[axis], triangle.corner[axis] + triangle.edge1[axis], triangle.corner[axis] + triangle.edge2[axis] };
+			for (float corner : corners)
+			{
+				if (corner < m_bounds.min[axis]) m_bounds.min[axis] = corner;
+				if (corner > m_bounds.max[axis]) m_bounds.max[axis] = corner;
+			}
+		}
+	}
+}
+
+void MeshSampler::PointOn(const SurfaceTriangle& triangle, float u, float v, float* out)
+{
+	//sqrt(u) folds the unit square onto the triangle with even density
+	float root = std::sqrt(u);
+	float s = root * (1.0f - v);
+	float t = root * v;
+	for (unsigned int axis = 0; axis < 3; axis++)
+		out[axis] = triangle.corner[axis] + s * triangle.edge1[axis] + t * triangle.edge2[axis];
+}
+
+void MeshSampler::Sample(uint32_t word, float coin, float u, float v, float out[3]) const
+{
+	PointOn(m_triangles[PickTriangle(word, coin)], u, v, out);
+}
+
+void MeshSampler::Sample(const uint32_t* words, const uint32_t* coins, const float* u, const float* v, unsigned int count, float* out) const
+{
+	unsigned int picked[c_sampleBatch];
+
+	for (unsigned int first = 0; first < count; first += c_sampleBatch)
+	{
+		unsigned int batch = count - first < c_sampleBatch ? count - first : c_sampleBatch;
+
+		//the column reads do not depend on each other so their misses overlap, and an aliased triangle is on its way before use
+		for (unsigned int n = 0; n < batch; n++)
+		{
+			picked[n] = PickTriangle(words[first + n], RandomUnitFloat(coins[first + n]));
+			const char* triangle = reinterpret_cast<const char*>(&m_triangles[picked[n]]);
+			_mm_prefetch(triangle, _MM_HINT_T0);
+			_mm_prefetch(triangle + sizeof(SurfaceTriangle) - 1, _MM_HINT_T0);
+		}
+
+		for (unsigned int n = 0; n < batch; n++)
+			PointOn(m_triangles[picked[n]], u[first + n], v[first + n], out + (size_t)(first + n) * 3);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ParticleBounds.h"
+
+//uniformly random points on the surface of a triangle mesh, for emitters that spawn on a mesh
+//built once per mesh: a Walker alias table over the triangle areas picks a triangle with one lookup and one compare,
+//and every triangle is kept as a corner and two edges, so a sample costs the same for ten triangles or a million
+class MeshSampler
+{
+public:
+	//three float positions every stride bytes from positions, and indexCount / 3 triangles
+	//triangles with zero area are never picked; a mesh with no area at all samples its first vertex
+	MeshSampler(const void* positions, unsigned int stride, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount);
+
+	//triangle picked with probability proportional to its area from a full 32 bit random word and a coin in [0, 1)
+	unsigned int PickTriangle(uint32_t word, float coin) const
+	{
+		//the word scaled into [0, count) keeps every column equally likely, which word % count would not
+		unsigned int column = (unsigned int)(((uint64_t)word * m_triangles.size()) >> 32);
+		const SurfaceTriangle& entry = m_triangles[column];
+		return coin < entry.threshold ? column : entry.alias;
+	}
+
+	//point on the mesh in its own space: the triangle from word and coin, then u and v in [0, 1) spread over it uniformly
+	void Sample(uint32_t word, float coin, float u, float v, float out[3]) const;
+
+	//count points at once into out as x, y, z each, the coins as raw words (RandomUnitFloat of them)
+	//picks every triangle before reading any, so on meshes bigger than the cache the misses overlap
+	void Sample(const uint32_t* words, const uint32_t* coins, const float* u, const float* v, unsigned int count, float* out) const;
+
+	unsigned int GetTriangleCount() const { return (unsigned int)m_triangles.size(); }
+	float GetSurfaceArea() const { return m_area; }
+
+	//box around every point Sample can return
+	const ParticleBounds& GetBounds() const { return m_bounds; }
+
+private:
+	//a triangle as a corner and two edges, and its alias table column: the column keeps itself below threshold and hands
+	//the rest of its share to alias, so the usual pick is one record and one cache miss on a big mesh
+	struct SurfaceTriangle
+	{
+		float corner[3];
+		float threshold;
+		float edge1[3];
+		uint32_t alias;
+		float edge2[3];
+		float padding;
+	};
+	std::vector<SurfaceTriangle> m_triangles;
+
+	static void PointOn(const SurfaceTriangle& triangle, float u, float v, float* out);
+
+	float m_area;
+	ParticleBounds m_bounds;
+};
@@ -0,0 +1,604 @@
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "JobSystem.h"
+#include "MappedFile.h"
+
+namespace
+{
+	//chunks are at least this big, so small files are one chunk and never touch the jobs
+	const size_t c_minChunkBytes = 1 << 20;
+
+	//chunks per thread, so one chunk dense with faces does not hold up the rest
+	const unsigned int c_chunksPerThread = 4;
+
+	//bytes past any newline the scanners may load; the end of the file is parsed from a copy padded this much
+	const size_t c_readSlack = 64;
+
+	//every power of ten a double holds exactly: a mantissa under 2^53 times or over one of these rounds only once
+	const double c_exactPowers[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const int c_maxExactPower = 22;
+
+	//a mantissa takes no more digits once it reaches this, so it stays under 2^53 and converts to double exactly
+	const uint64_t c_maxMantissa = 100000000000000ull;
+
+	//every line handed to the parsers ends in a newline, which is neither a space nor a digit,
+	//so none of the loops below needs an end pointer
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	inline bool IsDigit(char c) { return (unsigned char)(c - '0') < 10; }
+	inline bool IsLineEnd(char c) { return c == '\n' || c == '#'; }
+
+	inline unsigned int LowestBit(unsigned int mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	inline unsigned int PopCount(unsigned int v)
+	{
+		v = v - ((v >> 1) & 0x55555555);
+		v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+		return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+	}
+
+	inline __m128i Load16(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+	//just past the newline ending the line p is in, sixteen bytes at a time
+	inline const char* NextLine(const char* p)
+	{
+		const __m128i newline = _mm_set1_epi8('\n');
+		for (;; p += 16)
+		{
+			unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(Load16(p), newline));
+			if (mask)
+				return p + LowestBit(mask) + 1;
+		}
+	}
+
+	enum LineKind { Line_Other, Line_Position, Line_UV, Line_Normal, Line_Face };
+
+	//what the line at p holds, with p moved past its keyword
+	inline LineKind Classify(const char*& p)
+	{
+		while (IsSpace(*p))
+			p++;
+
+		if (p[0] == 'v')
+		{
+			if (IsSpace(p[1])) { p += 1; return Line_Position; }
+			if (!IsSpace(p[2])) return Line_Other;
+			if (p[1] == 't') { p += 2; return Line_UV; }
+			if (p[1] == 'n') { p += 2; return Line_Normal; }
+			return Line_Other;
+		}
+		if (p[0] == 'f' && IsSpace(p[1])) { p += 1; return Line_Face; }
+		return Line_Other;
+	}
+
+	//corners on a face line after the keyword: words up to the newline or a comment, sixteen bytes at a time
+	inline unsigned int CountCorners(const char* p)
+	{
+		const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), carriage = _mm_set1_epi8('\r');
+		const __m128i newline = _mm_set1_epi8('\n'), hash = _mm_set1_epi8('#');
+
+		//the keyword is always followed by a space
+		unsigned int corners = 0, previousSpace = 1;
+		for (;; p += 16)
+		{
+			__m128i block = Load16(p);
+			unsigned int spaces = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)), _mm_cmpeq_epi8(block, carriage)));
+			unsigned int stops = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, newline), _mm_cmpeq_epi8(block, hash)));
+
+			//a word starts on a byte that is not a space right after one that is
+			unsigned int starts = ~spaces & ((spaces << 1) | previousSpace) & 0xffff;
+			if (stops)
+				return corners + PopCount(starts & ((stops & (0u - stops)) - 1));
+
+			corners += PopCount(starts);
+			previousSpace = spaces >> 15;
+		}
+	}
+
+	//anything the fast path does not take (nan, inf, hex, 16+ digit mantissas, big exponents) through strtof on a
+	//terminated copy; returns p when there is no number there
+	const char* ParseFloatSlow(const char* p, float& out)
+	{
+		char buffer[64];
+		size_t length = 0;
+		while (length + 1 < sizeof(buffer) && !IsSpace(p[length]) && !IsLineEnd(p[length]))
+			length++;
+		memcpy(buffer, p, length);
+		buffer[length] = '\0';
+
+		char* stop;
+		out = strtof(buffer, &stop);
+		return p + (stop - buffer);
+	}
+
+	//from_chars style: no locale, no terminator and no allocation
+	//the mantissa is gathered as an integer and scaled by an exact power of ten in double, one rounding to float after
+	inline const char* ParseFloat(const char* p, float& out)
+	{
+		const char* start = p;
+		bool negative = *p == '-';
+		if (*p == '-' || *p == '+')
+			p++;
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		bool tooLong = false;
+		const char* digits = p;
+		for (; IsDigit(*p); p++)
+		{
+			if (mantissa < c_maxMantissa) mantissa = mantissa * 10 + (*p - '0');
+			else tooLong = true;
+		}
+		bool any = p > digits;
+
+		if (*p == '.')
+		{
+			const char* fraction = ++p;
+			for (; IsDigit(*p); p++)
+			{
+				if (mantissa < c_maxMantissa) { mantissa = mantissa * 10 + (*p - '0'); exponent--; }
+				else tooLong = true;
+			}
+			any |= p > fraction;
+		}
+		if (!any)
+			return ParseFloatSlow(start, out);
+
+		//an 'e' without digits after it is not part of the number
+		if (*p == 'e' || *p == 'E')
+		{
+			const char* e = p + 1;
+			bool negativeExponent = *e == '-';
+			if (*e == '-' || *e == '+')
+				e++;
+			if (IsDigit(*e))
+			{
+				int value = 0;
+				for (; IsDigit(*e); e++)
+					value = value < 10000 ? value * 10 + (*e - '0') : value;
+				exponent += negativeExponent ? -value : value;
+				p = e;
+			}
+		}
+
+		if (tooLong || exponent < -c_maxExactPower || exponent > c_maxExactPower)
+			return ParseFloatSlow(start, out);
+
+		double value = (double)mantissa;
+		value = exponent < 0 ? value / c_exactPowers[-exponent] : value * c_exactPowers[exponent];
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	//count floats off a v, vt or vn line into out, zero for any the line leaves off; false on something that is not a number
+	inline bool ParseFloats(const char* p, float* out, unsigned int count)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			while (IsSpace(*p))
+				p++;
+			if (IsLineEnd(*p))
+			{
+				for (; i < count; i++)
+					out[i] = 0.0f;
+				return true;
+			}
+
+			const char* next = ParseFloat(p, out[i]);
+			if (next == p)
+				return false;
+			p = next;
+		}
+		return true;
+	}
+
+	//one index of a corner, 1 based or negative back from the last one defined, to zero based
+	//an empty slot is c_objNone; false when the index is zero or outside the file
+	inline bool ParseIndex(const char*& p, size_t defined, size_t total, uint32_t& out)
+	{
+		bool negative = *p == '-';
+		if (negative)
+			p++;
+
+		const char* digits = p;
+		uint64_t value = 0;
+		for (; IsDigit(*p); p++)
+			value = value < (1ull << 40) ? value * 10 + (*p - '0') : value;
+		if (p == digits)
+		{
+			out = c_objNone;
+			return !negative;
+		}
+
+		int64_t index = negative ? (int64_t)defined - (int64_t)value : (int64_t)value - 1;
+		out = (uint32_t)index;
+		return value != 0 && index >= 0 && (uint64_t)index < total;
+	}
+
+	//counts of every kind of line, and the lines themselves for error messages
+	struct ObjCounts
+	{
+		size_t positions = 0, uvs = 0, normals = 0, triangles = 0, lines = 0;
+	};
+
+	struct ObjChunk
+	{
+		//whole lines, the last one included up to its newline
+		const char* begin, * end;
+
+		//what the first pass found in the chunk, and where the chunk's output starts: the counts of all chunks before
+		ObjCounts counts, first;
+
+		std::string error;
+	};
+
+	//a corner as v, v/vt, v//vn or v/vt/vn
+	inline bool ParseCorner(const char*& p, const ObjCounts& defined, const ObjCounts& total, ObjCorner& out)
+	{
+		if (!ParseIndex(p, defined.positions, total.positions, out.position) || out.position == c_objNone)
+			return false;
+
+		out.uv = out.normal = c_objNone;
+		if (*p == '/')
+		{
+			p++;
+			if (!ParseIndex(p, defined.uvs, total.uvs, out.uv))
+				return false;
+			if (*p == '/')
+			{
+				p++;
+				if (!ParseIndex(p, defined.normals, total.normals, out.normal))
+					return false;
+			}
+		}
+		return IsSpace(*p) || IsLineEnd(*p);
+	}
+
+	//first pass: only line starts and face words are looked at
+	void CountChunk(ObjChunk& chunk)
+	{
+		ObjCounts& counts = chunk.counts;
+		for (const char* line = chunk.begin; line < chunk.end; line = NextLine(line))
+		{
+			counts.lines++;
+
+			const char* p = line;
+			switch (Classify(p))
+			{
+			case Line_Position: counts.positions++; break;
+			case Line_UV: counts.uvs++; break;
+			case Line_Normal: counts.normals++; break;
+			case Line_Face:
+			{
+				unsigned int corners = CountCorners(p);
+				counts.triangles += corners > 2 ? corners - 2 : 0;
+				break;
+			}
+			default: break;
+			}
+		}
+	}
+
+	//second pass: the same lines parsed into the chunk's own part of the arrays, so chunks never share a write
+	void ParseChunk(ObjChunk& chunk, const ObjCounts& total, ObjData& out)
+	{
+		float* position = out.positions.data() + chunk.first.positions * 3;
+		float* uv = out.uvs.data() + chunk.first.uvs * 2;
+		float* normal = out.normals.data() + chunk.first.normals * 3;
+		ObjCorner* corner = out.corners.data() + chunk.first.triangles * 3;
+
+		//what is defined before the current line, for relative indices
+		ObjCounts defined = chunk.first;
+
+		for (const char* line = chunk.begin; line < chunk.end; )
+		{
+			defined.lines++;
+
+			const char* p = line;
+			bool valid = true;
+			switch (Classify(p))
+			{
+			case Line_Position:
+				valid = ParseFloats(p, position, 3);
+				position += 3;
+				defined.positions++;
+				break;
+
+			case Line_UV:
+				valid = ParseFloats(p, uv, 2);
+				uv += 2;
+				defined.uvs++;
+				break;
+
+			case Line_Normal:
+				valid = ParseFloats(p, normal, 3);
+				normal += 3;
+				defined.normals++;
+				break;
+
+			case Line_Face:
+			{
+				//a fan around the first corner: (first, previous, current) for every corner after the second
+				ObjCorner first = {}, previous = {}, current;
+				unsigned int corners = 0;
+				for (;;)
+				{
+					while (IsSpace(*p))
+						p++;
+					if (IsLineEnd(*p))
+						break;
+
+					if (!ParseCorner(p, defined, total, current))
+					{
+						valid = false;
+						break;
+					}
+					if (corners >= 2)
+					{
+						corner[0] = first;
+						corner[1] = previous;
+						corner[2] = current;
+						corner += 3;
+					}
+					if (corners == 0)
+						first = current;
+					previous = current;
+					corners++;
+				}
+				break;
+			}
+
+			default:
+				break;
+			}
+
+			//usually the newline is right at p
+			const char* next = NextLine(p);
+			if (!valid)
+			{
+				const char* lineEnd = next - 1;
+				while (lineEnd > line && IsSpace(lineEnd[-1]))
+					lineEnd--;
+				chunk.error = "line " + std::to_string(defined.lines) + ": '" + std::string(line, std::min<size_t>(lineEnd - line, 80)) + "' is not valid obj";
+				return;
+			}
+			line = next;
+		}
+	}
+
+	//count line aligned pieces of [text, end) of about the same size, end just past a newline
+	void SplitChunks(const char* text, const char* end, size_t count, std::vector<ObjChunk>& chunks)
+	{
+		size_t length = end - text;
+		const char* begin = text;
+		for (size_t k = 1; k <= count && begin < end; k++)
+		{
+			const char* cut = k < count ? std::max(text + length / count * k, begin) : end;
+			cut = cut < end ? NextLine(cut) : end;
+
+			ObjChunk chunk;
+			chunk.begin = begin;
+			chunk.end = cut;
+			chunks.push_back(chunk);
+			begin = cut;
+		}
+	}
+
+	template <typename Work>
+	void ForEachChunk(std::vector<ObjChunk>& chunks, JobSystem* jobs, const Work& work)
+	{
+		if (!jobs || chunks.size() < 2)
+		{
+			for (ObjChunk& chunk : chunks)
+				work(chunk);
+			return;
+		}
+
+		JobGroup group;
+		jobs->ParallelFor(group, (unsigned int)chunks.size(), 1, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+				work(chunks[i]);
+		});
+		jobs->Wait(group);
+	}
+
+	//numbers the distinct keys among count in order of first use: remap[i] is the number of key i, first[n] where number n
+	//was first seen; sameKey(i, j) compares two keys by their place in the input
+	//the open addressing table holds numbers, not keys, so a slot is 4 bytes whatever the key; it starts at a slot per key
+	//and doubles whenever it gets half full, so a probe rarely goes past two slots
+	template <typename Hash, typename SameKey>
+	void NumberKeys(size_t count, const Hash& hash, const SameKey& sameKey, ObjArray<uint32_t>& remap, ObjArray<uint32_t>& first)
+	{
+		remap.resize(count);
+		first.clear();
+
+		unsigned int bits = 4;
+		while (((size_t)1 << bits) < count)
+			bits++;
+		std::vector<uint32_t> table((size_t)1 << bits, c_objNone);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t mask = (uint32_t)(table.size() - 1);
+			uint32_t slot = hash(i) >> (32 - bits);
+			while (table[slot] != c_objNone && !sameKey(i, first[table[slot]]))
+				slot = (slot + 1) & mask;
+
+			if (table[slot] != c_objNone)
+			{
+				remap[i] = table[slot];
+				continue;
+			}
+			remap[i] = table[slot] = (uint32_t)first.size();
+			first.push_back((uint32_t)i);
+
+			if (first.size() * 2 > table.size())
+			{
+				bits++;
+				mask = mask * 2 + 1;
+				table.assign((size_t)1 << bits, c_objNone);
+				for (uint32_t n = 0; n < first.size(); n++)
+				{
+					slot = hash(first[n]) >> (32 - bits);
+					while (table[slot] != c_objNone)
+						slot = (slot + 1) & mask;
+					table[slot] = n;
+				}
+			}
+		}
+	}
+
+	inline uint32_t HashWords(const uint32_t* words, unsigned int count)
+	{
+		uint32_t hash = 0;
+		for (unsigned int i = 0; i < count; i++)
+			hash = (hash + words[i]) * 0x9e3779b1u;
+		return hash ^ (hash >> 15);
+	}
+
+	//for every element of an attribute array, the first element with the very same bits, so an exporter writing
+	//the same normal once per face still gives corners that weld
+	void FoldCopies(const ObjArray<float>& values, unsigned int width, ObjArray<uint32_t>& canonical)
+	{
+		const uint32_t* words = reinterpret_cast<const uint32_t*>(values.data());
+		ObjArray<uint32_t> first;
+		NumberKeys(values.size() / width,
+			[&](size_t i) { return HashWords(words + i * width, width); },
+			[&](size_t i, size_t j) { return memcmp(words + i * width, words + j * width, width * sizeof(uint32_t)) == 0; },
+			canonical, first);
+		for (uint32_t& index : canonical)
+			index = first[index];
+	}
+
+	inline uint32_t Fold(const ObjArray<uint32_t>& canonical, uint32_t index) { return index == c_objNone ? c_objNone : canonical[index]; }
+}
+
+bool ParseObj(const char* text, size_t length, ObjData& out, std::string& error, JobSystem* jobs)
+{
+	//the lines ending within c_readSlack of the end go in a copy with a newline and padding after them,
+	//every other line already has its newline and the slack after it in the text
+	size_t tail = length > c_readSlack ? length - c_readSlack : 0;
+	while (tail > 0 && text[tail - 1] != '\n')
+		tail--;
+	std::string padded(text + tail, length - tail);
+	padded.append(1, '\n');
+	padded.append(c_readSlack, '\0');
+
+	size_t threads = jobs ? jobs->GetWorkerCount() + 1 : 1;
+	size_t chunkCount = std::min(tail / c_minChunkBytes + 1, threads * c_chunksPerThread);
+	std::vector<ObjChunk> chunks;
+	SplitChunks(text, text + tail, chunkCount, chunks);
+	SplitChunks(padded.data(), padded.data() + (length - tail) + 1, 1, chunks);
+
+	ForEachChunk(chunks, jobs, CountChunk);
+
+	//every chunk's output starts where the ones before it end
+	ObjCounts total;
+	for (ObjChunk& chunk : chunks)
+	{
+		chunk.first = total;
+		total.positions += chunk.counts.positions;
+		total.uvs += chunk.counts.uvs;
+		total.normals += chunk.counts.normals;
+		total.triangles += chunk.counts.triangles;
+		total.lines += chunk.counts.lines;
+	}
+
+	if (std::max(std::max(total.positions, total.uvs), total.normals) >= c_objNone || total.triangles * 3 >= c_objNone)
+	{
+		error = "too much geometry for 32 bit indices";
+		return false;
+	}
+
+	out.positions.resize(total.positions * 3);
+	out.uvs.resize(total.uvs * 2);
+	out.normals.resize(total.normals * 3);
+	out.corners.resize(total.triangles * 3);
+
+	ForEachChunk(chunks, jobs, [&](ObjChunk& chunk) { ParseChunk(chunk, total, out); });
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (!chunk.error.empty())
+		{
+			error = chunk.error;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LoadObj(const char* path, ObjData& out, std::string& error, JobSystem* jobs)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+	return ParseObj(file.GetData(), file.GetSize(), out, error, jobs);
+}
+
+void WeldObj(ObjData& obj, ObjArray<ObjCorner>& unique, ObjArray<uint32_t>& remap, JobSystem* jobs)
+{
+	//the three attribute arrays fold independently
+	ObjArray<uint32_t> positions, uvs, normals;
+	auto fold = [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			if (i == 0) FoldCopies(obj.positions, 3, positions);
+			if (i == 1) FoldCopies(obj.uvs, 2, uvs);
+			if (i == 2) FoldCopies(obj.normals, 3, normals);
+		}
+	};
+	if (jobs)
+	{
+		JobGroup group;
+		jobs->ParallelFor(group, 3, 1, fold);
+		jobs->Wait(group);
+	}
+	else
+	{
+		fold(0, 3);
+	}
+
+	ObjArray<ObjCorner>& corners = obj.corners;
+	for (ObjCorner& corner : corners)
+	{
+		corner.position = positions[corner.position];
+		corner.uv = Fold(uvs, corner.uv);
+		corner.normal = Fold(normals, corner.normal);
+	}
+
+	ObjArray<uint32_t> first;
+	NumberKeys(corners.size(),
+		[&](size_t i) { return HashWords(&corners[i].position, 3); },
+		[&](size_t i, size_t j) { return corners[i].position == corners[j].position && corners[i].uv == corners[j].uv && corners[i].normal == corners[j].normal; },
+		remap, first);
+
+	unique.resize(first.size());
+	for (size_t n = 0; n < first.size(); n++)
+		unique[n] = corners[first[n]];
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class JobSystem;
+
+//what a face corner leaves out, as in "f 1//3" or "f 1 2 3"
+const uint32_t c_objNone = 0xffffffff;
+
+//one face corner: zero based indices into the position, uv and normal arrays, negative (relative) indices resolved
+struct ObjCorner
+{
+	uint32_t position, uv, normal;
+};
+
+//leaves the elements a resize adds uninitialized, so sizing the arrays up front does not write them all twice
+template <typename T>
+struct ObjAllocator : std::allocator<T>
+{
+	template <typename U> struct rebind { typedef ObjAllocator<U> other; };
+
+	ObjAllocator() = default;
+	template <typename U> ObjAllocator(const ObjAllocator<U>&) {}
+
+	template <typename U> void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+	template <typename U, typename... Args> void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+};
+template <typename T> using ObjArray = std::vector<T, ObjAllocator<T>>;
+
+//the geometry of an obj file as written, nothing converted or welded
+struct ObjData
+{
+	ObjArray<float> positions;	//x, y, z each
+	ObjArray<float> uvs;		//u, v each
+	ObjArray<float> normals;	//x, y, z each
+
+	//three per triangle, polygons fanned out from their first corner
+	ObjArray<ObjCorner> corners;
+};
+
+//parses obj text: v, vt, vn and f lines, everything else (groups, materials, comments) is skipped
+//a first pass counts every kind of line so the arrays are sized once, then a second pass parses straight into them
+//with jobs the text is cut into line aligned chunks and both passes run on every chunk in parallel
+bool ParseObj(const char* text, size_t length, ObjData& out, std::string& error, JobSystem* jobs = nullptr);
+
+//memory maps the file and parses it in place
+bool LoadObj(const char* path, ObjData& out, std::string& error, JobSystem* jobs = nullptr);
+
+//turns the corners into an indexed mesh: unique holds the distinct corners in order of first use, remap the number of
+//every corner among them, so shared vertices are written once
+//corners only share a vertex when position, uv and normal all match; attribute copies with the very same bits count
+//as one first (the corners in obj are rewritten to the first copy), then an open addressing table keyed on the whole
+//index triple finds the repeats
+void WeldObj(ObjData& obj, ObjArray<ObjCorner>& unique, ObjArray<uint32_t>& remap, JobSystem* jobs = nullptr);
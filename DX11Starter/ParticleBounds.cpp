@@ -0,0 +1,69 @@
+#include "ParticleBounds.h"
+#include <algorithm>
+
+namespace
+{
+	//lowest value of v t + a t^2 / 2 over [0, lifeTime], the vertex of the parabola only matters when it lies inside
+	float LowestOffset(float v, float a, float lifeTime)
+	{
+		float lowest = std::min(0.0f, (v + 0.5f * a * lifeTime) * lifeTime);
+		if (a > 0.0f)
+		{
+			float t = -v / a;
+			if (t > 0.0f && t < lifeTime)
+				lowest = std::min(lowest, (v + 0.5f * a * t) * t);
+		}
+		return lowest;
+	}
+}
+
+ParticleBounds ComputeParticleBounds(const ParticleMotion& m)
+{
+	//a corner of a rotated billboard sits up to size * sqrt(2) from the center, along any direction
+	const float pad = m.maxSize * 1.41421356f;
+
+	ParticleBounds bounds;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		//the lowest path leaves with the lowest velocity, the highest one is the mirror image
+		float lowest = LowestOffset(m.startVel[axis] - m.velRange[axis], m.acc[axis], m.lifeTime);
+		float highest = -LowestOffset(-(m.startVel[axis] + m.velRange[axis]), -m.acc[axis], m.lifeTime);
+
+		bounds.min[axis] = m.origin[axis] - m.posRange[axis] + lowest - pad;
+		bounds.max[axis] = m.origin[axis] + m.posRange[axis] + highest + pad;
+	}
+	return bounds;
+}
+
+ViewFrustum ExtractViewFrustum(const float m[4][4])
+{
+	//with row vectors clip = p * m, so every plane is a sum of columns of m
+	ViewFrustum frustum;
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		frustum.planes[0][i] = m[i][3] + m[i][0];	//left
+		frustum.planes[1][i] = m[i][3] - m[i][0];	//right
+		frustum.planes[2][i] = m[i][3] + m[i][1];	//bottom
+		frustum.planes[3][i] = m[i][3] - m[i][1];	//top
+		frustum.planes[4][i] = m[i][2];				//near
+		frustum.planes[5][i] = m[i][3] - m[i][2];	//far
+	}
+	return frustum;
+}
+
+bool IntersectsFrustum(const ParticleBounds& bounds, const ViewFrustum& frustum)
+{
+	for (unsigned int p = 0; p < 6; p++)
+	{
+		const float* plane = frustum.planes[p];
+
+		//the corner furthest along the plane normal decides it
+		float distance = plane[3];
+		for (unsigned int axis = 0; axis < 3; axis++)
+			distance += plane[axis] * (plane[axis] >= 0.0f ? bounds.max[axis] : bounds.min[axis]);
+
+		if (distance < 0.0f)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+//world space box around everything an emitter can draw
+struct ParticleBounds
+{
+	float min[3];
+	float max[3];
+};
+
+//what an emitter's particles can do over their whole life: start at origin +- posRange,
+//leave with startVel +- velRange, accelerate by acc, and draw billboards up to maxSize from the center along each camera axis
+struct ParticleMotion
+{
+	float origin[3], posRange[3];
+	float startVel[3], velRange[3];
+	float acc[3];
+	float lifeTime;
+	float maxSize;
+};
+
+//conservative box from the closed form motion: per axis, the extremes of p0 + v t + a t^2 / 2 over t in [0, lifeTime]
+ParticleBounds ComputeParticleBounds(const ParticleMotion& motion);
+
+//six planes a x + b y + c z + d >= 0 on the inside
+struct ViewFrustum
+{
+	float planes[6][4];
+};
+
+//planes of a row vector view * projection matrix (DirectXMath convention, not transposed), d3d clip space z in [0, w]
+ViewFrustum ExtractViewFrustum(const float viewProjection[4][4]);
+
+//false only when the box is fully outside one of the planes
+bool IntersectsFrustum(const ParticleBounds& bounds, const ViewFrustum& frustum);
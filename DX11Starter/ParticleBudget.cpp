@@ -0,0 +1,52 @@
+#include "ParticleBudget.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	double DrawnParticles(const std::vector<BudgetedEmitter>& emitters)
+	{
+		double drawn = 0.0;
+		for (const BudgetedEmitter& emitter : emitters)
+			if (!emitter.dropped) drawn += (double)emitter.particles / emitter.detail;
+		return drawn;
+	}
+}
+
+void FitParticleBudget(std::vector<BudgetedEmitter>& emitters, unsigned int budget, unsigned int maxDetail)
+{
+	//the same factor for all, rounded up so the total lands under the budget unless maxDetail stops some of them,
+	//and then again for the ones it did not stop
+	double drawn = DrawnParticles(emitters);
+	while (drawn > budget)
+	{
+		double scale = drawn / budget;
+		bool thinned = false;
+		for (BudgetedEmitter& emitter : emitters)
+		{
+			unsigned int detail = std::min(maxDetail, (unsigned int)std::ceil(emitter.detail * scale));
+			thinned = thinned || detail != emitter.detail;
+			emitter.detail = detail;
+		}
+		if (!thinned)
+			break;
+		drawn = DrawnParticles(emitters);
+	}
+	if (drawn <= budget)
+		return;
+
+	//more than maxDetail times over: the smallest on screen are the least missed
+	std::vector<BudgetedEmitter*> bySize;
+	for (BudgetedEmitter& emitter : emitters)
+		bySize.push_back(&emitter);
+	std::stable_sort(bySize.begin(), bySize.end(), [](const BudgetedEmitter* a, const BudgetedEmitter* b) { return a->screenSize < b->screenSize; });
+
+	for (BudgetedEmitter* emitter : bySize)
+	{
+		if (drawn <= budget)
+			break;
+		emitter->dropped = true;
+		drawn -= (double)emitter->particles / emitter->detail;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+//one visible emitter as the particle budget sees it
+struct BudgetedEmitter
+{
+	//particles at full detail, and the projected radius that decides which emitters go first
+	unsigned int particles;
+	float screenSize;
+
+	//in: the detail from screen size alone; out: the detail that fits the budget, or dropped for the frame
+	unsigned int detail;
+	bool dropped;
+};
+
+//thins every emitter by a common factor until the particles they draw (particles / detail) fit budget, again for the
+//ones not yet at maxDetail when that stops some
+//when even maxDetail does not fit, whole emitters are dropped, smallest on screen first, so the total never goes over
+void FitParticleBudget(std::vector<BudgetedEmitter>& emitters, unsigned int budget, unsigned int maxDetail);
@@ -0,0 +1,157 @@
+#include "ParticleEffects.h"
+
+#include <cstring>
+
+ParticleEffects::ParticleEffects
+(
+	ParticleSystemManager* systems, ID3D11Device* device, ID3D11DeviceContext* context,
+	const ParticleShaders& shaders, std::map<std::string, Texture*>* textures, std::map<std::string, Mesh*>* meshes
+)
+{
+	m_systems = systems;
+	m_device = device;
+	m_context = context;
+	m_shaders = shaders;
+	m_textures = textures;
+	m_meshes = meshes;
+	m_ground = nullptr;
+	m_groundSRV = nullptr;
+}
+
+ParticleEffects::~ParticleEffects()
+{
+	if (m_groundSRV) m_groundSRV->Release();
+}
+
+void ParticleEffects::SetGround(const Heightfield* ground)
+{
+	if (m_groundSRV) m_groundSRV->Release();
+	m_groundSRV = ground ? GPUEmitter::CreateGroundSRV(m_device, *ground) : nullptr;
+	m_ground = ground;
+}
+
+bool ParticleEffects::Load(const char* path, std::string& error)
+{
+	std::vector<EmitterDesc> descs;
+	if (!LoadEffectFile(path, descs, error))
+		return false;
+
+	m_effects.reserve(m_effects.size() + descs.size());
+	for (const EmitterDesc& desc : descs)
+		Add(desc);
+	return true;
+}
+
+void ParticleEffects::Add(const EmitterDesc& desc)
+{
+	m_effects.push_back(EffectPool());
+	m_effects.back().desc = desc;
+	m_effects.back().next = 0;
+	BuildPool(m_effects.back());
+}
+
+void ParticleEffects::BuildPool(EffectPool& effect)
+{
+	const EmitterDesc& desc = effect.desc;
+
+	ID3D11ShaderResourceView* texture = nullptr;
+	auto found = m_textures->find(desc.texture);
+	if (found != m_textures->end())
+		texture = found->second->GetSRV();
+
+	//a mesh only has a surface to spawn on when it was loaded with keepSurface
+	const MeshSampler* surface = nullptr;
+	auto mesh = m_meshes->find(desc.surface);
+	if (desc.surface[0] != '\0' && mesh != m_meshes->end())
+		surface = mesh->second->GetSurface();
+
+	//unknown modes from a hand edited file pass through like none
+	ParticleCollision collision = { (ParticleCollisionMode)desc.collision, desc.restitution, desc.friction };
+	bool colliding = m_ground && (desc.collision == ParticleCollision_Bounce || desc.collision == ParticleCollision_Kill);
+
+	for (unsigned int i = 0; i < desc.poolSize; i++)
+	{
+		switch (desc.type)
+		{
+		case EmitterType_Cpu:
+		{
+			Emitter* emitter = new Emitter(desc, m_device, m_shaders.particleVS, m_shaders.particlePS, texture);
+			if (desc.instancing) emitter->EnableInstancing(m_device, m_shaders.instanceVS);
+			if (desc.depthSort) emitter->SetDepthSort(true, &m_systems->GetJobs());
+			if (surface) emitter->SetSurface(surface);
+			if (colliding) emitter->SetCollision(m_ground, collision);
+			effect.emitters.push_back(m_systems->AddEmitter(emitter, false));
+			break;
+		}
+
+		case EmitterType_Hybrid:
+		{
+			HybridEmitter* emitter = new HybridEmitter(desc, m_device, m_shaders.hybridVS, m_shaders.particlePS, texture);
+			if (desc.depthSort) emitter->SetDepthSort(true, &m_systems->GetJobs());
+			if (surface) emitter->SetSurface(surface);
+			effect.hybridEmitters.push_back(m_systems->AddEmitter(emitter, false));
+			break;
+		}
+
+		case EmitterType_Gpu:
+		{
+			GPUEmitter* emitter = new GPUEmitter
+			(
+				desc, m_device, m_context,
+				m_shaders.deadInitCS, m_shaders.updateCS, m_shaders.emitCS, m_shaders.setArgsCS,
+				m_shaders.gpuVS, m_shaders.gpuPS, texture
+			);
+			if (desc.depthSort) emitter->EnableDepthSort(m_device, m_shaders.sortArgsCS, m_shaders.sortLocalCS, m_shaders.sortStepCS, m_shaders.sortMergeCS);
+			if (colliding) emitter->SetCollision(m_ground, m_groundSRV, collision);
+			effect.gpuEmitters.push_back(m_systems->AddEmitter(emitter, false));
+			break;
+		}
+		}
+	}
+}
+
+void* ParticleEffects::GetInstance(const EffectPool& effect, unsigned int index) const
+{
+	switch (effect.desc.type)
+	{
+	case EmitterType_Cpu: return effect.emitters[index];
+	case EmitterType_Hybrid: return effect.hybridEmitters[index];
+	default: return effect.gpuEmitters[index];
+	}
+}
+
+int ParticleEffects::Find(const char* name) const
+{
+	for (size_t i = 0; i < m_effects.size(); i++)
+	{
+		if (strcmp(m_effects[i].desc.name, name) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+void ParticleEffects::Spawn(unsigned int effect, const DirectX::XMFLOAT3& position)
+{
+	//a pipelined step may still be running the emitter about to restart
+	m_systems->Sync();
+
+	EffectPool& pool = m_effects[effect];
+	unsigned int index = pool.next;
+	pool.next = (pool.next + 1) % pool.desc.poolSize;
+
+	switch (pool.desc.type)
+	{
+	case EmitterType_Cpu: pool.emitters[index]->Restart(position); break;
+	case EmitterType_Hybrid: pool.hybridEmitters[index]->Restart(position); break;
+	case EmitterType_Gpu: pool.gpuEmitters[index]->Restart(position); break;
+	}
+
+	m_systems->SetActive(GetInstance(pool, index), true);
+}
+
+void ParticleEffects::StopAll(unsigned int effect)
+{
+	const EffectPool& pool = m_effects[effect];
+	for (unsigned int i = 0; i < pool.desc.poolSize; i++)
+		m_systems->SetActive(GetInstance(pool, i), false);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ParticleSystemManager.h"
+#include "EmitterDesc.h"
+#include "Textures.h"
+#include "Mesh.h"
+#include "Heightfield.h"
+
+//every shader an emitter of any kind may need
+struct ParticleShaders
+{
+	SimpleVertexShader* particleVS;
+	SimpleVertexShader* instanceVS;
+	SimpleVertexShader* hybridVS;
+	SimplePixelShader* particlePS;
+
+	SimpleVertexShader* gpuVS;
+	SimplePixelShader* gpuPS;
+	SimpleComputeShader* deadInitCS, * emitCS, * updateCS, * setArgsCS;
+	SimpleComputeShader* sortArgsCS, * sortLocalCS, * sortStepCS, * sortMergeCS;
+};
+
+//effects loaded in bulk from an effect file, each one a pool of emitters built up front from its EmitterDesc
+//the pools live in the manager, inactive, so spawning an effect takes the next pooled emitter and restarts it
+//at the new position: no parsing, no allocation and no buffer creation at runtime
+class ParticleEffects
+{
+private:
+	struct EffectPool
+	{
+		EmitterDesc desc;
+		std::vector<Emitter*> emitters;
+		std::vector<HybridEmitter*> hybridEmitters;
+		std::vector<GPUEmitter*> gpuEmitters;
+
+		//the pool is a ring, spawning past its size recycles the oldest instance
+		unsigned int next;
+	};
+	std::vector<EffectPool> m_effects;
+
+	ParticleSystemManager* m_systems;
+	ID3D11Device* m_device;
+	ID3D11DeviceContext* m_context;
+	ParticleShaders m_shaders;
+	std::map<std::string, Texture*>* m_textures;
+	std::map<std::string, Mesh*>* m_meshes;
+
+	//scene ground for emitters with collision, and its heights on the gpu for every GPUEmitter to share
+	const Heightfield* m_ground;
+	ID3D11ShaderResourceView* m_groundSRV;
+
+	void BuildPool(EffectPool& effect);
+	void* GetInstance(const EffectPool& effect, unsigned int index) const;
+
+public:
+	ParticleEffects
+	(
+		ParticleSystemManager* systems, ID3D11Device* device, ID3D11DeviceContext* context,
+		const ParticleShaders& shaders, std::map<std::string, Texture*>* textures, std::map<std::string, Mesh*>* meshes
+	);
+	~ParticleEffects();
+
+	//the ground emitters with a collision mode collide with, for the effects loaded after this; not owned
+	void SetGround(const Heightfield* ground);
+
+	//adds every effect in a binary or text effect file, see EmitterDesc.h
+	bool Load(const char* path, std::string& error);
+	void Add(const EmitterDesc& desc);
+
+	//index of the effect with the given name, -1 when there is none
+	int Find(const char* name) const;
+	unsigned int GetEffectCount() const { return (unsigned int)m_effects.size(); }
+	const EmitterDesc& GetDesc(unsigned int effect) const { return m_effects[effect].desc; }
+
+	void Spawn(unsigned int effect, const DirectX::XMFLOAT3& position);
+
+	//takes every instance of the effect out of the frame
+	void StopAll(unsigned int effect);
+};
@@ -1,4 +1,5 @@
 #include "ParticleIncludes.hlsli"
+#include "ParticleRandom.hlsli"
 
 cbuffer ExternalData : register(b0)
 {
@@ -16,15 +17,13 @@ cbuffer ExternalData : register(b0)
 	float3 velRange;
 	int maxParticle;
 
+	uint randomKey;
+	uint spawnBase;
 }
 
 RWStructuredBuffer<Particle> ParticlePool : register(u0);
 ConsumeStructuredBuffer<uint> DeadList	  : register(u1);
 
-float rand(float2 co) {
-	return 0.5 + (frac(sin(dot(co.xy, float2(12.9898, 78.233))) * 43758.5453)) * 0.5;
-}
-
 [numthreads(32, 1, 1)]
 void main(uint3 id : SV_DispatchThreadID)
 {
@@ -35,12 +34,8 @@ void main(uint3 id : SV_DispatchThreadID)
 
 	uint emitIndex = DeadList.Consume();
 
-	//random number generation
-	float random[6];
-	for (unsigned int i = 0; i < 6; i++)
-	{
-		random[i] = rand((float2((float)emitIndex, (float)i)));
-	}
+	//random numbers keyed by spawn order, the same values a cpu emitter with this key would draw
+	uint spawnIndex = spawnBase + id.x;
 
 	Particle emitParticle = ParticlePool.Load(emitIndex);
 
@@ -49,13 +44,13 @@ void main(uint3 id : SV_DispatchThreadID)
 	emitParticle.Color = startColor;
 	emitParticle.Alive = 1.0f;
 
-	emitParticle.Velocity.x = startVel.x + (((random[0] - 0.5) * 4) - 1)* velRange.x;
-	emitParticle.Velocity.y = startVel.y + (((random[1] - 0.5) * 4) - 1)* velRange.y;
-	emitParticle.Velocity.z = startVel.z + (((random[2] - 0.5) * 4) - 1)* velRange.z;
+	emitParticle.Velocity.x = startVel.x + (ParticleRandomFloat(randomKey, spawnIndex, RANDOM_VEL_X) * 2 - 1) * velRange.x;
+	emitParticle.Velocity.y = startVel.y + (ParticleRandomFloat(randomKey, spawnIndex, RANDOM_VEL_Y) * 2 - 1) * velRange.y;
+	emitParticle.Velocity.z = startVel.z + (ParticleRandomFloat(randomKey, spawnIndex, RANDOM_VEL_Z) * 2 - 1) * velRange.z;
 
-	emitParticle.Position.x = startPos.x + (((random[3] - 0.5) * 4) - 1)* posRange.x;
-	emitParticle.Position.y = startPos.y + (((random[4] - 0.5) * 4) - 1) * posRange.y;
-	emitParticle.Position.z = startPos.z + (((random[5] - 0.5) * 4) - 1) * posRange.z;
+	emitParticle.Position.x = startPos.x + (ParticleRandomFloat(randomKey, spawnIndex, RANDOM_POS_X) * 2 - 1) * posRange.x;
+	emitParticle.Position.y = startPos.y + (ParticleRandomFloat(randomKey, spawnIndex, RANDOM_POS_Y) * 2 - 1) * posRange.y;
+	emitParticle.Position.z = startPos.z + (ParticleRandomFloat(randomKey, spawnIndex, RANDOM_POS_Z) * 2 - 1) * posRange.z;
 
 	ParticlePool[emitIndex] = emitParticle;
 }
\ No newline at end of file
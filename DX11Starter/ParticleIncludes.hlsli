@@ -15,6 +15,7 @@ struct Particle
 struct ParticleDraw
 {
 	uint Index;
+	float DistanceSq;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+cbuffer external : register(b0)
+{
+	matrix projection;
+	matrix view;
+
+	float3 origin;
+}
+
+//one 16 byte record per particle, packed by ExpandParticleInstances
+//x: half position x | half position y, y: half position z | half size, z: rgba8 color, w: half rotation
+struct vertexShaderInput
+{
+	uint vertexID	: SV_VertexID;
+	uint4 particle	: PARTICLE_PER_INSTANCE;
+};
+
+struct vertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 UV		: TEXCOORD;
+	float4 Color	: COLOR;
+};
+
+vertexToPixel main(vertexShaderInput input)
+{
+	vertexToPixel output;
+
+	//six vertices per instance, in the same corner order as the indexed quads (0 1 2, 0 2 3)
+	uint cornerIndex[6] = { 0, 1, 2, 0, 2, 3 };
+	uint cornerID = cornerIndex[input.vertexID];
+
+	uint4 particle = input.particle;
+	float3 pos = origin + float3(f16tof32(particle.x), f16tof32(particle.x >> 16), f16tof32(particle.y));
+	float size = f16tof32(particle.y >> 16);
+	float rotation = f16tof32(particle.w);
+	float4 color = float4(particle.z & 0xff, (particle.z >> 8) & 0xff, (particle.z >> 16) & 0xff, particle.z >> 24) / 255.0f;
+
+	float2 offsets[4];
+	offsets[0] = float2(-1.0f, 1.0f);
+	offsets[1] = float2(1.0f, 1.0f);
+	offsets[2] = float2(1.0f, -1.0f);
+	offsets[3] = float2(-1.0f, -1.0f);
+
+	float Sine, Cosine;
+	sincos(rotation, Sine, Cosine);
+	float2x2 rotationMatrix =
+	{
+		Cosine, Sine, -Sine, Cosine
+	};
+
+	float2 rotatedOffset = mul(offsets[cornerID], rotationMatrix);
+	pos += float3(view._11, view._21, view._31) * rotatedOffset.x * size;
+	pos += float3(view._12, view._22, view._32) * rotatedOffset.y * size;
+
+	matrix viewProj = mul(view, projection);
+	output.position = mul(float4(pos, 1.0f), viewProj);
+
+	float2 UV[4];
+	UV[0] = float2(0, 0);
+	UV[1] = float2(1, 0);
+	UV[2] = float2(1, 1);
+	UV[3] = float2(0, 1);
+
+	output.UV = UV[cornerID];
+	output.Color = color;
+
+	return output;
+}
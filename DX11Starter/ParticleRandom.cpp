@@ -0,0 +1,120 @@
+#include "ParticleRandom.h"
+#include <emmintrin.h>
+
+namespace
+{
+	const uint32_t c_philoxMultiplier = 0xD256D357u;
+	const uint32_t c_philoxKeyBump = 0x9E3779B9u;
+	const unsigned int c_philoxRounds = 10;
+
+	uint32_t s_nextKey = 0;
+
+	//one philox block for the four spawn indices from firstIndex at once
+	void PhiloxRandom4(uint32_t key, uint32_t firstIndex, uint32_t block, __m128i& x0, __m128i& x1)
+	{
+		const __m128i multiplier = _mm_set1_epi32((int)c_philoxMultiplier);
+
+		x0 = _mm_add_epi32(_mm_set1_epi32((int)firstIndex), _mm_setr_epi32(0, 1, 2, 3));
+		x1 = _mm_set1_epi32((int)block);
+
+		for (unsigned int round = 0; round < c_philoxRounds; round++)
+		{
+			//sse2 only multiplies the even lanes to 64 bits, so do even and odd separately and re-interleave
+			__m128i even = _mm_mul_epu32(x0, multiplier);
+			__m128i odd = _mm_mul_epu32(_mm_srli_epi64(x0, 32), multiplier);
+			even = _mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 2, 0));
+			odd = _mm_shuffle_epi32(odd, _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i lo = _mm_unpacklo_epi32(even, odd);
+			__m128i hi = _mm_unpackhi_epi32(even, odd);
+
+			x0 = _mm_xor_si128(_mm_xor_si128(hi, _mm_set1_epi32((int)key)), x1);
+			x1 = lo;
+			key += c_philoxKeyBump;
+		}
+	}
+
+	//RandomUnitFloat on four words
+	__m128 UnitFloats4(__m128i bits)
+	{
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(bits, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+	}
+}
+
+void PhiloxRandom2x32(uint32_t key, uint32_t counter0, uint32_t counter1, uint32_t out[2])
+{
+	for (unsigned int round = 0; round < c_philoxRounds; round++)
+	{
+		uint64_t product = (uint64_t)c_philoxMultiplier * counter0;
+		uint32_t hi = (uint32_t)(product >> 32);
+		uint32_t lo = (uint32_t)product;
+
+		counter0 = hi ^ key ^ counter1;
+		counter1 = lo;
+		key += c_philoxKeyBump;
+	}
+
+	out[0] = counter0;
+	out[1] = counter1;
+}
+
+float ParticleRandomFloat(uint32_t key, uint32_t particleIndex, unsigned int channel)
+{
+	//every block gives two channels
+	uint32_t words[2];
+	PhiloxRandom2x32(key, particleIndex, channel >> 1, words);
+	return RandomUnitFloat(words[channel & 1]);
+}
+
+void FillParticleRandoms(uint32_t key, uint32_t firstIndex, unsigned int count, float* out)
+{
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		for (uint32_t block = 0; block < c_particleRandomChannels / 2; block++)
+		{
+			__m128i x0, x1;
+			PhiloxRandom4(key, firstIndex + i, block, x0, x1);
+			_mm_storeu_ps(out + (block * 2) * count + i, UnitFloats4(x0));
+			_mm_storeu_ps(out + (block * 2 + 1) * count + i, UnitFloats4(x1));
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		for (uint32_t block = 0; block < c_particleRandomChannels / 2; block++)
+		{
+			uint32_t words[2];
+			PhiloxRandom2x32(key, firstIndex + i, block, words);
+			out[(block * 2) * count + i] = RandomUnitFloat(words[0]);
+			out[(block * 2 + 1) * count + i] = RandomUnitFloat(words[1]);
+		}
+	}
+}
+
+void FillParticleRandomWords(uint32_t key, uint32_t firstIndex, unsigned int count, uint32_t block, uint32_t* out)
+{
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i x0, x1;
+		PhiloxRandom4(key, firstIndex + i, block, x0, x1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + count + i), x1);
+	}
+
+	for (; i < count; i++)
+	{
+		uint32_t words[2];
+		PhiloxRandom2x32(key, firstIndex + i, block, words);
+		out[i] = words[0];
+		out[count + i] = words[1];
+	}
+}
+
+uint32_t NextParticleRandomKey()
+{
+	//spread consecutive keys with a philox block of their own
+	uint32_t words[2];
+	PhiloxRandom2x32(0x5EED5EEDu, s_nextKey++, 0, words);
+	return words[0];
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+//counter based random numbers (philox 2x32, 10 rounds)
+//a (key, counter) pair always gives the same bits, here and in ParticleRandom.hlsli,
+//so spawning needs no shared state and cpu and gpu emitters can be compared particle for particle
+
+//random values every emitter draws per spawned particle, by channel
+const unsigned int c_randomPosX = 0, c_randomPosY = 1, c_randomPosZ = 2;
+const unsigned int c_randomVelX = 3, c_randomVelY = 4, c_randomVelZ = 5;
+const unsigned int c_randomRotStart = 6, c_randomRotEnd = 7;
+const unsigned int c_particleRandomChannels = 8;
+
+//philox block after the channels' blocks, two full words for picking a mesh triangle when spawning on a surface
+const uint32_t c_randomSurfaceBlock = c_particleRandomChannels / 2;
+
+//particles the cpu emitters draw randoms for in one FillParticleRandoms call
+const unsigned int c_randomBatch = 64;
+
+//one philox block: two 32 bit words for the counter (counter0, counter1)
+void PhiloxRandom2x32(uint32_t key, uint32_t counter0, uint32_t counter1, uint32_t out[2]);
+
+//top 24 bits of a random word as a float in [0, 1), exact on both cpu and gpu
+inline float RandomUnitFloat(uint32_t bits) { return (float)(bits >> 8) * (1.0f / 16777216.0f); }
+
+//channel value in [0, 1) for the particle with spawn index particleIndex
+float ParticleRandomFloat(uint32_t key, uint32_t particleIndex, unsigned int channel);
+
+//fills every channel for count particles starting at spawn index firstIndex, four particles at a time
+//out is channel major: out[channel * count + i] belongs to particle firstIndex + i
+void FillParticleRandoms(uint32_t key, uint32_t firstIndex, unsigned int count, float* out);
+
+//the raw words of one block for count particles, for draws that need more than 24 bits
+//out[i] and out[count + i] are the block's two words for particle firstIndex + i
+void FillParticleRandomWords(uint32_t key, uint32_t firstIndex, unsigned int count, uint32_t block, uint32_t* out);
+
+//a different key for every emitter created, so two emitters never share a sequence by accident
+uint32_t NextParticleRandomKey();
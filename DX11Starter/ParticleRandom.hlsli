@@ -0,0 +1,57 @@
+#ifndef __PARTICLE_RANDOM
+#define __PARTICLE_RANDOM
+
+//port of ParticleRandom.cpp, integer ops only so a (key, counter) gives the same bits as the cpu
+
+//channels drawn per spawned particle, same order as ParticleRandom.h
+#define RANDOM_POS_X 0
+#define RANDOM_POS_Y 1
+#define RANDOM_POS_Z 2
+#define RANDOM_VEL_X 3
+#define RANDOM_VEL_Y 4
+#define RANDOM_VEL_Z 5
+#define RANDOM_ROT_START 6
+#define RANDOM_ROT_END 7
+
+//high half of a 32x32 bit multiply, sm5 has no 64 bit integers
+uint MulHi32(uint a, uint b)
+{
+	uint aLo = a & 0xffff;
+	uint aHi = a >> 16;
+	uint bLo = b & 0xffff;
+	uint bHi = b >> 16;
+
+	uint loLo = aLo * bLo;
+	uint loHi = aLo * bHi;
+	uint hiLo = aHi * bLo;
+
+	//cannot overflow, at most 0xffff + 0xffff + 0xfffe0001
+	uint middle = (loLo >> 16) + (loHi & 0xffff) + hiLo;
+	return aHi * bHi + (loHi >> 16) + (middle >> 16);
+}
+
+uint2 PhiloxRandom2x32(uint key, uint2 counter)
+{
+	for (uint round = 0; round < 10; round++)
+	{
+		uint hi = MulHi32(0xD256D357, counter.x);
+		uint lo = 0xD256D357 * counter.x;
+
+		counter = uint2(hi ^ key ^ counter.y, lo);
+		key += 0x9E3779B9;
+	}
+	return counter;
+}
+
+float RandomUnitFloat(uint bits)
+{
+	return (float)(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+float ParticleRandomFloat(uint key, uint particleIndex, uint channel)
+{
+	uint2 words = PhiloxRandom2x32(key, uint2(particleIndex, channel >> 1));
+	return RandomUnitFloat((channel & 1) ? words.y : words.x);
+}
+
+#endif
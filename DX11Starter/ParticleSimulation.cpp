@@ -0,0 +1,133 @@
+#include "ParticleSimulation.h"
+#include "ParticleRandom.h"
+#include "MeshSampler.h"
+
+#include <cstring>
+
+ParticleLiveRange LiveRangeAt(const SpawnSchedule& schedule, double time, float lifeTime, unsigned int capacity)
+{
+	ParticleLiveRange range;
+	range.last = schedule.SpawnedBy(time);
+	range.first = schedule.SpawnedBy(time - lifeTime);
+	if (range.last - range.first > capacity)
+		range.first = range.last - capacity;
+	return range;
+}
+
+//start positions on the surface for spawn indices [first, first + count), x y z each, placed at the emitter
+//the triangles come from the surface block and are spread over by the posX and posY randoms
+static void SpawnOnSurface(const ParticleSpawnParams& params, uint32_t first, unsigned int count, const float* random, float* out)
+{
+	uint32_t words[2 * c_randomBatch];
+	FillParticleRandomWords(params.randomKey, first, count, c_randomSurfaceBlock, words);
+	params.surface->Sample(words, words + count, random + c_randomPosX * count, random + c_randomPosY * count, count, out);
+	for (unsigned int n = 0; n < count; n++)
+	{
+		out[n * 3] += params.position[0];
+		out[n * 3 + 1] += params.position[1];
+		out[n * 3 + 2] += params.position[2];
+	}
+}
+
+void SpawnParticleStreams(ParticleStreams& streams, unsigned int poolSize, const SpawnSchedule& schedule, const ParticleSpawnParams& params, unsigned int first, unsigned int last)
+{
+	//randoms for a batch of spawns at once, channel major
+	float random[c_particleRandomChannels * c_randomBatch];
+	float surface[3 * c_randomBatch];
+
+	while (first < last)
+	{
+		unsigned int batch = last - first < c_randomBatch ? last - first : c_randomBatch;
+		FillParticleRandoms(params.randomKey, first, batch, random);
+		if (params.surface)
+			SpawnOnSurface(params, first, batch, random, surface);
+
+		unsigned int i = first % poolSize;
+		for (unsigned int n = 0; n < batch; n++)
+		{
+			streams.spawnTime[i] = (float)schedule.SpawnTime(first + n);
+
+			if (params.surface)
+			{
+				streams.posX[i] = surface[n * 3];
+				streams.posY[i] = surface[n * 3 + 1];
+				streams.posZ[i] = surface[n * 3 + 2];
+			}
+			else
+			{
+				streams.posX[i] = params.position[0] + (random[c_randomPosX * batch + n] * 2 - 1) * params.positionRange[0];
+				streams.posY[i] = params.position[1] + (random[c_randomPosY * batch + n] * 2 - 1) * params.positionRange[1];
+				streams.posZ[i] = params.position[2] + (random[c_randomPosZ * batch + n] * 2 - 1) * params.positionRange[2];
+			}
+
+			streams.velX[i] = params.velocity[0] + (random[c_randomVelX * batch + n] * 2 - 1) * params.velocityRange[0];
+			streams.velY[i] = params.velocity[1] + (random[c_randomVelY * batch + n] * 2 - 1) * params.velocityRange[1];
+			streams.velZ[i] = params.velocity[2] + (random[c_randomVelZ * batch + n] * 2 - 1) * params.velocityRange[2];
+
+			streams.rotStart[i] = random[c_randomRotStart * batch + n] *
+				(params.rotationRange[1] - params.rotationRange[0]) + params.rotationRange[0];
+
+			streams.rotEnd[i] = random[c_randomRotEnd * batch + n] *
+				(params.rotationRange[3] - params.rotationRange[2]) + params.rotationRange[2];
+
+			++i %= poolSize;
+		}
+
+		first += batch;
+	}
+}
+
+void SpawnHybridParticles(HybridParticleRecord* pool, unsigned int capacity, const SpawnSchedule& schedule, const ParticleSpawnParams& params, unsigned int first, unsigned int last)
+{
+	float random[c_particleRandomChannels * c_randomBatch];
+	float surface[3 * c_randomBatch];
+
+	while (first < last)
+	{
+		unsigned int batch = last - first < c_randomBatch ? last - first : c_randomBatch;
+		FillParticleRandoms(params.randomKey, first, batch, random);
+		if (params.surface)
+			SpawnOnSurface(params, first, batch, random, surface);
+
+		for (unsigned int n = 0; n < batch; n++)
+		{
+			HybridParticleRecord* particle = pool + (first + n) % capacity;
+
+			particle->spawnTime = (float)schedule.SpawnTime(first + n);
+
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				particle->startPosition[axis] = params.position[axis] + (random[(c_randomPosX + axis) * batch + n] * 2 - 1) * params.positionRange[axis];
+				particle->startVelocity[axis] = params.velocity[axis] + (random[(c_randomVelX + axis) * batch + n] * 2 - 1) * params.velocityRange[axis];
+			}
+			if (params.surface)
+				memcpy(particle->startPosition, surface + n * 3, sizeof(float) * 3);
+
+			particle->rotationStart = random[c_randomRotStart * batch + n] * (params.rotationRange[1] - params.rotationRange[0]) + params.rotationRange[0];
+			particle->rotationEnd = random[c_randomRotEnd * batch + n] * (params.rotationRange[3] - params.rotationRange[2]) + params.rotationRange[2];
+		}
+
+		first += batch;
+	}
+}
+
+unsigned int CountExpiredParticles(const HybridParticleRecord* pool, unsigned int capacity, unsigned int head, unsigned int live, double time, float lifeTime)
+{
+	auto isExpired = [&](unsigned int offset) { return (float)time - pool[(head + offset) % capacity].spawnTime >= lifeTime; };
+
+	//most frames nothing or only a few particles expire, which the head alone answers
+	if (live == 0 || !isExpired(0))
+		return 0;
+
+	//spawn times rise along the ring, so the expired particles are a prefix and the boundary is a binary search away
+	unsigned int low = 1, high = live;
+	while (low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		if (isExpired(mid))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ParticleStreams.h"
+#include "SpawnSchedule.h"
+
+class MeshSampler;
+
+//the cpu side of Emitter and HybridEmitter without d3d, so headless tools run the exact same spawn and retire code
+
+//where and how particles start out, the emitter fields spawning reads
+//with a surface the particles start on that mesh placed at position instead of in the box, and positionRange is unused
+struct ParticleSpawnParams
+{
+	float position[3], positionRange[3];
+	float velocity[3], velocityRange[3];
+	float rotationRange[4];
+	uint32_t randomKey;
+	const MeshSampler* surface;
+};
+
+//HybridParticle in HybridEmitter.h without the DirectXMath types
+struct HybridParticleRecord
+{
+	float startPosition[3];
+	float spawnTime;
+	float startVelocity[3];
+	float rotationStart;
+	float rotationEnd;
+	float padding[3];
+};
+static_assert(sizeof(HybridParticleRecord) == 48, "HybridParticleRecord must match HybridParticle in HybridParticleVS.hlsl");
+
+//spawn indices [first, last) live at a time, the newest ones win when the pool is full
+struct ParticleLiveRange
+{
+	unsigned int first, last;
+};
+ParticleLiveRange LiveRangeAt(const SpawnSchedule& schedule, double time, float lifeTime, unsigned int capacity);
+
+//spawn state of indices [first, last) into slot index % poolSize, the emitter's particle count and not
+//streams.capacity, which is rounded up to whole SIMD lanes
+void SpawnParticleStreams(ParticleStreams& streams, unsigned int poolSize, const SpawnSchedule& schedule, const ParticleSpawnParams& params, unsigned int first, unsigned int last);
+
+//same into a ring of capacity records
+void SpawnHybridParticles(HybridParticleRecord* pool, unsigned int capacity, const SpawnSchedule& schedule, const ParticleSpawnParams& params, unsigned int first, unsigned int last);
+
+//how many of the live records starting at slot head have expired at time, oldest first
+unsigned int CountExpiredParticles(const HybridParticleRecord* pool, unsigned int capacity, unsigned int head, unsigned int live, double time, float lifeTime);
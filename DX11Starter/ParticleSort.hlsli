@@ -0,0 +1,75 @@
+#ifndef __PARTICLE_SORT
+#define __PARTICLE_SORT
+
+#include "ParticleIncludes.hlsli"
+
+//back to front bitonic sort of the draw list, in the variant where every comparison is ascending:
+//the first step of each stage compares mirrored pairs and the rest are plain half cleaners,
+//so anything past the live count behaves as the largest key and never has to move
+
+//blocks of SORT_BLOCK elements are sorted and merged in groupshared memory, two per thread
+#define SORT_THREADS 512
+#define SORT_BLOCK 1024
+
+//live draw count, copied from the draw list counter with CopyStructureCount
+Buffer<uint> SortCount : register(t0);
+RWStructuredBuffer<ParticleDraw> DrawList : register(u0);
+
+//farther particles draw first
+bool SortsBefore(ParticleDraw a, ParticleDraw b)
+{
+	return a.DistanceSq > b.DistanceSq;
+}
+
+//pair p of a stage of size sortSize: mirrored when stride is half the stage, a half cleaner otherwise
+void SortPair(uint p, uint sortSize, uint stride, out uint lower, out uint upper)
+{
+	uint block = p / stride;
+	uint offset = p % stride;
+	lower = block * stride * 2 + offset;
+	upper = (stride * 2 == sortSize) ? block * sortSize + sortSize - 1 - offset : lower + stride;
+}
+
+groupshared ParticleDraw SortBlock[SORT_BLOCK];
+
+void LoadSortBlock(uint group, uint thread, uint count)
+{
+	//padding gets a negative distance, which sorts after every real particle
+	ParticleDraw padding;
+	padding.Index = 0;
+	padding.DistanceSq = -1.0f;
+
+	for (uint e = thread; e < SORT_BLOCK; e += SORT_THREADS)
+	{
+		uint i = group * SORT_BLOCK + e;
+		SortBlock[e] = (i < count) ? DrawList[i] : padding;
+	}
+	GroupMemoryBarrierWithGroupSync();
+}
+
+void StoreSortBlock(uint group, uint thread, uint count)
+{
+	for (uint e = thread; e < SORT_BLOCK; e += SORT_THREADS)
+	{
+		uint i = group * SORT_BLOCK + e;
+		if (i < count)
+			DrawList[i] = SortBlock[e];
+	}
+}
+
+void SortSharedStep(uint thread, uint sortSize, uint stride)
+{
+	uint lower, upper;
+	SortPair(thread, sortSize, stride, lower, upper);
+
+	ParticleDraw a = SortBlock[lower];
+	ParticleDraw b = SortBlock[upper];
+	if (SortsBefore(b, a))
+	{
+		SortBlock[lower] = b;
+		SortBlock[upper] = a;
+	}
+	GroupMemoryBarrierWithGroupSync();
+}
+
+#endif
@@ -0,0 +1,18 @@
+#include "ParticleSort.hlsli"
+
+RWBuffer<uint> SortArgs : register(u1);
+
+//indirect dispatch args for the sort: block passes at [0], pair passes at [3]
+[numthreads(1, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	uint count = SortCount[0];
+
+	SortArgs[0] = (count + SORT_BLOCK - 1) / SORT_BLOCK;
+	SortArgs[1] = 1;
+	SortArgs[2] = 1;
+
+	SortArgs[3] = (count + SORT_THREADS - 1) / SORT_THREADS;
+	SortArgs[4] = 1;
+	SortArgs[5] = 1;
+}
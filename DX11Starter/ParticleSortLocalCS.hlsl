@@ -0,0 +1,17 @@
+#include "ParticleSort.hlsli"
+
+//every stage up to SORT_BLOCK, each block on its own
+[numthreads(SORT_THREADS, 1, 1)]
+void main(uint3 group : SV_GroupID, uint thread : SV_GroupIndex)
+{
+	uint count = SortCount[0];
+	LoadSortBlock(group.x, thread, count);
+
+	for (uint sortSize = 2; sortSize <= SORT_BLOCK; sortSize *= 2)
+	{
+		for (uint stride = sortSize / 2; stride > 0; stride /= 2)
+			SortSharedStep(thread, sortSize, stride);
+	}
+
+	StoreSortBlock(group.x, thread, count);
+}
@@ -0,0 +1,19 @@
+#include "ParticleSort.hlsli"
+
+cbuffer ExternalData : register(b0)
+{
+	uint sortSize;
+}
+
+//the steps of a stage that stay inside one block, once the global steps have run
+[numthreads(SORT_THREADS, 1, 1)]
+void main(uint3 group : SV_GroupID, uint thread : SV_GroupIndex)
+{
+	uint count = SortCount[0];
+	LoadSortBlock(group.x, thread, count);
+
+	for (uint stride = SORT_BLOCK / 2; stride > 0; stride /= 2)
+		SortSharedStep(thread, sortSize, stride);
+
+	StoreSortBlock(group.x, thread, count);
+}
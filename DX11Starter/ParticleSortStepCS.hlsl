@@ -0,0 +1,25 @@
+#include "ParticleSort.hlsli"
+
+cbuffer ExternalData : register(b0)
+{
+	uint sortSize;
+	uint sortStep;
+}
+
+//one step of a stage larger than a block, a pair per thread straight in the draw list
+[numthreads(SORT_THREADS, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	uint lower, upper;
+	SortPair(id.x, sortSize, sortStep, lower, upper);
+
+	if (upper >= SortCount[0]) return;
+
+	ParticleDraw a = DrawList[lower];
+	ParticleDraw b = DrawList[upper];
+	if (SortsBefore(b, a))
+	{
+		DrawList[lower] = b;
+		DrawList[upper] = a;
+	}
+}
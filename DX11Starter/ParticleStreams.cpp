@@ -0,0 +1,306 @@
+#include "ParticleStreams.h"
+#include <new>
+#include <cstring>
+#include <emmintrin.h>
+
+namespace
+{
+	const unsigned int c_streamCount = 9;
+	const unsigned int c_streamAlign = 32;
+	const unsigned int c_laneCount = 8;
+
+	//sin and cos of four angles at once, same range reduction and minimax polynomials as XMVectorSinCos
+	inline void SinCos4(__m128 x, __m128& sinOut, __m128& cosOut)
+	{
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 pi = _mm_set1_ps(3.141592654f);
+		const __m128 halfPi = _mm_set1_ps(1.570796327f);
+
+		__m128 quotient = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.159154943f))));
+		__m128 y = _mm_sub_ps(x, _mm_mul_ps(quotient, _mm_set1_ps(6.283185307f)));
+
+		//fold y into [-pi/2, pi/2], sin keeps its value and cos flips sign
+		__m128 reflected = _mm_sub_ps(_mm_or_ps(pi, _mm_and_ps(y, signMask)), y);
+		__m128 inRange = _mm_cmple_ps(_mm_andnot_ps(signMask, y), halfPi);
+		y = _mm_or_ps(_mm_and_ps(inRange, y), _mm_andnot_ps(inRange, reflected));
+		__m128 sign = _mm_or_ps(_mm_and_ps(inRange, one), _mm_andnot_ps(inRange, _mm_set1_ps(-1.0f)));
+
+		__m128 y2 = _mm_mul_ps(y, y);
+
+		__m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-2.3889859e-08f), y2), _mm_set1_ps(2.7525562e-06f));
+		s = _mm_add_ps(_mm_mul_ps(s, y2), _mm_set1_ps(-0.00019840874f));
+		s = _mm_add_ps(_mm_mul_ps(s, y2), _mm_set1_ps(0.0083333310f));
+		s = _mm_add_ps(_mm_mul_ps(s, y2), _mm_set1_ps(-0.16666667f));
+		s = _mm_add_ps(_mm_mul_ps(s, y2), one);
+		sinOut = _mm_mul_ps(s, y);
+
+		__m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-2.6051615e-07f), y2), _mm_set1_ps(2.4760495e-05f));
+		c = _mm_add_ps(_mm_mul_ps(c, y2), _mm_set1_ps(-0.0013888378f));
+		c = _mm_add_ps(_mm_mul_ps(c, y2), _mm_set1_ps(0.041666638f));
+		c = _mm_add_ps(_mm_mul_ps(c, y2), _mm_set1_ps(-0.5f));
+		c = _mm_add_ps(_mm_mul_ps(c, y2), one);
+		cosOut = _mm_mul_ps(c, sign);
+	}
+
+	//one corner is position (3), color (4) and uv (2); the overlapping stores keep it to three writes
+	inline float* WriteCorner(float* out, __m128 position, __m128 color, __m128 uv)
+	{
+		_mm_storeu_ps(out, position);
+		_mm_storeu_ps(out + 3, color);
+		_mm_storel_pi(reinterpret_cast<__m64*>(out + 7), uv);
+		return out + c_particleVertexFloats;
+	}
+
+	//float to half with round to nearest even, bit exact with _mm_cvtps_ph, in the low 16 bits of each lane
+	inline __m128i FloatToHalf4(__m128 f)
+	{
+		const __m128i infinityBits = _mm_set1_epi32(0x7c00);
+		const __m128i halfLimit = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i normalLimit = _mm_set1_epi32((127 - 14) << 23);
+		const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+		__m128 sign = _mm_and_ps(f, _mm_set1_ps(-0.0f));
+		__m128 absF = _mm_xor_ps(f, sign);
+		__m128i absBits = _mm_castps_si128(absF);
+
+		__m128i nanBit = _mm_and_si128(_mm_castps_si128(_mm_cmpunord_ps(absF, absF)), _mm_set1_epi32(0x200));
+		__m128i special = _mm_or_si128(nanBit, infinityBits);
+		__m128i isRegular = _mm_cmpgt_epi32(halfLimit, absBits);
+		__m128i isSubnormal = _mm_cmpgt_epi32(normalLimit, absBits);
+
+		//subnormal results round through a float add, normal ones by biasing the exponent and rounding the mantissa
+		__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+		__m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+		__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absBits, normalBias), mantissaOdd), 13);
+
+		__m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+		__m128i bits = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, special));
+		return _mm_or_si128(bits, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+	}
+
+	//particle state at params.time for a block of up to four particles
+	struct EvaluatedBlock
+	{
+		__m128 position[3];
+		__m128 agePercent, rotation, size;
+	};
+
+	enum { c_spawnTime, c_posX, c_posY, c_posZ, c_velX, c_velY, c_velZ, c_rotStart, c_rotEnd };
+
+	//particles i..i+count, or the slots order[i..i+count) when an order is given
+	inline void EvaluateBlock(const ParticleStreams& s, unsigned int i, unsigned int count, const unsigned int* order, const ParticleExpandParams& p, EvaluatedBlock& out)
+	{
+		const float* streams[c_streamCount] = { s.spawnTime, s.posX, s.posY, s.posZ, s.velX, s.velY, s.velZ, s.rotStart, s.rotEnd };
+
+		__m128 block[c_streamCount];
+		if (count == 4 && !order)
+		{
+			for (unsigned int stream = 0; stream < c_streamCount; stream++)
+				block[stream] = _mm_loadu_ps(streams[stream] + i);
+		}
+		else
+		{
+			//tails and sorted orders gather lane by lane
+			unsigned int slot[4];
+			for (unsigned int k = 0; k < count; k++)
+				slot[k] = order ? order[i + k] : i + k;
+
+			alignas(16) float gathered[4];
+			for (unsigned int stream = 0; stream < c_streamCount; stream++)
+			{
+				for (unsigned int k = 0; k < 4; k++)
+					gathered[k] = (k < count) ? streams[stream][slot[k]] : 0.0f;
+				block[stream] = _mm_load_ps(gathered);
+			}
+		}
+
+		//everything below is the closed form of constant acceleration and linear fades over the lifetime
+		__m128 age = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(p.time), block[c_spawnTime]), _mm_setzero_ps());
+		__m128 t = _mm_mul_ps(age, _mm_set1_ps(p.invLifeTime));
+		out.agePercent = t;
+		out.rotation = _mm_add_ps(block[c_rotStart], _mm_mul_ps(t, _mm_sub_ps(block[c_rotEnd], block[c_rotStart])));
+		out.size = _mm_add_ps(_mm_set1_ps(p.startSize), _mm_mul_ps(t, _mm_set1_ps(p.endSize - p.startSize)));
+
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			__m128 velocity = _mm_add_ps(block[c_velX + axis], _mm_mul_ps(_mm_set1_ps(0.5f * p.acc[axis]), age));
+			out.position[axis] = _mm_add_ps(block[c_posX + axis], _mm_mul_ps(velocity, age));
+		}
+	}
+}
+
+void ParticleStreams::Allocate(unsigned int count)
+{
+	Release();
+
+	//round up so every stream starts on a 32 byte boundary
+	capacity = (count + c_laneCount - 1) & ~(c_laneCount - 1);
+	m_block = static_cast<float*>(::operator new(sizeof(float) * capacity * c_streamCount, std::align_val_t(c_streamAlign)));
+	memset(m_block, 0, sizeof(float) * capacity * c_streamCount);
+
+	float** streams[c_streamCount] = { &spawnTime, &posX, &posY, &posZ, &velX, &velY, &velZ, &rotStart, &rotEnd };
+	for (unsigned int i = 0; i < c_streamCount; i++)
+		*streams[i] = m_block + i * capacity;
+}
+
+void ParticleStreams::Release()
+{
+	if (m_block)
+		::operator delete(m_block, std::align_val_t(c_streamAlign));
+
+	m_block = nullptr;
+	spawnTime = posX = posY = posZ = velX = velY = velZ = rotStart = rotEnd = nullptr;
+	capacity = 0;
+}
+
+namespace
+{
+	float* ExpandQuads(const ParticleStreams& s, unsigned int begin, unsigned int end, const unsigned int* order, const ParticleExpandParams& p, float* out)
+	{
+		const __m128 right = _mm_setr_ps(p.right[0], p.right[1], p.right[2], 0);
+		const __m128 up = _mm_setr_ps(p.up[0], p.up[1], p.up[2], 0);
+		const __m128 startColor = _mm_loadu_ps(p.startColor);
+		const __m128 colorRange = _mm_sub_ps(_mm_loadu_ps(p.endColor), startColor);
+		const __m128 uv[4] = { _mm_setr_ps(0, 0, 0, 0), _mm_setr_ps(1, 0, 0, 0), _mm_setr_ps(1, 1, 0, 0), _mm_setr_ps(0, 1, 0, 0) };
+
+		//with corners (-1,1) (1,1) (1,-1) (-1,-1) rotated by r, every corner offset is a signed mix of
+		//a = (cos + sin) * size and b = (cos - sin) * size, so one sincos per particle covers all four corners
+		alignas(16) float a[4], b[4], position[3][4], agePercent[4];
+		for (unsigned int i = begin; i < end; i += 4)
+		{
+			unsigned int count = (end - i < 4) ? end - i : 4;
+
+			EvaluatedBlock block;
+			EvaluateBlock(s, i, count, order, p, block);
+			for (unsigned int axis = 0; axis < 3; axis++)
+				_mm_store_ps(position[axis], block.position[axis]);
+			_mm_store_ps(agePercent, block.agePercent);
+
+			__m128 sine, cosine;
+			SinCos4(block.rotation, sine, cosine);
+			_mm_store_ps(a, _mm_mul_ps(_mm_add_ps(cosine, sine), block.size));
+			_mm_store_ps(b, _mm_mul_ps(_mm_sub_ps(cosine, sine), block.size));
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				__m128 center = _mm_setr_ps(position[0][k], position[1][k], position[2][k], 0);
+				__m128 color = _mm_add_ps(startColor, _mm_mul_ps(colorRange, _mm_set1_ps(agePercent[k])));
+
+				__m128 av = _mm_set1_ps(a[k]);
+				__m128 bv = _mm_set1_ps(b[k]);
+				__m128 diagonal0 = _mm_sub_ps(_mm_mul_ps(up, bv), _mm_mul_ps(right, av));
+				__m128 diagonal1 = _mm_add_ps(_mm_mul_ps(right, bv), _mm_mul_ps(up, av));
+
+				out = WriteCorner(out, _mm_add_ps(center, diagonal0), color, uv[0]);
+				out = WriteCorner(out, _mm_add_ps(center, diagonal1), color, uv[1]);
+				out = WriteCorner(out, _mm_sub_ps(center, diagonal0), color, uv[2]);
+				out = WriteCorner(out, _mm_sub_ps(center, diagonal1), color, uv[3]);
+			}
+		}
+
+		return out;
+	}
+
+	unsigned int* ExpandInstances(const ParticleStreams& s, unsigned int begin, unsigned int end, const unsigned int* order, const ParticleExpandParams& p, unsigned int* out)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 toByte = _mm_set1_ps(255.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+
+		for (unsigned int i = begin; i < end; i += 4)
+		{
+			unsigned int count = (end - i < 4) ? end - i : 4;
+
+			EvaluatedBlock block;
+			EvaluateBlock(s, i, count, order, p, block);
+
+			//positions go relative to the origin so half floats keep their precision near the emitter
+			__m128i position[3];
+			for (unsigned int axis = 0; axis < 3; axis++)
+				position[axis] = FloatToHalf4(_mm_sub_ps(block.position[axis], _mm_set1_ps(p.origin[axis])));
+
+			__m128i color = _mm_setzero_si128();
+			for (unsigned int channel = 0; channel < 4; channel++)
+			{
+				__m128 value = _mm_add_ps(_mm_set1_ps(p.startColor[channel]), _mm_mul_ps(block.agePercent, _mm_set1_ps(p.endColor[channel] - p.startColor[channel])));
+				value = _mm_min_ps(_mm_max_ps(value, zero), one);
+				__m128i bytes = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, toByte), half));
+				color = _mm_or_si128(color, _mm_slli_epi32(bytes, channel * 8));
+			}
+
+			//four words per particle, one particle per lane, then transposed into records
+			__m128 words[4] =
+			{
+				_mm_castsi128_ps(_mm_or_si128(position[0], _mm_slli_epi32(position[1], 16))),
+				_mm_castsi128_ps(_mm_or_si128(position[2], _mm_slli_epi32(FloatToHalf4(block.size), 16))),
+				_mm_castsi128_ps(color),
+				_mm_castsi128_ps(FloatToHalf4(block.rotation))
+			};
+			_MM_TRANSPOSE4_PS(words[0], words[1], words[2], words[3]);
+
+			for (unsigned int k = 0; k < count; k++)
+				_mm_storeu_ps(reinterpret_cast<float*>(out + k * c_particleInstanceWords), words[k]);
+			out += count * c_particleInstanceWords;
+		}
+
+		return out;
+	}
+}
+
+float* ExpandParticleQuads(const ParticleStreams& s, unsigned int begin, unsigned int end, const ParticleExpandParams& p, float* out)
+{
+	return ExpandQuads(s, begin, end, nullptr, p, out);
+}
+
+unsigned int* ExpandParticleInstances(const ParticleStreams& s, unsigned int begin, unsigned int end, const ParticleExpandParams& p, unsigned int* out)
+{
+	return ExpandInstances(s, begin, end, nullptr, p, out);
+}
+
+float* ExpandSortedParticleQuads(const ParticleStreams& s, const unsigned int* order, unsigned int count, const ParticleExpandParams& p, float* out)
+{
+	return ExpandQuads(s, 0, count, order, p, out);
+}
+
+unsigned int* ExpandSortedParticleInstances(const ParticleStreams& s, const unsigned int* order, unsigned int count, const ParticleExpandParams& p, unsigned int* out)
+{
+	return ExpandInstances(s, 0, count, order, p, out);
+}
+
+namespace
+{
+	float* ComputeDepths(const ParticleStreams& s, unsigned int begin, unsigned int end, const unsigned int* order, const ParticleExpandParams& p, float* out)
+	{
+		alignas(16) float depth[4];
+		for (unsigned int i = begin; i < end; i += 4)
+		{
+			unsigned int count = (end - i < 4) ? end - i : 4;
+
+			EvaluatedBlock block;
+			EvaluateBlock(s, i, count, order, p, block);
+
+			__m128 z = _mm_mul_ps(block.position[0], _mm_set1_ps(p.forward[0]));
+			z = _mm_add_ps(z, _mm_mul_ps(block.position[1], _mm_set1_ps(p.forward[1])));
+			z = _mm_add_ps(z, _mm_mul_ps(block.position[2], _mm_set1_ps(p.forward[2])));
+			_mm_store_ps(depth, z);
+
+			for (unsigned int k = 0; k < count; k++)
+				*out++ = depth[k];
+		}
+
+		return out;
+	}
+}
+
+float* ComputeParticleDepths(const ParticleStreams& s, unsigned int begin, unsigned int end, const ParticleExpandParams& p, float* out)
+{
+	return ComputeDepths(s, begin, end, nullptr, p, out);
+}
+
+float* ComputeParticleDepthsAt(const ParticleStreams& s, const unsigned int* slots, unsigned int count, const ParticleExpandParams& p, float* out)
+{
+	return ComputeDepths(s, 0, count, slots, p, out);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+//structure-of-arrays particle storage for the cpu emitter
+//only spawn state is stored, everything else is a function of age evaluated when the quads are built
+//every stream is 32 byte aligned and padded so the simd kernel can use aligned blocks
+struct ParticleStreams
+{
+	float* spawnTime = nullptr;
+	float* posX = nullptr, * posY = nullptr, * posZ = nullptr;
+	float* velX = nullptr, * velY = nullptr, * velZ = nullptr;
+	float* rotStart = nullptr, * rotEnd = nullptr;
+
+	unsigned int capacity = 0;
+
+	void Allocate(unsigned int count);
+	void Release();
+
+private:
+	float* m_block = nullptr;
+};
+
+//per frame values for evaluating particles at params.time and expanding them into camera facing quads
+struct ParticleExpandParams
+{
+	float time;
+	float acc[3];
+	float right[3], up[3], forward[3];
+	float startColor[4], endColor[4];
+	float startSize, endSize;
+	float invLifeTime;
+	float origin[3];
+};
+
+//floats in one billboard corner (position, color, uv), matching ParticleVertex and ParticleVS.hlsl
+const unsigned int c_particleVertexFloats = 9;
+
+//words in one instance record, matching ParticleInstanceVS.hlsl:
+//half position x | y, half position z | size, rgba8 color, half rotation
+//the position is relative to params.origin
+const unsigned int c_particleInstanceWords = 4;
+
+//evaluates every particle in [begin, end) at params.time in closed form and writes its four billboard corners to out
+//returns the end of what was written
+//out is only ever written, so it can point straight into a mapped write-combined buffer
+float* ExpandParticleQuads(const ParticleStreams& streams, unsigned int begin, unsigned int end, const ParticleExpandParams& params, float* out);
+
+//same evaluation, but writes one 16 byte instance record per particle and leaves the corners to the vertex shader
+unsigned int* ExpandParticleInstances(const ParticleStreams& streams, unsigned int begin, unsigned int end, const ParticleExpandParams& params, unsigned int* out);
+
+//the two expansions for the slots order[0..count) in that order, for depth sorted drawing
+float* ExpandSortedParticleQuads(const ParticleStreams& streams, const unsigned int* order, unsigned int count, const ParticleExpandParams& params, float* out);
+unsigned int* ExpandSortedParticleInstances(const ParticleStreams& streams, const unsigned int* order, unsigned int count, const ParticleExpandParams& params, unsigned int* out);
+
+//depth along params.forward of every particle in [begin, end) at params.time, without the camera translation
+//only the order matters for sorting, so the constant term is left out
+float* ComputeParticleDepths(const ParticleStreams& streams, unsigned int begin, unsigned int end, const ParticleExpandParams& params, float* out);
+
+//same for the slots slots[0..count)
+float* ComputeParticleDepthsAt(const ParticleStreams& streams, const unsigned int* slots, unsigned int count, const ParticleExpandParams& params, float* out);
@@ -0,0 +1,422 @@
+#include "ParticleSystemManager.h"
+#include <cmath>
+
+namespace
+{
+	//small enough to balance across cores, big enough that the job overhead disappears
+	const unsigned int c_emittersPerJob = 4;
+	const unsigned int c_particlesPerChunk = 4096;
+
+	//screen sizes from which an emitter draws every particle and steps every frame, and how far below that it may go
+	const float c_fullDetailSize = 0.25f;
+	const float c_fullRateSize = 0.1f;
+	const unsigned int c_maxDetail = 16;
+	const unsigned int c_maxUpdateInterval = 4;
+
+	//particles an emitter would draw at full detail
+	unsigned int ParticleCount(const Emitter* emitter) { return emitter->GetLiveParticles(); }
+	unsigned int ParticleCount(const HybridEmitter* emitter) { return emitter->GetLiveParticles(); }
+	unsigned int ParticleCount(const GPUEmitter* emitter) { return emitter->GetMaxParticles(); }
+}
+
+ParticleSystemManager::ParticleSystemManager(unsigned int workerCount)
+	: m_jobs(workerCount)
+{
+	m_cullSimulation = false;
+	m_budget = 0;
+	m_frame = 0;
+	m_pipelined = false;
+	m_inFlight = false;
+	m_pipelineContext = nullptr;
+}
+
+ParticleSystemManager::~ParticleSystemManager()
+{
+	DropPipeline();
+
+	for (Emitter* emitter : m_emitters) delete emitter;
+	for (HybridEmitter* emitter : m_hybridEmitters) delete emitter;
+	for (GPUEmitter* emitter : m_gpuEmitters) delete emitter;
+}
+
+Emitter* ParticleSystemManager::AddEmitter(Emitter* emitter, bool active)
+{
+	m_slots[emitter] = StateSlot{ &m_emitterStates, m_emitterStates.size() };
+	m_emitters.push_back(emitter);
+	m_emitterStates.push_back(EmitterState());
+	m_emitterStates.back().active = active;
+	return emitter;
+}
+
+HybridEmitter* ParticleSystemManager::AddEmitter(HybridEmitter* emitter, bool active)
+{
+	m_slots[emitter] = StateSlot{ &m_hybridStates, m_hybridStates.size() };
+	m_hybridEmitters.push_back(emitter);
+	m_hybridStates.push_back(EmitterState());
+	m_hybridStates.back().active = active;
+	return emitter;
+}
+
+GPUEmitter* ParticleSystemManager::AddEmitter(GPUEmitter* emitter, bool active)
+{
+	m_slots[emitter] = StateSlot{ &m_gpuStates, m_gpuStates.size() };
+	m_gpuEmitters.push_back(emitter);
+	m_gpuStates.push_back(EmitterState());
+	m_gpuStates.back().active = active;
+	return emitter;
+}
+
+void ParticleSystemManager::SetPipelined(bool enabled)
+{
+	if (enabled != m_pipelined)
+		DropPipeline();
+	m_pipelined = enabled;
+}
+
+void ParticleSystemManager::Sync()
+{
+	if (!m_inFlight)
+		return;
+
+	m_jobs.Wait(m_pipelineGroup);
+	m_inFlight = false;
+}
+
+void ParticleSystemManager::DropPipeline()
+{
+	//the step in flight finishes and keeps its result, only its upload is never drawn
+	Sync();
+	for (const PipelineItem& item : m_pipelineItems)
+	{
+		if (item.mapped)
+			item.emitter->EndUpload(m_pipelineContext);
+	}
+	m_pipelineItems.clear();
+}
+
+void ParticleSystemManager::SetActive(const void* emitter, bool active)
+{
+	auto slot = m_slots.find(emitter);
+	if (slot == m_slots.end())
+		return;
+
+	//coming back starts clean, not with the time it missed
+	EmitterState& state = (*slot->second.states)[slot->second.index];
+	state.active = active;
+	state.lag = 0.0f;
+}
+
+template <typename EmitterType>
+void ParticleSystemManager::TestEmitters(const std::vector<EmitterType*>& emitters, std::vector<EmitterState>& states, const ViewFrustum& frustum, const XMFLOAT3& eye, float focal)
+{
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		const ParticleBounds& bounds = emitters[i]->GetBounds();
+		EmitterState& state = states[i];
+
+		state.visible = state.active && IntersectsFrustum(bounds, frustum);
+		if (!state.visible)
+		{
+			state.screenSize = 0.0f;
+			continue;
+		}
+
+		//the bounding sphere of the box, projected at its center's distance
+		float center[3], radius = 0.0f, distance = 0.0f;
+		const float eyePos[3] = { eye.x, eye.y, eye.z };
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float extent = 0.5f * (bounds.max[axis] - bounds.min[axis]);
+			center[axis] = bounds.min[axis] + extent;
+			radius += extent * extent;
+			distance += (center[axis] - eyePos[axis]) * (center[axis] - eyePos[axis]);
+		}
+		radius = sqrtf(radius);
+		distance = sqrtf(distance);
+
+		state.screenSize = distance > radius ? radius * focal / distance : focal;
+	}
+}
+
+void ParticleSystemManager::UpdateVisibility(Camera* camera)
+{
+	//camera matrices are stored transposed for the shaders
+	XMFLOAT4X4 view = camera->GetView();
+	XMFLOAT4X4 projection = camera->GetProjection();
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixTranspose(XMMatrixMultiply(XMLoadFloat4x4(&projection), XMLoadFloat4x4(&view))));
+	ViewFrustum frustum = ExtractViewFrustum(viewProjection.m);
+
+	XMFLOAT3 eye = camera->GetPosition();
+	float focal = projection._22;
+
+	TestEmitters(m_emitters, m_emitterStates, frustum, eye, focal);
+	TestEmitters(m_hybridEmitters, m_hybridStates, frustum, eye, focal);
+	TestEmitters(m_gpuEmitters, m_gpuStates, frustum, eye, focal);
+}
+
+void ParticleSystemManager::UpdateDetail()
+{
+	//first from screen size alone: a quarter as large draws a quarter of the particles
+	std::vector<EmitterState>* stateLists[3] = { &m_emitterStates, &m_hybridStates, &m_gpuStates };
+	for (std::vector<EmitterState>* states : stateLists)
+	{
+		for (EmitterState& state : *states)
+		{
+			float size = max(state.screenSize, 1e-6f);
+			state.detail = size >= c_fullDetailSize ? 1 : min(c_maxDetail, (unsigned int)ceilf(c_fullDetailSize / size));
+			state.updateInterval = size >= c_fullRateSize ? 1 : min(c_maxUpdateInterval, (unsigned int)ceilf(c_fullRateSize / size));
+			state.dropped = false;
+		}
+	}
+
+	if (m_budget == 0)
+		return;
+
+	//a cpu emitter being stepped on a worker keeps the count it had when its step started
+	if (!m_inFlight)
+	{
+		for (size_t i = 0; i < m_emitters.size(); i++)
+			m_emitterStates[i].particles = ParticleCount(m_emitters[i]);
+	}
+	for (size_t i = 0; i < m_hybridEmitters.size(); i++)
+		m_hybridStates[i].particles = ParticleCount(m_hybridEmitters[i]);
+	for (size_t i = 0; i < m_gpuEmitters.size(); i++)
+		m_gpuStates[i].particles = ParticleCount(m_gpuEmitters[i]);
+
+	//then, when the visible emitters still draw more than the budget, all of them thin out by the same factor,
+	//and whole emitters go when that is not enough
+	m_budgeted.clear();
+	m_budgetedStates.clear();
+	for (std::vector<EmitterState>* states : stateLists)
+	{
+		for (EmitterState& state : *states)
+		{
+			if (!state.visible)
+				continue;
+			m_budgeted.push_back(BudgetedEmitter{ state.particles, state.screenSize, state.detail, false });
+			m_budgetedStates.push_back(&state);
+		}
+	}
+
+	FitParticleBudget(m_budgeted, m_budget, c_maxDetail);
+	for (size_t k = 0; k < m_budgeted.size(); k++)
+	{
+		m_budgetedStates[k]->detail = m_budgeted[k].detail;
+		m_budgetedStates[k]->dropped = m_budgeted[k].dropped;
+	}
+}
+
+void ParticleSystemManager::Update(float dt, float totalTime, Camera* camera)
+{
+	UpdateVisibility(camera);
+	UpdateDetail();
+	m_frame++;
+
+	//an emitter steps when its interval comes round, staggered by index so the slow ones spread over frames
+	//culled ones have no screen size so they step at the slowest rate, or not at all with m_cullSimulation
+	auto stepsNow = [this](EmitterState& state, size_t index, float dt)
+	{
+		if (!state.active)
+			return false;
+
+		state.lag += dt;
+		if (!state.visible && m_cullSimulation)
+			return false;
+		return (m_frame + index) % state.updateInterval == 0;
+	};
+
+	for (size_t i = 0; i < m_hybridEmitters.size(); i++)
+		m_hybridEmitters[i]->SetDetail(m_hybridStates[i].detail);
+
+	//cpu emitters only touch their own memory while stepping, so they all go wide
+	//they step in closed form, so one late step with the banked time equals all the skipped ones
+	//pipelined, they may be stepping on a worker right now, so the time is only banked for the next launch
+	JobGroup group;
+	if (m_pipelined)
+	{
+		for (EmitterState& state : m_emitterStates)
+			if (state.active) state.lag += dt;
+	}
+	else
+	{
+		for (size_t i = 0; i < m_emitters.size(); i++)
+			m_emitters[i]->SetDetail(m_emitterStates[i].detail);
+
+		m_jobs.ParallelFor(group, (unsigned int)m_emitters.size(), c_emittersPerJob, [this, dt, &stepsNow](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+			{
+				EmitterState& state = m_emitterStates[i];
+				if (stepsNow(state, i, dt))
+				{
+					m_emitters[i]->UpdateEmitter(state.lag);
+					state.lag = 0.0f;
+				}
+			}
+		});
+	}
+	m_jobs.ParallelFor(group, (unsigned int)m_hybridEmitters.size(), c_emittersPerJob, [this, dt, &stepsNow](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			EmitterState& state = m_hybridStates[i];
+			if (stepsNow(state, i, dt))
+			{
+				m_hybridEmitters[i]->UpdateEmitter(state.lag);
+				state.lag = 0.0f;
+			}
+		}
+	});
+
+	//gpu emitters dispatch on the context, so they run here while the workers step the rest
+	//they integrate step by step, so they never stop, and a slow one just takes longer steps
+	for (size_t i = 0; i < m_gpuEmitters.size(); i++)
+	{
+		EmitterState& state = m_gpuStates[i];
+		if (!state.active)
+			continue;
+
+		state.lag += dt;
+		if (state.visible && (m_frame + i) % state.updateInterval != 0)
+			continue;
+
+		m_gpuEmitters[i]->SetDetail(state.detail);
+		m_gpuEmitters[i]->SetViewPosition(camera->GetPosition());
+		m_gpuEmitters[i]->Update(state.lag, totalTime);
+		state.lag = 0.0f;
+	}
+
+	m_jobs.Wait(group);
+}
+
+void ParticleSystemManager::Draw(ID3D11DeviceContext* context, Camera* camera)
+{
+	//the camera may have moved since Update, detail stays as Update chose it
+	UpdateVisibility(camera);
+
+	if (m_pipelined)
+	{
+		//the fence: everything the workers built since the last Draw is finished and gets submitted now
+		Sync();
+		for (const PipelineItem& item : m_pipelineItems)
+		{
+			if (!item.mapped)
+				continue;
+
+			item.emitter->EndUpload(context);
+			item.emitter->Draw(context, camera);
+		}
+		m_pipelineItems.clear();
+
+		DrawGpuSideEmitters(context, camera);
+		LaunchPipeline(context, camera);
+		return;
+	}
+
+	//map every upload on this thread, then let the workers fill the mapped memory in chunks
+	m_chunks.clear();
+	for (size_t i = 0; i < m_emitters.size(); i++)
+	{
+		Emitter* emitter = m_emitters[i];
+		if (!m_emitterStates[i].Drawn() || !emitter->BeginUpload(context, camera))
+			continue;
+
+		unsigned int drawn = emitter->GetDrawCount();
+		for (unsigned int first = 0; first < drawn; first += c_particlesPerChunk)
+			m_chunks.push_back(ExpandChunk{ emitter, first, min(c_particlesPerChunk, drawn - first) });
+	}
+
+	JobGroup group;
+	m_jobs.ParallelFor(group, (unsigned int)m_chunks.size(), 1, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+			m_chunks[i].emitter->ExpandRange(m_chunks[i].first, m_chunks[i].count);
+	});
+	m_jobs.Wait(group);
+
+	//joined, so everything below is single threaded submission
+	for (size_t i = 0; i < m_emitters.size(); i++)
+	{
+		if (!m_emitterStates[i].Drawn())
+			continue;
+
+		m_emitters[i]->EndUpload(context);
+		m_emitters[i]->Draw(context, camera);
+	}
+
+	DrawGpuSideEmitters(context, camera);
+}
+
+void ParticleSystemManager::DrawGpuSideEmitters(ID3D11DeviceContext* context, Camera* camera)
+{
+	for (size_t i = 0; i < m_hybridEmitters.size(); i++)
+	{
+		if (m_hybridStates[i].Drawn())
+			m_hybridEmitters[i]->DrawEmitter(context, camera);
+	}
+
+	for (size_t i = 0; i < m_gpuEmitters.size(); i++)
+	{
+		if (m_gpuStates[i].Drawn())
+			m_gpuEmitters[i]->Draw(camera);
+	}
+}
+
+void ParticleSystemManager::LaunchPipeline(ID3D11DeviceContext* context, Camera* camera)
+{
+	//nothing is in flight, so the cpu emitters can be read and configured here
+	//the workers get their own copy of the view, the camera moves on before they finish
+	m_pipelineContext = context;
+	m_pipelineView = camera->GetView();
+
+	for (size_t i = 0; i < m_emitters.size(); i++)
+	{
+		EmitterState& state = m_emitterStates[i];
+		state.particles = m_emitters[i]->GetLiveParticles();
+		if (!state.active)
+			continue;
+
+		bool steps = (state.visible || !m_cullSimulation) && (m_frame + i) % state.updateInterval == 0;
+		if (!steps && !state.Drawn())
+			continue;
+
+		m_emitters[i]->SetDetail(state.detail);
+		PipelineItem item = { m_emitters[i], state.lag, steps, state.Drawn() && m_emitters[i]->MapUpload(context) };
+		if (steps)
+			state.lag = 0.0f;
+		m_pipelineItems.push_back(item);
+	}
+
+	if (m_pipelineItems.empty())
+		return;
+
+	//one job per emitter steps it, then spreads its expansion over the pool again
+	m_inFlight = true;
+	m_jobs.ParallelFor(m_pipelineGroup, (unsigned int)m_pipelineItems.size(), 1, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			const PipelineItem& item = m_pipelineItems[i];
+			if (item.steps)
+				item.emitter->UpdateEmitter(item.dt);
+			if (!item.mapped)
+				continue;
+
+			Emitter* emitter = item.emitter;
+			emitter->PrepareUpload(m_pipelineView);
+			unsigned int drawn = emitter->GetDrawCount();
+
+			JobGroup expand;
+			m_jobs.ParallelFor(expand, (drawn + c_particlesPerChunk - 1) / c_particlesPerChunk, 1, [emitter, drawn](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int chunk = begin; chunk < end; chunk++)
+				{
+					unsigned int first = chunk * c_particlesPerChunk;
+					emitter->ExpandRange(first, min(c_particlesPerChunk, drawn - first));
+				}
+			});
+			m_jobs.Wait(expand);
+		}
+	});
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Emitter.h"
+#include "HybridEmitter.h"
+#include "GpuEmitter.h"
+#include "ParticleBounds.h"
+#include "ParticleBudget.h"
+
+//owns every particle emitter and runs the cpu side of them on a work stealing pool
+//emitter steps run as parallel jobs, and the quad/instance expansion of each cpu emitter
+//is split into chunks so one huge emitter spreads across every core too
+//everything touching the d3d context stays on the calling thread, and Draw joins all jobs before submitting
+//emitters whose lifetime bounds miss the camera frustum are not expanded, uploaded or drawn
+//emitters small on screen draw a fraction of their particles and step less often, and a particle budget caps the total
+//optionally the cpu emitters step and expand on the workers while the next frame is built, see SetPipelined
+class ParticleSystemManager
+{
+private:
+	JobSystem m_jobs;
+
+	std::vector<Emitter*> m_emitters;
+	std::vector<HybridEmitter*> m_hybridEmitters;
+	std::vector<GPUEmitter*> m_gpuEmitters;
+
+	//one expansion job: a piece of one emitter's live particles
+	struct ExpandChunk
+	{
+		Emitter* emitter;
+		unsigned int first, count;
+	};
+	std::vector<ExpandChunk> m_chunks;
+
+	//culling and level of detail of one emitter
+	struct EmitterState
+	{
+		//inactive emitters are pooled, neither stepped nor drawn
+		bool active = true;
+		bool visible = true;
+
+		//projected radius of the bounds, in half screen heights
+		float screenSize = 0.0f;
+
+		//draws one particle in detail and steps every updateInterval frames, with the time it has not stepped yet in lag
+		unsigned int detail = 1, updateInterval = 1;
+		float lag = 0.0f;
+
+		//particles at full detail as of the last time the emitter could be read, for the budget
+		unsigned int particles = 0;
+
+		//in view but left out by the budget, even the most thinned out emitters drew more than it allows
+		bool dropped = false;
+
+		bool Drawn() const { return visible && !dropped; }
+	};
+	std::vector<EmitterState> m_emitterStates, m_hybridStates, m_gpuStates;
+
+	//the visible emitters handed to FitParticleBudget, and whose state each one is
+	std::vector<BudgetedEmitter> m_budgeted;
+	std::vector<EmitterState*> m_budgetedStates;
+
+	//where each emitter's state lives, for SetActive
+	struct StateSlot
+	{
+		std::vector<EmitterState>* states;
+		size_t index;
+	};
+	std::unordered_map<const void*, StateSlot> m_slots;
+
+	bool m_cullSimulation;
+	unsigned int m_budget;
+	unsigned int m_frame;
+
+	//pipelined mode: one cpu emitter's part of the step in flight
+	struct PipelineItem
+	{
+		Emitter* emitter;
+		float dt;
+		bool steps, mapped;
+	};
+	bool m_pipelined, m_inFlight;
+	JobGroup m_pipelineGroup;
+	std::vector<PipelineItem> m_pipelineItems;
+	ID3D11DeviceContext* m_pipelineContext;
+	XMFLOAT4X4 m_pipelineView;
+
+	void LaunchPipeline(ID3D11DeviceContext* context, Camera* camera);
+	void DrawGpuSideEmitters(ID3D11DeviceContext* context, Camera* camera);
+	void DropPipeline();
+
+	template <typename EmitterType>
+	static void TestEmitters(const std::vector<EmitterType*>& emitters, std::vector<EmitterState>& states, const ViewFrustum& frustum, const XMFLOAT3& eye, float focal);
+	void UpdateVisibility(Camera* camera);
+	void UpdateDetail();
+
+public:
+	//workerCount 0 uses every hardware thread
+	explicit ParticleSystemManager(unsigned int workerCount = 0);
+	~ParticleSystemManager();
+
+	//the manager takes ownership
+	Emitter* AddEmitter(Emitter* emitter, bool active = true);
+	HybridEmitter* AddEmitter(HybridEmitter* emitter, bool active = true);
+	GPUEmitter* AddEmitter(GPUEmitter* emitter, bool active = true);
+
+	//switches an emitter in or out of the frame without giving up its buffers, see ParticleEffects
+	void SetActive(const void* emitter, bool active);
+
+	//cpu emitters out of view stop stepping and catch up in one closed form step when they come back;
+	//gpu emitters always step, their state only exists as the result of every step
+	void SetCullSimulation(bool enabled) { m_cullSimulation = enabled; }
+
+	//most particles drawn per frame across every emitter, 0 for no limit
+	//gpu emitters count at their capacity, their live count never reaches the cpu
+	//emitters thin out together first, and past the most level of detail allows the smallest on screen are not drawn
+	void SetParticleBudget(unsigned int budget) { m_budget = budget; }
+
+	//cpu emitters run a frame ahead: Draw submits what the workers built during the previous frame, then maps
+	//and starts the next step, which overlaps everything up to the next Draw; their effects show one frame late
+	void SetPipelined(bool enabled);
+
+	//waits for the pipelined step in flight, needed before touching a cpu emitter from outside the manager
+	void Sync();
+
+	void Update(float dt, float totalTime, Camera* camera);
+	void Draw(ID3D11DeviceContext* context, Camera* camera);
+
+	JobSystem& GetJobs() { return m_jobs; }
+};
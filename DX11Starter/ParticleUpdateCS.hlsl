@@ -1,4 +1,6 @@
 #include "ParticleIncludes.hlsli"
+#include "ForceField.hlsli"
+#include "Heightfield.hlsli"
 
 cbuffer ExternalData : register(b0) 
 {
@@ -11,6 +13,9 @@ cbuffer ExternalData : register(b0)
 	float startSize;
 	float endSize;
 	int maxParticles;
+
+	//sort key origin
+	float3 viewPos;
 }
 
 RWStructuredBuffer<Particle> ParticlePool : register (u0);
@@ -28,7 +33,10 @@ void main( uint3 id : SV_DispatchThreadID )
 
 	particle.Age += dt;
 	particle.Alive = (float)(particle.Age < lifeTime);
+	particle.Velocity += ForceAt(particle.Position, totalTime) * dt;
 	particle.Position += particle.Velocity * dt;
+	if (CollideGround(particle.Position, particle.Velocity))
+		particle.Alive = 0.0f;
 
 	particle.Age += dt;
 
@@ -48,7 +56,8 @@ void main( uint3 id : SV_DispatchThreadID )
 
 		ParticleDraw drawData;
 		drawData.Index = id.x;
-		//drawData.DistanceSq = 0.0f;
+		float3 toView = particle.Position - viewPos;
+		drawData.DistanceSq = dot(toView, toView);
 
 		DrawList[drawIndex] = drawData;
 	}
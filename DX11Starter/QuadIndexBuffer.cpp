@@ -0,0 +1,109 @@
+#include "QuadIndexBuffer.h"
+#include <vector>
+
+ID3D11Buffer* QuadIndexBuffer::s_shortBuffer = nullptr;
+ID3D11Buffer* QuadIndexBuffer::s_longBuffer = nullptr;
+unsigned int QuadIndexBuffer::s_shortQuads = 0;
+unsigned int QuadIndexBuffer::s_longQuads = 0;
+unsigned int QuadIndexBuffer::s_users = 0;
+
+namespace
+{
+	//grow in powers of two so a run of slightly bigger emitters does not rebuild the buffer every time
+	const unsigned int c_minQuads = 256;
+
+	unsigned int GrowQuads(unsigned int quadCount)
+	{
+		unsigned int quads = c_minQuads;
+		while (quads < quadCount)
+			quads *= 2;
+		return quads;
+	}
+
+	template <typename T>
+	void FillQuadIndices(std::vector<T>& indices, unsigned int quadCount)
+	{
+		indices.resize(quadCount * 6);
+		for (unsigned int quad = 0; quad < quadCount; quad++)
+		{
+			T vertex = (T)(quad * 4);
+			T* out = &indices[quad * 6];
+			out[0] = vertex;
+			out[1] = vertex + 1;
+			out[2] = vertex + 2;
+			out[3] = vertex;
+			out[4] = vertex + 2;
+			out[5] = vertex + 3;
+		}
+	}
+}
+
+ID3D11Buffer* QuadIndexBuffer::Create(ID3D11Device* device, unsigned int quadCount, bool shortIndices)
+{
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int> indices32;
+
+	D3D11_SUBRESOURCE_DATA indexData = {};
+	D3D11_BUFFER_DESC indexDesc = {};
+	indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexDesc.CPUAccessFlags = 0;
+	indexDesc.Usage = D3D11_USAGE_IMMUTABLE;
+
+	if (shortIndices)
+	{
+		FillQuadIndices(indices16, quadCount);
+		indexData.pSysMem = indices16.data();
+		indexDesc.ByteWidth = sizeof(unsigned short) * 6 * quadCount;
+	}
+	else
+	{
+		FillQuadIndices(indices32, quadCount);
+		indexData.pSysMem = indices32.data();
+		indexDesc.ByteWidth = sizeof(unsigned int) * 6 * quadCount;
+	}
+
+	ID3D11Buffer* buffer = nullptr;
+	device->CreateBuffer(&indexDesc, &indexData, &buffer);
+	return buffer;
+}
+
+void QuadIndexBuffer::Acquire(ID3D11Device* device, unsigned int quadCount)
+{
+	s_users++;
+
+	//buffers are only bound at draw time, so replacing a smaller one never leaves an emitter holding a stale pointer
+	if (quadCount <= c_maxShortQuads)
+	{
+		if (quadCount > s_shortQuads || !s_shortBuffer)
+		{
+			if (s_shortBuffer) s_shortBuffer->Release();
+			s_shortQuads = min(GrowQuads(quadCount), c_maxShortQuads);
+			s_shortBuffer = Create(device, s_shortQuads, true);
+		}
+	}
+	else if (quadCount > s_longQuads || !s_longBuffer)
+	{
+		if (s_longBuffer) s_longBuffer->Release();
+		s_longQuads = GrowQuads(quadCount);
+		s_longBuffer = Create(device, s_longQuads, false);
+	}
+}
+
+void QuadIndexBuffer::Release()
+{
+	if (s_users == 0 || --s_users > 0)
+		return;
+
+	if (s_shortBuffer) s_shortBuffer->Release();
+	if (s_longBuffer) s_longBuffer->Release();
+	s_shortBuffer = s_longBuffer = nullptr;
+	s_shortQuads = s_longQuads = 0;
+}
+
+void QuadIndexBuffer::Bind(ID3D11DeviceContext* context, unsigned int quadCount)
+{
+	if (quadCount <= c_maxShortQuads && s_shortBuffer)
+		context->IASetIndexBuffer(s_shortBuffer, DXGI_FORMAT_R16_UINT, 0);
+	else
+		context->IASetIndexBuffer(s_longBuffer, DXGI_FORMAT_R32_UINT, 0);
+}
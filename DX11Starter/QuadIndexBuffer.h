@@ -0,0 +1,27 @@
+#pragma once
+
+#include <d3d11.h>
+
+//the quad index buffer (0 1 2, 0 2 3 for every four vertices) that all particle emitters share
+//it is reference counted like Texture's sampler and only ever grows, so emitters created later are cheap
+//pools of up to c_maxShortQuads quads are drawn from a 16 bit copy
+class QuadIndexBuffer
+{
+private:
+	static ID3D11Buffer* s_shortBuffer, * s_longBuffer;
+	static unsigned int s_shortQuads, s_longQuads;
+	static unsigned int s_users;
+
+	static ID3D11Buffer* Create(ID3D11Device* device, unsigned int quadCount, bool shortIndices);
+
+public:
+	//every vertex of the last quad still fits a 16 bit index
+	static const unsigned int c_maxShortQuads = 65536 / 4;
+
+	//registers a user and grows the shared buffer to cover quadCount quads
+	static void Acquire(ID3D11Device* device, unsigned int quadCount);
+	static void Release();
+
+	//binds the smallest index format that covers quadCount quads
+	static void Bind(ID3D11DeviceContext* context, unsigned int quadCount);
+};
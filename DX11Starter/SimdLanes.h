@@ -0,0 +1,31 @@
+#pragma once
+
+#include <emmintrin.h>
+
+//sse loads and stores of count lanes of a float stream, the rest zero; a range's last block may end past the stream
+//shared by the cpu particle kernels that walk their streams four at a time
+
+inline __m128 LoadLanes(const float* source, unsigned int count)
+{
+	if (count == 4)
+		return _mm_loadu_ps(source);
+
+	alignas(16) float lanes[4] = {};
+	for (unsigned int k = 0; k < count; k++)
+		lanes[k] = source[k];
+	return _mm_load_ps(lanes);
+}
+
+inline void StoreLanes(float* destination, __m128 value, unsigned int count)
+{
+	if (count == 4)
+	{
+		_mm_storeu_ps(destination, value);
+		return;
+	}
+
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, value);
+	for (unsigned int k = 0; k < count; k++)
+		destination[k] = lanes[k];
+}
@@ -0,0 +1,25 @@
+#include "SpawnSchedule.h"
+#include <cmath>
+
+double SpawnSchedule::SpawnTime(unsigned int index) const
+{
+	if (index < burstCount)
+		return 0.0;
+
+	return (double)(index - burstCount + 1) * interval;
+}
+
+unsigned int SpawnSchedule::SpawnedBy(double time) const
+{
+	if (time < 0.0)
+		return 0;
+
+	//the division can land one off at exact spawn times, so settle it against SpawnTime's own products
+	unsigned int steps = (unsigned int)floor(time / interval);
+	while ((double)(steps + 1) * interval <= time)
+		steps++;
+	while (steps > 0 && (double)steps * interval > time)
+		steps--;
+
+	return burstCount + steps;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+//when every particle of an emitter is born, as a pure function of its spawn index
+//burstCount particles at time zero, then one every interval after that
+//with spawn state coming from the counter rng, the live set at any time can be rebuilt without stepping
+struct SpawnSchedule
+{
+	unsigned int burstCount = 0;
+	double interval = 1.0;
+
+	double SpawnTime(unsigned int index) const;
+
+	//how many particles have a spawn time at or before time
+	unsigned int SpawnedBy(double time) const;
+};
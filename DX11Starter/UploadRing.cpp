@@ -0,0 +1,42 @@
+#include "UploadRing.h"
+
+UploadRing::UploadRing()
+{
+	m_capacity = 0;
+	m_cursor = 0;
+}
+
+void UploadRing::Reset(unsigned int capacity)
+{
+	m_capacity = capacity;
+
+	//a fresh buffer has to be DISCARDed once before NO_OVERWRITE is allowed
+	m_cursor = capacity + 1;
+}
+
+void* UploadRing::Append(ID3D11DeviceContext* context, ID3D11Buffer* buffer, unsigned int count, unsigned int stride, unsigned int& offset)
+{
+	if (!CanAppend(count))
+	{
+		offset = 0;
+		return Restart(context, buffer, count);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))
+		return nullptr;
+
+	offset = m_cursor;
+	m_cursor += count;
+	return static_cast<char*>(mapped.pData) + (size_t)offset * stride;
+}
+
+void* UploadRing::Restart(ID3D11DeviceContext* context, ID3D11Buffer* buffer, unsigned int count)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return nullptr;
+
+	m_cursor = count;
+	return mapped.pData;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <d3d11.h>
+
+//how many full pools worth of data an upload ring holds before it has to wrap
+const unsigned int c_uploadRingFrames = 3;
+
+//append-only upload region inside a dynamic buffer
+//appends map with NO_OVERWRITE behind everything written since the last DISCARD,
+//so the gpu never sees data it may still be reading change; DISCARD only happens on wrap
+class UploadRing
+{
+	unsigned int m_capacity, m_cursor;
+
+public:
+	UploadRing();
+
+	void Reset(unsigned int capacity);
+
+	//true when count more elements still fit behind the cursor
+	bool CanAppend(unsigned int count) const { return m_cursor + count <= m_capacity; }
+
+	//maps room for count elements of size stride, appending when it fits and restarting from zero with DISCARD otherwise
+	//offset receives the element index the returned pointer corresponds to
+	void* Append(ID3D11DeviceContext* context, ID3D11Buffer* buffer, unsigned int count, unsigned int stride, unsigned int& offset);
+
+	//always DISCARDs and starts again from element zero
+	void* Restart(ID3D11DeviceContext* context, ID3D11Buffer* buffer, unsigned int count);
+};
@@ -0,0 +1,307 @@
+//headless report of what the mesh optimization passes buy, on the same portable code the game loads meshes with:
+//every model is loaded and welded the way Mesh does it, then the passes of Mesh::Optimize run one after another and
+//the index and vertex order is measured after each
+//  acmr       vertex shader runs per triangle in a fifo post transform cache (3 at worst, about 0.5 at best)
+//  atvr       vertex shader runs per used vertex (1 at best)
+//  overfetch  vertex bytes read from memory per used vertex byte (1 at best)
+//
+//usage: MeshBench [model.obj ...] [--grid 1000] [--cache 16] [--threads 4] [--cook dir] [--encode 1] [--csv results.csv]
+//grid adds a flat grid of that many corners a side twice: in plain rows, and banded by BuildGridIndices the way the
+//game's water and terrain are built, whose input line is what the game draws
+//cache is the fifo size acmr and atvr are measured with; the reorder itself always aims at c_vertexCacheSize
+//cook writes every model's mesh file into dir (see MeshCache.h) and times loading it back against loading the obj
+//encode 1 writes them with MeshEncoding_Codec, the way they ship, and reports the size against raw and the decode speed
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+#include "ObjParser.h"
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	//laid out like Vertex, so the fetch numbers are the game's
+	struct BenchVertex
+	{
+		float position[3];
+		float normal[3];
+		float uv[2];
+	};
+
+	struct BenchMesh
+	{
+		std::string name;
+		std::vector<BenchVertex> vertices;
+		std::vector<unsigned int> indices;
+		double loadMs = 0;
+	};
+
+	double ElapsedMs(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	//parsed, welded and turned left handed like the Mesh constructor does, so the order the passes start from is the file's
+	bool LoadBenchMesh(const char* path, JobSystem* jobs, BenchMesh& mesh)
+	{
+		Clock::time_point start = Clock::now();
+		ObjData obj;
+		std::string error;
+		if (!LoadObj(path, obj, error, jobs))
+		{
+			fprintf(stderr, "%s: %s\n", path, error.c_str());
+			return false;
+		}
+
+		ObjArray<ObjCorner> unique;
+		ObjArray<uint32_t> remap;
+		WeldObj(obj, unique, remap, jobs);
+
+		mesh.name = path;
+		mesh.vertices.resize(unique.size());
+		for (size_t i = 0; i < unique.size(); i++)
+		{
+			BenchVertex& v = mesh.vertices[i];
+			memset(&v, 0, sizeof(v));
+			memcpy(v.position, &obj.positions[(size_t)unique[i].position * 3], sizeof(v.position));
+			v.position[2] = -v.position[2];
+			if (unique[i].normal != c_objNone)
+				memcpy(v.normal, &obj.normals[(size_t)unique[i].normal * 3], sizeof(v.normal));
+			if (unique[i].uv != c_objNone)
+				memcpy(v.uv, &obj.uvs[(size_t)unique[i].uv * 2], sizeof(v.uv));
+		}
+
+		mesh.indices.assign(remap.begin(), remap.end());
+		for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+			std::swap(mesh.indices[t + 1], mesh.indices[t + 2]);
+		mesh.loadMs = ElapsedMs(start);
+		return true;
+	}
+
+	//size x size corners one unit apart, two triangles a cell, in rows or in Game::CreateWaterMesh's bands
+	BenchMesh BenchGrid(unsigned int size, bool banded)
+	{
+		BenchMesh mesh;
+		mesh.name = "grid " + std::to_string(size) + (banded ? " banded" : " rows");
+		mesh.vertices.resize((size_t)size * size);
+		for (unsigned int i = 0; i < size; i++)
+		{
+			for (unsigned int j = 0; j < size; j++)
+			{
+				BenchVertex v = { { (float)i, 0, (float)j }, { 0, 1, 0 }, { i / 50.0f, j / 50.0f } };
+				mesh.vertices[i * size + j] = v;
+			}
+		}
+
+		if (banded)
+		{
+			Clock::time_point start = Clock::now();
+			mesh.indices.resize(GridIndexCount(size, size));
+			BuildGridIndices(mesh.indices.data(), size, size);
+			mesh.loadMs = ElapsedMs(start);
+			return mesh;
+		}
+
+		for (unsigned int i = 0; i + 1 < size; i++)
+		{
+			for (unsigned int j = 0; j + 1 < size; j++)
+			{
+				unsigned int a = i * size + j, b = a + size;
+				unsigned int quad[6] = { a, a + 1, b, a + 1, b + 1, b };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+		return mesh;
+	}
+
+	//cooks the model into dir, then maps the file back as Mesh does on a later launch and decodes it into the memory the
+	//upload would read, which for a raw file is a copy
+	void ReportCooked(const char* path, const char* dir, MeshEncoding encoding, JobSystem* jobs)
+	{
+		std::string name(path);
+		size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos)
+			name = name.substr(slash + 1);
+		std::string cachePath = std::string(dir) + "/" + name.substr(0, name.rfind('.')) + ".mesh";
+
+		Clock::time_point start = Clock::now();
+		CookedMesh cooked;
+		std::string error;
+		if (!CookObj(path, cooked, error, jobs) || !WriteMeshFile(cachePath.c_str(), cooked, path, error, encoding))
+		{
+			fprintf(stderr, "%s: %s\n", path, error.c_str());
+			return;
+		}
+		double cookMs = ElapsedMs(start);
+
+		start = Clock::now();
+		MeshFile file;
+		if (!file.Open(cachePath.c_str(), c_meshFileVertexLayout, error) || !file.IsCurrent(path))
+		{
+			fprintf(stderr, "%s: %s\n", cachePath.c_str(), error.empty() ? "not current" : error.c_str());
+			return;
+		}
+		const MeshFileHeader& header = file.GetHeader();
+		ObjArray<MeshFileVertex> vertices(header.vertexCount);
+		ObjArray<uint32_t> indices(header.indexCount);
+		Clock::time_point decodeStart = Clock::now();
+		if (!file.Decode(vertices.data(), indices.data()))
+		{
+			fprintf(stderr, "%s: does not decode\n", cachePath.c_str());
+			return;
+		}
+		double decodeMs = ElapsedMs(decodeStart);
+		double loadMs = ElapsedMs(start);
+
+		//what the codec costs against the cooked mesh: bytes on disk, and how far quantizing moved any attribute
+		uint64_t rawBytes = header.vertexCount * sizeof(MeshFileVertex) + header.indexCount * sizeof(uint32_t);
+		uint64_t fileBytes = header.vertexBytes + header.indexBytes;
+		float worst = 0;
+		for (size_t v = 0; v < vertices.size(); v++)
+		{
+			const float* a = reinterpret_cast<const float*>(&vertices[v]);
+			const float* b = reinterpret_cast<const float*>(&cooked.vertices[v]);
+			for (size_t k = 0; k < sizeof(MeshFileVertex) / sizeof(float); k++)
+				worst = std::max(worst, std::abs(a[k] - b[k]));
+		}
+		bool same = memcmp(indices.data(), cooked.indices.data(), indices.size() * sizeof(uint32_t)) == 0;
+
+		printf("  cooked to %s: cook and write %.1f ms, map, check and decode %.1f ms\n", cachePath.c_str(), cookMs, loadMs);
+		printf("  %llu of %llu bytes (%.2fx), decoded at %.2f GB/s, worst attribute error %g, indices %s\n",
+			(unsigned long long)fileBytes, (unsigned long long)rawBytes, (double)rawBytes / std::max<uint64_t>(fileBytes, 1),
+			rawBytes / std::max(decodeMs, 1e-6) / 1e6, worst, same ? "exact" : "DIFFER");
+	}
+
+	void Report(FILE* csv, const BenchMesh& mesh, const char* stage, unsigned int vertexCount, unsigned int cacheSize, double ms)
+	{
+		unsigned int indexCount = (unsigned int)mesh.indices.size();
+		VertexCacheStats cache = AnalyzeVertexCache(mesh.indices.data(), indexCount, vertexCount, cacheSize);
+		VertexFetchStats fetch = AnalyzeVertexFetch(mesh.indices.data(), indexCount, vertexCount, sizeof(BenchVertex));
+
+		printf("  %-9s %7.3f %7.3f %9.3f %10.1f\n", stage, cache.acmr, cache.atvr, fetch.overfetch, ms);
+		if (csv)
+		{
+			fprintf(csv, "\"%s\",%u,%u,%s,%u,%.4f,%.4f,%.4f,%.2f\n",
+				mesh.name.c_str(), vertexCount, indexCount / 3, stage, cacheSize, cache.acmr, cache.atvr, fetch.overfetch, ms);
+			fflush(csv);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const char*> models;
+	unsigned int gridSize = 0;
+	unsigned int cacheSize = c_vertexCacheSize;
+	unsigned int threads = 1;
+	const char* cookDir = nullptr;
+	MeshEncoding encoding = MeshEncoding_Raw;
+	const char* csvPath = nullptr;
+
+	auto toUint = [](const char* s) { return (unsigned int)strtoul(s, nullptr, 10); };
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option.compare(0, 2, "--") != 0) { models.push_back(argv[i]); continue; }
+		if (i + 1 >= argc)
+		{
+			fprintf(stderr, "%s needs a value\n", argv[i]);
+			return 1;
+		}
+		if (option == "--grid") gridSize = toUint(argv[++i]);
+		else if (option == "--cache") cacheSize = toUint(argv[++i]);
+		else if (option == "--threads") threads = toUint(argv[++i]);
+		else if (option == "--cook") cookDir = argv[++i];
+		else if (option == "--encode") encoding = toUint(argv[++i]) ? MeshEncoding_Codec : MeshEncoding_Raw;
+		else if (option == "--csv") csvPath = argv[++i];
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (models.empty() && gridSize == 0)
+	{
+		fprintf(stderr, "usage: MeshBench [model.obj ...] [--grid 1000] [--cache 16] [--threads 4] [--cook dir] [--encode 1] [--csv results.csv]\n");
+		return 1;
+	}
+
+	FILE* csv = nullptr;
+	if (csvPath)
+	{
+		csv = fopen(csvPath, "w");
+		if (!csv)
+		{
+			fprintf(stderr, "cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "mesh,vertices,triangles,stage,cache,acmr,atvr,overfetch,ms\n");
+	}
+
+	//the calling thread helps in Wait, so n threads is n - 1 workers
+	std::unique_ptr<JobSystem> jobs;
+	if (threads > 1)
+		jobs.reset(new JobSystem(threads - 1));
+
+	std::vector<BenchMesh> meshes;
+	for (const char* model : models)
+	{
+		BenchMesh mesh;
+		if (LoadBenchMesh(model, jobs.get(), mesh))
+			meshes.push_back(std::move(mesh));
+	}
+	if (cookDir)
+	{
+		for (const char* model : models)
+		{
+			printf("%s:\n", model);
+			ReportCooked(model, cookDir, encoding, jobs.get());
+		}
+	}
+	if (gridSize > 1)
+	{
+		meshes.push_back(BenchGrid(gridSize, false));
+		meshes.push_back(BenchGrid(gridSize, true));
+	}
+
+	for (BenchMesh& mesh : meshes)
+	{
+		unsigned int vertexCount = (unsigned int)mesh.vertices.size();
+		unsigned int indexCount = (unsigned int)mesh.indices.size();
+		printf("%s: %u vertices, %u triangles\n", mesh.name.c_str(), vertexCount, indexCount / 3);
+		if (indexCount < 3)
+			continue;
+		printf("  %-9s %7s %7s %9s %10s\n", "stage", "acmr", "atvr", "overfetch", "ms");
+		Report(csv, mesh, "input", vertexCount, cacheSize, mesh.loadMs);
+
+		//the passes in Mesh::Optimize's order, each timed on its own
+		Clock::time_point start = Clock::now();
+		OptimizeVertexCache(mesh.indices.data(), indexCount, vertexCount);
+		Report(csv, mesh, "cache", vertexCount, cacheSize, ElapsedMs(start));
+
+		start = Clock::now();
+		OptimizeOverdraw(mesh.indices.data(), indexCount, mesh.vertices[0].position, sizeof(BenchVertex), vertexCount);
+		Report(csv, mesh, "overdraw", vertexCount, cacheSize, ElapsedMs(start));
+
+		start = Clock::now();
+		vertexCount = OptimizeVertexFetch(mesh.vertices.data(), sizeof(BenchVertex), vertexCount, mesh.indices.data(), indexCount);
+		Report(csv, mesh, "fetch", vertexCount, cacheSize, ElapsedMs(start));
+	}
+
+	if (csv)
+		fclose(csv);
+	return 0;
+}
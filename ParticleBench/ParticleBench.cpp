@@ -0,0 +1,892 @@
+//headless benchmark of the three emitter designs, on the same portable code the game runs:
+//  cpu     Emitter: closed form live range, SoA spawn, quad expansion on the cpu
+//  hybrid  HybridEmitter: record spawn and retire on the cpu, only new records uploaded, expansion in the vertex shader
+//  gpu     GPUEmitter through GpuParticleReference: the compute kernels run on the cpu
+//every design runs to steady state first, then a fixed number of 60hz frames is timed phase by phase
+//
+//usage: ParticleBench [--pools 1000,10000,...] [--fill 0.5,1,2] [--threads 1,4,...] [--designs cpu,hybrid,gpu]
+//                     [--frames 60] [--curl 0] [--surface 0] [--ground 0] [--csv results.csv]
+//       ParticleBench --validate
+//fill is the emit rate as a fraction of what keeps the pool exactly full over one lifetime
+//curl adds a curl noise ForceField of that many waves to the cpu and gpu designs, timed as part of the update
+//surface spawns the cpu and hybrid designs on a sphere of about that many triangles instead of in a box
+//ground bounces the cpu and gpu designs off a rippled slope of that many corners a side, timed as part of the update
+//validate runs correctness checks of the shared code instead of timing it, and exits non zero when any fails:
+//  spawn ring  Emitter's slots wrap on the pool size for pools that are not whole SIMD lanes
+//  gpu sort    GpuParticleReference with depth sorting passes Validate, and the sort shaders' passes match DispatchSort
+//  depth sort  SortBackToFront orders the finite depths farthest first with NaNs (killed particles) in the input
+//  budget      FitParticleBudget keeps the drawn particles under budgets up to far past what level of detail reaches
+//  effect file an effect round trips through the binary form, and both readers reject a lifetime that is not positive
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+#include "ParticleStreams.h"
+#include "ParticleSimulation.h"
+#include "ParticleRandom.h"
+#include "ParticleBudget.h"
+#include "EmitterDesc.h"
+#include "DepthSort.h"
+#include "GpuParticleReference.h"
+#include "ForceField.h"
+#include "MeshSampler.h"
+#include "Heightfield.h"
+
+namespace
+{
+	const float c_frameTime = 1.0f / 60.0f;
+	const float c_lifeTime = 2.0f;
+
+	//cpu expansion job size, the same as ParticleSystemManager's chunks
+	const unsigned int c_particlesPerChunk = 4096;
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct BenchConfig
+	{
+		std::string design;
+		unsigned int pool;
+		float fill;
+		unsigned int threads;
+		unsigned int frames;
+		unsigned int curlWaves;
+		const MeshSampler* surface;
+		unsigned int groundSize;
+	};
+
+	//what one run measured, times summed over the timed frames
+	struct BenchResult
+	{
+		double spawnNs = 0, updateNs = 0, expandNs = 0;
+		double spawned = 0, updated = 0, expanded = 0;
+		double uploadBytes = 0;
+		double frameNs = 0;
+		unsigned int live = 0;
+	};
+
+	double ElapsedNs(Clock::time_point start)
+	{
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+
+	double PerParticle(double ns, double count) { return count > 0 ? ns / count : 0.0; }
+
+	unsigned int EmitRate(const BenchConfig& config)
+	{
+		return (unsigned int)fmax(1.0, config.fill * config.pool / c_lifeTime);
+	}
+
+	ParticleSpawnParams BenchSpawnParams(const BenchConfig& config)
+	{
+		ParticleSpawnParams params =
+		{
+			{ -2, 8, 5 }, { 0.1f, 0.1f, 0.1f },
+			{ -2, 2, 0 }, { 0.2f, 0.2f, 0.2f },
+			{ -2, 2, -2, 2 },
+			NextParticleRandomKey(),
+			config.surface
+		};
+		return params;
+	}
+
+	//unit sphere of rings x 2 rings triangles, at least triangles of them, indexed like a loaded mesh
+	MeshSampler BenchSurface(unsigned int triangles)
+	{
+		unsigned int rings = 2;
+		while (rings * rings * 4 < triangles)
+			rings++;
+		unsigned int segments = rings * 2;
+
+		std::vector<float> positions;
+		for (unsigned int ring = 0; ring <= rings; ring++)
+		{
+			float polar = 3.14159265f * ring / rings;
+			for (unsigned int segment = 0; segment <= segments; segment++)
+			{
+				float azimuth = 6.28318531f * segment / segments;
+				positions.push_back(sinf(polar) * cosf(azimuth));
+				positions.push_back(cosf(polar));
+				positions.push_back(sinf(polar) * sinf(azimuth));
+			}
+		}
+
+		std::vector<unsigned int> indices;
+		for (unsigned int ring = 0; ring < rings; ring++)
+		{
+			for (unsigned int segment = 0; segment < segments; segment++)
+			{
+				unsigned int a = ring * (segments + 1) + segment, b = a + segments + 1;
+				unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+
+		return MeshSampler(positions.data(), sizeof(float) * 3, (unsigned int)positions.size() / 3, indices.data(), (unsigned int)indices.size());
+	}
+
+	//the same field for every design, empty when no curl waves are asked for
+	ForceField BenchForceField(const BenchConfig& config)
+	{
+		ForceField field;
+		if (config.curlWaves > 0)
+			field.SetCurlNoise(2.0f, 4.0f, 1.0f, config.curlWaves, 1);
+		return field;
+	}
+
+	//a 16 unit square of size x size corners around the emitter, rising faster than the particles climb so most of them hit it
+	Heightfield BenchGround(unsigned int size, const float emitter[3])
+	{
+		float cellSize = 16.0f / size;
+		float origin[3] = { emitter[0] - 8.0f, emitter[1], emitter[2] - 8.0f };
+		std::vector<float> heights((size_t)size * size);
+		for (unsigned int i = 0; i < size; i++)
+		{
+			for (unsigned int j = 0; j < size; j++)
+			{
+				float x = i * cellSize - 8.0f, z = j * cellSize - 8.0f;
+				heights[(size_t)i * size + j] = -1.2f * x + 0.3f * sinf(3.0f * x) * cosf(2.0f * z) - 0.5f;
+			}
+		}
+		return Heightfield(heights.data(), sizeof(float), size, size, origin, cellSize);
+	}
+
+	const ParticleCollision c_benchCollision = { ParticleCollision_Bounce, 0.4f, 0.3f };
+
+	ParticleExpandParams BenchExpandParams(double time)
+	{
+		ParticleExpandParams params =
+		{
+			(float)time,
+			{ 0, -1, 0 },
+			{ 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 },
+			{ 1, 0.1f, 0.1f, 0.7f }, { 1, 0.6f, 0.1f, 0 },
+			0.1f, 2.0f,
+			1.0f / c_lifeTime,
+			{ -2, 8, 5 }
+		};
+		return params;
+	}
+
+	//Emitter: UpdateEmitter is a Seek, and every drawn particle is expanded into four corners each frame
+	BenchResult RunCpu(const BenchConfig& config, JobSystem* jobs)
+	{
+		BenchResult result;
+
+		ParticleStreams streams;
+		streams.Allocate(config.pool);
+		std::vector<float> quads((size_t)config.pool * 4 * c_particleVertexFloats);
+
+		SpawnSchedule schedule;
+		schedule.interval = 1.0 / EmitRate(config);
+		schedule.burstCount = EmitRate(config);
+		ParticleSpawnParams spawn = BenchSpawnParams(config);
+		ForceField field = BenchForceField(config);
+		std::unique_ptr<Heightfield> ground;
+		if (config.groundSize > 0)
+			ground.reset(new Heightfield(BenchGround(config.groundSize, spawn.position)));
+
+		//steady state in closed form, the way Seek gets there
+		double time = c_lifeTime;
+		ParticleLiveRange live = LiveRangeAt(schedule, time, c_lifeTime, config.pool);
+		SpawnParticleStreams(streams, config.pool, schedule, spawn, live.first, live.last);
+
+		for (unsigned int frame = 0; frame < config.frames; frame++)
+		{
+			Clock::time_point frameStart = Clock::now();
+
+			Clock::time_point start = Clock::now();
+			time += c_frameTime;
+			ParticleLiveRange next = LiveRangeAt(schedule, time, c_lifeTime, config.pool);
+			unsigned int firstNew = std::max(next.first, live.last);
+			result.updateNs += ElapsedNs(start);
+			result.updated += next.last - next.first;
+
+			start = Clock::now();
+			SpawnParticleStreams(streams, config.pool, schedule, spawn, firstNew, next.last);
+			result.spawnNs += ElapsedNs(start);
+			result.spawned += next.last - firstNew;
+			live = next;
+
+			//Emitter::UpdateEmitter kicks and collides the live range's two runs of the ring after spawning
+			if (!field.IsEmpty() || ground)
+			{
+				start = Clock::now();
+				const float acc[3] = { 0, -1, 0 };
+				unsigned int firstSlot = live.first % config.pool;
+				unsigned int firstRun = std::min(live.last - live.first, config.pool - firstSlot);
+				if (!field.IsEmpty())
+				{
+					ApplyForceField(field, streams, firstSlot, firstSlot + firstRun, (float)time, c_frameTime, acc);
+					ApplyForceField(field, streams, 0, live.last - live.first - firstRun, (float)time, c_frameTime, acc);
+				}
+				if (ground)
+				{
+					CollideParticles(*ground, c_benchCollision, streams, firstSlot, firstSlot + firstRun, (float)time, acc);
+					CollideParticles(*ground, c_benchCollision, streams, 0, live.last - live.first - firstRun, (float)time, acc);
+				}
+				result.updateNs += ElapsedNs(start);
+			}
+
+			//the live range is contiguous on the ring but may wrap, like Emitter::ExpandRange
+			start = Clock::now();
+			unsigned int count = live.last - live.first;
+			unsigned int firstSlot = live.first % config.pool;
+			ParticleExpandParams params = BenchExpandParams(time);
+			auto expand = [&](unsigned int begin, unsigned int end)
+			{
+				while (begin < end)
+				{
+					unsigned int slot = (firstSlot + begin) % config.pool;
+					unsigned int run = std::min(end - begin, config.pool - slot);
+					ExpandParticleQuads(streams, slot, slot + run, params, quads.data() + (size_t)begin * 4 * c_particleVertexFloats);
+					begin += run;
+				}
+			};
+
+			if (jobs)
+			{
+				JobGroup group;
+				unsigned int chunks = (count + c_particlesPerChunk - 1) / c_particlesPerChunk;
+				jobs->ParallelFor(group, chunks, 1, [&](unsigned int begin, unsigned int end)
+				{
+					for (unsigned int chunk = begin; chunk < end; chunk++)
+					{
+						unsigned int first = chunk * c_particlesPerChunk;
+						expand(first, std::min(first + c_particlesPerChunk, count));
+					}
+				});
+				jobs->Wait(group);
+			}
+			else
+			{
+				expand(0, count);
+			}
+			result.expandNs += ElapsedNs(start);
+			result.expanded += count;
+			result.uploadBytes += (double)count * 4 * c_particleVertexFloats * sizeof(float);
+
+			result.frameNs += ElapsedNs(frameStart);
+		}
+
+		result.live = live.last - live.first;
+		streams.Release();
+		return result;
+	}
+
+	//HybridEmitter: retire and spawn records, then only the records spawned since the last frame cross the bus
+	BenchResult RunHybrid(const BenchConfig& config)
+	{
+		BenchResult result;
+
+		std::vector<HybridParticleRecord> pool(config.pool);
+		std::vector<HybridParticleRecord> upload(config.pool);
+
+		SpawnSchedule schedule;
+		schedule.interval = 1.0 / EmitRate(config);
+		ParticleSpawnParams spawn = BenchSpawnParams(config);
+
+		double time = 0;
+		unsigned int liveCount = 0, nextSpawn = 0, head = 0;
+		auto step = [&](double dt, BenchResult* measure)
+		{
+			Clock::time_point start = Clock::now();
+			time += dt;
+			liveCount -= CountExpiredParticles(pool.data(), config.pool, head, liveCount, time, c_lifeTime);
+
+			//when the pool is full the oldest particles make room, as in HybridEmitter::UpdateEmitter
+			unsigned int last = schedule.SpawnedBy(time);
+			unsigned int first = std::max(nextSpawn, last - std::min(last, config.pool));
+			unsigned int overflow = liveCount + (last - first);
+			liveCount -= overflow > config.pool ? overflow - config.pool : 0;
+			if (measure)
+			{
+				measure->updateNs += ElapsedNs(start);
+				measure->updated += liveCount;
+			}
+
+			start = Clock::now();
+			SpawnHybridParticles(pool.data(), config.pool, schedule, spawn, first, last);
+			if (measure)
+			{
+				measure->spawnNs += ElapsedNs(start);
+				measure->spawned += last - first;
+			}
+
+			//the append upload copies the new records out of the ring, the vertex shader does the rest
+			start = Clock::now();
+			unsigned int pending = last - first;
+			unsigned int firstSlot = first % config.pool;
+			unsigned int firstRun = std::min(pending, config.pool - firstSlot);
+			memcpy(upload.data(), pool.data() + firstSlot, sizeof(HybridParticleRecord) * firstRun);
+			memcpy(upload.data() + firstRun, pool.data(), sizeof(HybridParticleRecord) * (pending - firstRun));
+			if (measure)
+			{
+				measure->expandNs += ElapsedNs(start);
+				measure->expanded += pending;
+				measure->uploadBytes += (double)pending * sizeof(HybridParticleRecord);
+			}
+
+			liveCount += last - first;
+			nextSpawn = last;
+			head = (last - liveCount) % config.pool;
+		};
+
+		for (double warm = 0; warm < c_lifeTime; warm += c_frameTime)
+			step(c_frameTime, nullptr);
+
+		for (unsigned int frame = 0; frame < config.frames; frame++)
+		{
+			Clock::time_point frameStart = Clock::now();
+			step(c_frameTime, &result);
+			result.frameNs += ElapsedNs(frameStart);
+		}
+
+		result.live = liveCount;
+		return result;
+	}
+
+	//what GPUEmitter would be built with for this config
+	GpuEmitterSettings BenchGpuSettings(const BenchConfig& config)
+	{
+		GpuEmitterSettings settings = {};
+		settings.maxParticles = config.pool;
+		settings.emitRate = EmitRate(config);
+		settings.lifeTime = c_lifeTime;
+		settings.startSize = 0.1f;
+		settings.endSize = 2.0f;
+		float position[3] = { -2, 0, 5 }, velocity[3] = { -2, 2, 0 }, range[3] = { 0.1f, 0.1f, 0.1f };
+		float startColor[4] = { 1, 0.1f, 0.1f, 0.7f }, endColor[4] = { 1, 0.6f, 0.1f, 0 };
+		memcpy(settings.emitterPos, position, sizeof(position));
+		memcpy(settings.startVel, velocity, sizeof(velocity));
+		memcpy(settings.posRange, range, sizeof(range));
+		memcpy(settings.velRange, range, sizeof(range));
+		memcpy(settings.startColor, startColor, sizeof(startColor));
+		memcpy(settings.endColor, endColor, sizeof(endColor));
+		settings.randomKey = NextParticleRandomKey();
+		return settings;
+	}
+
+	//GPUEmitter: the kernels on their own, dispatched the way Update does
+	BenchResult RunGpu(const BenchConfig& config, JobSystem* jobs)
+	{
+		BenchResult result;
+		GpuEmitterSettings settings = BenchGpuSettings(config);
+		const float* position = settings.emitterPos;
+
+		//the constructor runs the dead list init, like GPUEmitter's
+		GpuParticleReference reference(settings, jobs);
+		ForceField field = BenchForceField(config);
+		if (!field.IsEmpty())
+			reference.SetForceField(&field);
+		std::unique_ptr<Heightfield> ground;
+		if (config.groundSize > 0)
+		{
+			ground.reset(new Heightfield(BenchGround(config.groundSize, position)));
+			reference.SetCollision(ground.get(), c_benchCollision);
+		}
+
+		//the draw count the args hold; GetDrawCount is one past it after SetArgs, which increments the counter too
+		auto drawn = [&]() { return reference.GetDrawArgs().indexCountPerInstance / 6; };
+
+		//same emit count as GPUEmitter::Update
+		float emitCounter = 0.0f, totalTime = 0.0f;
+		float timePerEmit = 1.0f / settings.emitRate;
+		auto step = [&](BenchResult* measure)
+		{
+			totalTime += c_frameTime;
+			emitCounter += c_frameTime;
+			unsigned int emitCount = 0;
+			if (emitCounter >= timePerEmit)
+			{
+				emitCount = (unsigned int)(emitCounter / timePerEmit);
+				emitCount = std::min(emitCount, 65535u);
+				emitCounter = fmod(emitCounter, timePerEmit);
+			}
+
+			Clock::time_point start = Clock::now();
+			uint32_t deadBefore = reference.GetDeadCount();
+			if (emitCount)
+				reference.DispatchEmit(emitCount, totalTime);
+			if (measure)
+			{
+				measure->spawnNs += ElapsedNs(start);
+				measure->spawned += deadBefore - reference.GetDeadCount();
+			}
+
+			start = Clock::now();
+			reference.DispatchUpdate(c_frameTime, totalTime);
+			if (measure)
+			{
+				measure->updateNs += ElapsedNs(start);
+				measure->updated += config.pool;
+			}
+
+			//the draw list is the gpu side "expansion", the corners come from the vertex shader
+			start = Clock::now();
+			reference.DispatchSetArgs(6);
+			if (measure)
+			{
+				measure->expandNs += ElapsedNs(start);
+				measure->expanded += drawn();
+			}
+		};
+
+		for (float warm = 0; warm < c_lifeTime; warm += c_frameTime)
+			step(nullptr);
+
+		for (unsigned int frame = 0; frame < config.frames; frame++)
+		{
+			Clock::time_point frameStart = Clock::now();
+			step(&result);
+			result.frameNs += ElapsedNs(frameStart);
+		}
+
+		result.live = drawn();
+		return result;
+	}
+
+	//Emitter's ring: spawns wrap on the pool size, not on the SIMD rounded stream capacity, so every live particle in a
+	//wrapped range must match the same spawn index written to a ring that never wraps
+	std::string CheckSpawnRing(unsigned int pool)
+	{
+		BenchConfig config = { "cpu", pool, 1.0f, 1, 0, 0, nullptr, 0 };
+		SpawnSchedule schedule;
+		schedule.interval = 1.0 / EmitRate(config);
+		ParticleSpawnParams spawn = BenchSpawnParams(config);
+
+		//a lifetime and a half in, in two steps, so the live range crosses the end of the pool
+		ParticleLiveRange early = LiveRangeAt(schedule, c_lifeTime, c_lifeTime, pool);
+		ParticleLiveRange live = LiveRangeAt(schedule, c_lifeTime * 1.5, c_lifeTime, pool);
+
+		ParticleStreams ring, flat;
+		ring.Allocate(pool);
+		flat.Allocate(live.last);
+		SpawnParticleStreams(ring, pool, schedule, spawn, early.first, early.last);
+		SpawnParticleStreams(ring, pool, schedule, spawn, std::max(live.first, early.last), live.last);
+		SpawnParticleStreams(flat, live.last, schedule, spawn, live.first, live.last);
+
+		std::string error;
+		for (unsigned int n = live.first; n < live.last && error.empty(); n++)
+		{
+			unsigned int slot = n % pool;
+			if (ring.spawnTime[slot] != flat.spawnTime[n] || ring.posX[slot] != flat.posX[n] || ring.posY[slot] != flat.posY[n] ||
+				ring.velX[slot] != flat.velX[n] || ring.velZ[slot] != flat.velZ[n] || ring.rotEnd[slot] != flat.rotEnd[n])
+				error = "spawn " + std::to_string(n) + " of a pool of " + std::to_string(pool) + " (streams of " +
+					std::to_string(ring.capacity) + ") is not in slot " + std::to_string(slot);
+		}
+		ring.Release();
+		flat.Release();
+		return error;
+	}
+
+	//SortBackToFront with NaN depths (ground killed particles) among the others; count 8 is a fixed case, larger counts
+	//are random with every seventh depth NaN and every thirteenth infinite, big enough for the parallel passes
+	std::string CheckDepthSort(unsigned int count, JobSystem* jobs)
+	{
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+		std::vector<float> depths = { nan, 5, 1, 7, 3, 9, 2, 4 };
+		if (count != 8)
+		{
+			depths.resize(count);
+			for (unsigned int i = 0; i < count; i++)
+			{
+				float random = ParticleRandomFloat(0x5eed, i, 0);
+				depths[i] = i % 7 == 3 ? nan : i % 13 == 5 ? std::numeric_limits<float>::infinity() : 1.0f + 100.0f * random;
+			}
+		}
+
+		std::vector<unsigned int> order(count);
+		DepthSortScratch scratch;
+		SortBackToFront(depths.data(), count, order.data(), scratch, jobs);
+
+		//every index once, the finite depths farthest first, and none of them sorted as if the range were empty
+		std::vector<bool> seen(count, false);
+		float previous = std::numeric_limits<float>::max();
+		unsigned int finite = 0;
+		for (unsigned int k = 0; k < count; k++)
+		{
+			unsigned int i = order[k];
+			if (i >= count || seen[i])
+				return "index " + std::to_string(i) + " at " + std::to_string(k) + " is out of range or repeated";
+			seen[i] = true;
+			if (!std::isfinite(depths[i]))
+				continue;
+
+			//22 bit keys over a range of 100, so neighbours closer than that may come in input order
+			if (depths[i] > previous + 100.0f / (1 << 21))
+				return "depth " + std::to_string(depths[i]) + " at " + std::to_string(k) + " comes after " + std::to_string(previous);
+			previous = depths[i];
+			finite++;
+		}
+		if (count == 8 && order != std::vector<unsigned int>{ 0, 5, 3, 1, 7, 4, 6, 2 })
+			return "a leading NaN leaves the order unsorted";
+		return finite > 0 ? "" : "no finite depths";
+	}
+
+	//FitParticleBudget on emitters of 1000 to 12000 particles, some already thinned out by screen size, over budgets
+	//from within what detail 16 can reach to over a hundred times past it
+	std::string CheckParticleBudget(unsigned int budget)
+	{
+		const unsigned int maxDetail = 16;
+		std::vector<BudgetedEmitter> emitters;
+		for (unsigned int i = 0; i < 12; i++)
+			emitters.push_back(BudgetedEmitter{ 1000 * (i + 1), 0.05f * ((i * 7) % 12 + 1), 1 + i % 3, false });
+		std::vector<BudgetedEmitter> before = emitters;
+		FitParticleBudget(emitters, budget, maxDetail);
+
+		double drawn = 0.0, thinnest = 0.0;
+		float largestDropped = 0.0f, smallestKept = 1e30f;
+		for (size_t i = 0; i < emitters.size(); i++)
+		{
+			const BudgetedEmitter& emitter = emitters[i];
+			thinnest += (double)before[i].particles / maxDetail;
+			if (emitter.detail < before[i].detail || emitter.detail > maxDetail)
+				return "detail " + std::to_string(emitter.detail) + " from " + std::to_string(before[i].detail);
+			if (emitter.dropped)
+			{
+				largestDropped = std::max(largestDropped, emitter.screenSize);
+				continue;
+			}
+			drawn += (double)emitter.particles / emitter.detail;
+			smallestKept = std::min(smallestKept, emitter.screenSize);
+		}
+
+		if (drawn > budget)
+			return std::to_string((unsigned int)drawn) + " drawn, " + std::to_string((unsigned int)(thinnest * maxDetail / budget)) + " times over";
+		if (largestDropped > smallestKept)
+			return "dropped an emitter larger on screen than one kept";
+		if (thinnest <= budget && largestDropped > 0.0f)
+			return "dropped an emitter when thinning out was enough";
+		return "";
+	}
+
+	//an effect through WriteEffectBinary and back, and the same with lifeTime set to lifeTime, which has to be
+	//rejected by both readers when it is not positive
+	std::string CheckEffectFile(float lifeTime)
+	{
+		std::vector<EmitterDesc> descs(2, DefaultEmitterDesc());
+		strcpy(descs[0].name, "good");
+		strcpy(descs[1].name, "checked");
+		descs[1].lifeTime = lifeTime;
+		bool valid = lifeTime > 0.0f;
+
+		std::vector<unsigned char> bytes = WriteEffectBinary(descs);
+		std::vector<EmitterDesc> read;
+		std::string error;
+		if (ReadEffectBinary(bytes.data(), bytes.size(), read, error) != valid)
+			return valid ? "binary read failed: " + error : "binary read took a lifetime of " + std::to_string(lifeTime);
+		if (valid && (read.size() != 2 || memcmp(read.data(), descs.data(), sizeof(EmitterDesc) * 2) != 0))
+			return "binary read gave back different emitters";
+
+		std::string text = FormatEffectText(descs);
+		if (ParseEffectText(text.data(), text.size(), read, error) != valid)
+			return valid ? "text parse failed: " + error : "text parse took a lifetime of " + std::to_string(lifeTime);
+		return "";
+	}
+
+	//SORT_BLOCK and SORT_THREADS in ParticleSort.hlsli
+	const uint32_t c_sortBlock = 1024;
+	const uint32_t c_sortThreads = 512;
+
+	//SortPair in ParticleSort.hlsli
+	void SortPair(uint32_t p, uint32_t sortSize, uint32_t stride, uint32_t& lower, uint32_t& upper)
+	{
+		uint32_t block = p / stride;
+		uint32_t offset = p % stride;
+		lower = block * stride * 2 + offset;
+		upper = (stride * 2 == sortSize) ? block * sortSize + sortSize - 1 - offset : lower + stride;
+	}
+
+	//GPUEmitter::SortDrawList the way its passes run, which DispatchSort only matches as a whole: ParticleSortLocalCS over
+	//every block, then per larger stage ParticleSortStepCS for the steps across blocks and ParticleSortMergeCS for the rest
+	//the block passes see the entries past count as the padding LoadSortBlock gives them, compared like any other
+	void ModelSortPasses(std::vector<GpuDrawRecord>& list, uint32_t count, unsigned int maxParticles)
+	{
+		const GpuDrawRecord padding = { 0, -1.0f };
+		uint32_t groups = (count + c_sortBlock - 1) / c_sortBlock;
+		uint32_t pairThreads = (count + c_sortThreads - 1) / c_sortThreads * c_sortThreads;
+
+		auto sharedStep = [](GpuDrawRecord* shared, uint32_t sortSize, uint32_t stride)
+		{
+			for (uint32_t thread = 0; thread < c_sortThreads; thread++)
+			{
+				uint32_t lower, upper;
+				SortPair(thread, sortSize, stride, lower, upper);
+				if (shared[upper].distanceSq > shared[lower].distanceSq)
+					std::swap(shared[lower], shared[upper]);
+			}
+		};
+		auto blockPass = [&](uint32_t firstSize, uint32_t lastSize)
+		{
+			GpuDrawRecord shared[c_sortBlock];
+			for (uint32_t group = 0; group < groups; group++)
+			{
+				for (uint32_t e = 0; e < c_sortBlock; e++)
+				{
+					uint32_t i = group * c_sortBlock + e;
+					shared[e] = i < count ? list[i] : padding;
+				}
+				//the merge pass starts at the stride below a block, whatever the stage
+				for (uint32_t sortSize = firstSize; sortSize <= lastSize; sortSize *= 2)
+					for (uint32_t stride = std::min(sortSize, c_sortBlock) / 2; stride > 0; stride /= 2)
+						sharedStep(shared, sortSize, stride);
+				for (uint32_t e = 0; e < c_sortBlock; e++)
+				{
+					uint32_t i = group * c_sortBlock + e;
+					if (i < count)
+						list[i] = shared[e];
+				}
+			}
+		};
+
+		blockPass(2, c_sortBlock);
+
+		uint32_t sortLimit = c_sortBlock;
+		while (sortLimit < maxParticles)
+			sortLimit *= 2;
+		for (uint32_t sortSize = c_sortBlock * 2; sortSize <= sortLimit; sortSize *= 2)
+		{
+			for (uint32_t step = sortSize / 2; step >= c_sortBlock; step /= 2)
+			{
+				for (uint32_t p = 0; p < pairThreads; p++)
+				{
+					uint32_t lower, upper;
+					SortPair(p, sortSize, step, lower, upper);
+					if (upper < count && list[upper].distanceSq > list[lower].distanceSq)
+						std::swap(list[lower], list[upper]);
+				}
+			}
+			blockPass(sortSize, sortSize);
+		}
+	}
+
+	//GPUEmitter with depth sorting on, one frame at a time under a moving camera: the reference must pass Validate after
+	//every frame, and the pass by pass model of the sort shaders must give the very order DispatchSort does
+	std::string CheckGpuSort(unsigned int pool)
+	{
+		//emitting the whole pool over a lifetime keeps well over one sort block live
+		BenchConfig config = { "gpu", pool, 2.0f, 1, 0, 0, nullptr, 0 };
+		GpuEmitterSettings settings = BenchGpuSettings(config);
+		settings.depthSort = true;
+		GpuParticleReference reference(settings);
+
+		float emitCounter = 0.0f, totalTime = 0.0f;
+		float timePerEmit = 1.0f / settings.emitRate;
+		std::vector<GpuDrawRecord> unsorted;
+		for (unsigned int frame = 0; frame < 150; frame++)
+		{
+			totalTime += c_frameTime;
+			float view[3] = { 10.0f * cosf(totalTime), 5.0f, 10.0f * sinf(totalTime) };
+			reference.SetViewPosition(view);
+
+			//GpuParticleReference::Update step by step, to catch the list between the update and the sort
+			emitCounter += c_frameTime;
+			if (emitCounter >= timePerEmit)
+			{
+				reference.DispatchEmit(std::min((unsigned int)(emitCounter / timePerEmit), 65535u), totalTime);
+				emitCounter = fmod(emitCounter, timePerEmit);
+			}
+			reference.DispatchUpdate(c_frameTime, totalTime);
+
+			uint32_t count = reference.GetDrawCount();
+			unsorted = reference.GetDrawList();
+			reference.DispatchSort();
+			reference.DispatchSetArgs(6);
+
+			std::string error = reference.Validate();
+			if (!error.empty())
+				return "frame " + std::to_string(frame) + ": " + error;
+
+			ModelSortPasses(unsorted, count, pool);
+			const std::vector<GpuDrawRecord>& sorted = reference.GetDrawList();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (unsorted[i].index != sorted[i].index || unsorted[i].distanceSq != sorted[i].distanceSq)
+					return "frame " + std::to_string(frame) + ": the sort passes put particle " + std::to_string(unsorted[i].index) +
+						" at " + std::to_string(i) + " of " + std::to_string(count) + ", DispatchSort put " + std::to_string(sorted[i].index);
+			}
+		}
+		return std::string();
+	}
+
+	//every check, pool sizes that are not whole SIMD lanes or powers of two among them
+	bool Validate()
+	{
+		bool passed = true;
+		auto report = [&](const char* check, float size, const std::string& error)
+		{
+			printf("%-12s %9.9g %s\n", check, size, error.empty() ? "ok" : error.c_str());
+			passed = passed && error.empty();
+		};
+		for (unsigned int pool : { 7u, 210u, 1000u, 4099u })
+			report("spawn ring", (float)pool, CheckSpawnRing(pool));
+		for (unsigned int pool : { 300u, 1000u, 1500u, 3000u, 5000u })
+			report("gpu sort", (float)pool, CheckGpuSort(pool));
+
+		for (unsigned int budget : { 1000000u, 30000u, 3000u, 1000u, 200u, 50u })
+			report("budget", (float)budget, CheckParticleBudget(budget));
+
+		JobSystem jobs(3);
+		for (unsigned int count : { 8u, 1000u, 100000u })
+			report("depth sort", (float)count, CheckDepthSort(count, &jobs));
+
+		for (float lifeTime : { 2.0f, 0.0f, -1.0f, std::numeric_limits<float>::quiet_NaN() })
+			report("effect file", lifeTime, CheckEffectFile(lifeTime));
+		return passed;
+	}
+
+	template <typename T, typename Parse>
+	std::vector<T> ParseList(const char* text, Parse parse)
+	{
+		std::vector<T> values;
+		std::string list(text);
+		size_t start = 0;
+		while (start <= list.size())
+		{
+			size_t end = list.find(',', start);
+			if (end == std::string::npos) end = list.size();
+			if (end > start)
+				values.push_back(parse(list.substr(start, end - start)));
+			start = end + 1;
+		}
+		return values;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<unsigned int> pools = { 1000, 10000, 100000, 1000000, 10000000 };
+	std::vector<float> fills = { 0.5f, 1.0f };
+	std::vector<unsigned int> threads = { 1 };
+	unsigned int hardware = std::thread::hardware_concurrency();
+	if (hardware > 1) threads.push_back(hardware);
+	std::vector<std::string> designs = { "cpu", "hybrid", "gpu" };
+	unsigned int frames = 60;
+	unsigned int curlWaves = 0;
+	unsigned int surfaceTriangles = 0;
+	unsigned int groundSize = 0;
+	const char* csvPath = nullptr;
+
+	auto toUint = [](const std::string& s) { return (unsigned int)strtoul(s.c_str(), nullptr, 10); };
+	auto toFloat = [](const std::string& s) { return strtof(s.c_str(), nullptr); };
+	auto toString = [](const std::string& s) { return s; };
+
+	const char* usage = "usage: ParticleBench [--pools 1000,10000,...] [--fill 0.5,1,2] [--threads 1,4,...] [--designs cpu,hybrid,gpu]\n"
+		"                     [--frames 60] [--curl 0] [--surface 0] [--ground 0] [--csv results.csv]\n"
+		"       ParticleBench --validate\n";
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--validate")
+			return Validate() ? 0 : 1;
+		if (i + 1 >= argc)
+		{
+			fprintf(stderr, "%s needs a value\n%s", argv[i], usage);
+			return 1;
+		}
+		const char* value = argv[++i];
+		if (option == "--pools") pools = ParseList<unsigned int>(value, toUint);
+		else if (option == "--fill") fills = ParseList<float>(value, toFloat);
+		else if (option == "--threads") threads = ParseList<unsigned int>(value, toUint);
+		else if (option == "--designs") designs = ParseList<std::string>(value, toString);
+		else if (option == "--frames") frames = toUint(value);
+		else if (option == "--curl") curlWaves = toUint(value);
+		else if (option == "--surface") surfaceTriangles = toUint(value);
+		else if (option == "--ground") groundSize = toUint(value);
+		else if (option == "--csv") csvPath = value;
+		else
+		{
+			fprintf(stderr, "unknown option %s\n%s", argv[i - 1], usage);
+			return 1;
+		}
+	}
+
+	FILE* csv = nullptr;
+	if (csvPath)
+	{
+		csv = fopen(csvPath, "w");
+		if (!csv)
+		{
+			fprintf(stderr, "cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "design,pool,emit_rate,threads,frames,live,spawn_ns_per_particle,update_ns_per_particle,expand_ns_per_particle,upload_bytes_per_frame,frame_ms\n");
+	}
+
+	std::unique_ptr<MeshSampler> surface;
+	if (surfaceTriangles > 0)
+	{
+		surface.reset(new MeshSampler(BenchSurface(surfaceTriangles)));
+		printf("spawning on a sphere of %u triangles\n", surface->GetTriangleCount());
+	}
+
+	printf("%-7s %9s %9s %3s %9s %10s %10s %10s %14s %9s\n", "design", "pool", "rate", "thr", "live", "spawn ns", "update ns", "expand ns", "upload B/frm", "frame ms");
+
+	for (unsigned int threadCount : threads)
+	{
+		//the calling thread helps in Wait, so n threads is n - 1 workers
+		std::unique_ptr<JobSystem> jobs;
+		if (threadCount > 1)
+			jobs.reset(new JobSystem(threadCount - 1));
+
+		for (const std::string& design : designs)
+		{
+			for (unsigned int pool : pools)
+			{
+				for (float fill : fills)
+				{
+					BenchConfig config = { design, pool, fill, threadCount, frames, curlWaves, surface.get(), groundSize };
+					BenchResult result;
+
+					try
+					{
+						if (design == "cpu") result = RunCpu(config, jobs.get());
+						else if (design == "hybrid") result = RunHybrid(config);
+						else if (design == "gpu") result = RunGpu(config, jobs.get());
+						else
+						{
+							fprintf(stderr, "unknown design %s\n", design.c_str());
+							return 1;
+						}
+					}
+					catch (const std::bad_alloc&)
+					{
+						printf("%-7s %9u skipped, out of memory\n", design.c_str(), pool);
+						continue;
+					}
+
+					double spawn = PerParticle(result.spawnNs, result.spawned);
+					double update = PerParticle(result.updateNs, result.updated);
+					double expand = PerParticle(result.expandNs, result.expanded);
+					double upload = result.uploadBytes / frames;
+					double frameMs = result.frameNs / frames * 1e-6;
+
+					printf("%-7s %9u %9u %3u %9u %10.3f %10.3f %10.3f %14.0f %9.3f\n",
+						design.c_str(), pool, EmitRate(config), threadCount, result.live, spawn, update, expand, upload, frameMs);
+					if (csv)
+					{
+						fprintf(csv, "%s,%u,%u,%u,%u,%u,%.4f,%.4f,%.4f,%.0f,%.4f\n",
+							design.c_str(), pool, EmitRate(config), threadCount, frames, result.live, spawn, update, expand, upload, frameMs);
+						fflush(csv);
+					}
+				}
+			}
+		}
+	}
+
+	if (csv)
+		fclose(csv);
+	return 0;
+}